@@ -5,6 +5,11 @@
 #ifndef REDIS_DESIGN_ROBJ_H
 #define REDIS_DESIGN_ROBJ_H
 
+/**
+ * robj.lru 字段的位数
+ */
+#define LRU_BITS 24
+
 /**
  * Redis中的对象结构定义。
  */
@@ -12,6 +17,9 @@ typedef struct redis_object
 {
     unsigned int type;  //类型
     unsigned encoding;  //编码
+    //LRU 策略下为对象最后一次被访问时的 LRU 时钟；
+    //LFU 策略下高 16 位为最后一次递减访问计数的时间（分钟），低 8 位为对数访问计数
+    unsigned lru:LRU_BITS;
     void * ptr;         //指向底层实现数据结构的指针
 } robj;
 
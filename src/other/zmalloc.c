@@ -1,22 +1,184 @@
 //
 // Created by Administrator on 2022/2/27.
 //
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/mman.h>
+
 #include "zmalloc.h"
 
+/**
+ * 通过 z_* 函数分配、尚未释放的内存的字节数（按 malloc 实际分配的大小计算）
+ *
+ * 多个线程（比如后台释放线程）会同时分配和释放内存，所以通过原子操作访问
+ */
+static size_t used_memory = 0;
+
+#define update_z_malloc_stat_alloc(ptr) \
+    __atomic_add_fetch(&used_memory, malloc_usable_size(ptr), __ATOMIC_RELAXED)
+#define update_z_malloc_stat_free(ptr) \
+    __atomic_sub_fetch(&used_memory, malloc_usable_size(ptr), __ATOMIC_RELAXED)
+
 void * z_malloc(size_t size)
 {
     void * ptr = malloc(size);
 
     if (ptr)
+    {
+        update_z_malloc_stat_alloc(ptr);
         return ptr;
+    }
     else
         return NULL;
 }
 
+/**
+ * 分配 size 字节并清零
+ */
+void * z_calloc(size_t size)
+{
+    void * ptr = calloc(1, size);
+
+    if (ptr)
+        update_z_malloc_stat_alloc(ptr);
+    return ptr;
+}
+
+/**
+ * 调整 ptr 的大小，ptr 为 NULL 时等同于 z_malloc() ；
+ * 失败时返回 NULL ，ptr 保持不变
+ */
+void * z_realloc(void * ptr, size_t size)
+{
+    size_t oldSize;
+    void * newPtr;
+
+    if (ptr == NULL)
+        return z_malloc(size);
+
+    oldSize = malloc_usable_size(ptr);
+    newPtr = realloc(ptr, size);
+    if (newPtr == NULL)
+        return NULL;
+
+    __atomic_sub_fetch(&used_memory, oldSize, __ATOMIC_RELAXED);
+    update_z_malloc_stat_alloc(newPtr);
+    return newPtr;
+}
+
+/**
+ * 分配 size 字节，起始地址按 alignment 对齐，alignment 必须是 2 的幂，
+ * 返回的内存同样通过 z_free() 释放
+ */
+void * z_malloc_aligned(size_t alignment, size_t size)
+{
+    void * ptr;
+
+    if (posix_memalign(&ptr, alignment, size) != 0)
+        return NULL;
+
+    update_z_malloc_stat_alloc(ptr);
+    return ptr;
+}
+
 void z_free(void * ptr)
 {
     if (ptr == NULL)
         return;
     else
+    {
+        update_z_malloc_stat_free(ptr);
         free(ptr);
+    }
+}
+
+/**
+ * 返回 ptr 实际占用的字节数
+ */
+size_t z_malloc_size(void * ptr)
+{
+    return malloc_usable_size(ptr);
+}
+
+/**
+ * 返回通过 z_* 函数分配、尚未释放的内存的字节数
+ */
+size_t z_malloc_used_memory(void)
+{
+    return __atomic_load_n(&used_memory, __ATOMIC_RELAXED);
+}
+
+/**
+ * 返回 z_calloc_huge(size) 实际映射的字节数，即 size 按大页的大小向上取整
+ */
+size_t z_huge_size(size_t size)
+{
+    return (size + Z_HUGE_PAGE_SIZE - 1) & ~(size_t)(Z_HUGE_PAGE_SIZE - 1);
+}
+
+/**
+ * 通过 mmap 分配 size 字节并清零，用于很大的、随机访问的数组，
+ * 每个大页只占一个 TLB 项，随机访问时的 TLB 缺失比 4 KiB 的普通页少得多
+ *
+ * 映射的长度为 z_huge_size(size) ，计入 z_malloc_used_memory() ，必须通过 z_free_huge() 释放
+ *
+ * @param size 字节数
+ * @param mode 页类型，见 Z_HUGE_*
+ * @return 按大页对齐的内存，失败时返回 NULL
+ */
+void * z_calloc_huge(size_t size, int mode)
+{
+    size_t len = z_huge_size(size);
+    char * base, * ptr;
+
+#if defined(MAP_HUGETLB)
+    if (mode == Z_HUGE_HUGETLB)
+    {
+        int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB;
+
+#if defined(MAP_HUGE_2MB)
+        flags |= MAP_HUGE_2MB;
+#endif
+        ptr = mmap(NULL, len, PROT_READ | PROT_WRITE, flags, -1, 0);
+        if (ptr != MAP_FAILED)
+            goto done;
+        mode = Z_HUGE_MADVISE;
+    }
+#endif
+
+    //透明大页只能用在对齐的区域上，多映射一个大页，再截掉首尾不对齐的部分
+    base = mmap(NULL, len + Z_HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED)
+        return NULL;
+    ptr = (char *)(((uintptr_t)base + Z_HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(Z_HUGE_PAGE_SIZE - 1));
+    if (ptr > base)
+        munmap(base, ptr - base);
+    if (ptr + len < base + len + Z_HUGE_PAGE_SIZE)
+        munmap(ptr + len, base + Z_HUGE_PAGE_SIZE - ptr);
+
+#if defined(MADV_HUGEPAGE)
+    madvise(ptr, len, mode == Z_HUGE_OFF ? MADV_NOHUGEPAGE : MADV_HUGEPAGE);
+#endif
+
+done:
+    __atomic_add_fetch(&used_memory, len, __ATOMIC_RELAXED);
+    return ptr;
+}
+
+/**
+ * 释放 z_calloc_huge() 分配的内存
+ *
+ * @param ptr 内存，为 NULL 时什么也不做
+ * @param size 分配时的 size 参数
+ */
+void z_free_huge(void * ptr, size_t size)
+{
+    size_t len = z_huge_size(size);
+
+    if (ptr == NULL)
+        return;
+
+    munmap(ptr, len);
+    __atomic_sub_fetch(&used_memory, len, __ATOMIC_RELAXED);
 }
@@ -8,9 +8,27 @@
 #include <sys/types.h>
 #include <malloc.h>
 
+/**
+ * z_calloc_huge() 使用的大页的大小
+ */
+#define Z_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+/**
+ * z_calloc_huge() 的页类型
+ */
+#define Z_HUGE_OFF      0   //普通页，禁止透明大页
+#define Z_HUGE_MADVISE  1   //通过 MADV_HUGEPAGE 请求透明大页
+#define Z_HUGE_HUGETLB  2   //hugetlbfs 预留的大页，不够时退回 Z_HUGE_MADVISE
+
 void * z_malloc(size_t size);
 void * z_calloc(size_t size);
 void * z_realloc(void * ptr, size_t size);
+void * z_malloc_aligned(size_t alignment, size_t size);
 void z_free(void * ptr);
+size_t z_malloc_size(void * ptr);
+size_t z_malloc_used_memory(void);
+void * z_calloc_huge(size_t size, int mode);
+void z_free_huge(void * ptr, size_t size);
+size_t z_huge_size(size_t size);
 
 #endif //REDIS_DESIGN_ZMALLOC_H
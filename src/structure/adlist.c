@@ -81,7 +81,7 @@ list * listAddNodeTail(list * lt, void * value)
     listNode * node;
 
     //分配内存
-    if ( (node = z_malloc(sizeof(node))) == NULL)
+    if ( (node = z_malloc(sizeof(listNode))) == NULL)
         return NULL;
 
     node->value = value;
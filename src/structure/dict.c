@@ -9,8 +9,15 @@
 #include <ctype.h>
 #include <stdlib.h>
 #include <sys/time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include "dict.h"
+#include "dicthash.h"
 #include "zmalloc.h"
 #include "redisassert.h"
 
@@ -23,25 +30,169 @@
  * 程序可以手动地允许或阻止哈希表进行 rehash ，
  * 这在 Redis 使用子进程进行保存操作时，可以有效地利用 copy-on-write 机制。
  *
- * Note that even when dict_can_resize is set to 0, not all resizes are
- * prevented: a hash table is still allowed to grow if the ratio between
- * the number of elements and the buckets > dict_force_resize_ratio.
+ * 这两个函数修改的是默认策略的状态，
+ * 通过 dictSetResizePolicy() 使用了其他策略的字典不受影响。
  *
  * 需要注意的是，并非所有 rehash 都会被 dictDisableResize 阻止：
- * 如果已使用节点的数量和字典大小之间的比率，
- * 大于字典强制 rehash 比率 dict_force_resize_ratio ，
- * 那么 rehash 仍然会（强制）进行。
+ * 如果已使用节点的数量和字典容量之间的比率，
+ * 大于策略的强制 rehash 比率 forceRatio ，
+ * 那么扩展仍然会（强制）进行。
  */
-//指示字典是否启用rehash的标识
-static int dict_can_resize = 1;
-//强制rehash的比率
-static unsigned int dict_force_resize_ratio = 5;
+//没有指定策略的字典使用的默认 resize 策略
+static dictResizePolicy dict_default_resize_policy = DICT_RESIZE_POLICY_DEFAULT;
+
+//大的桶数组使用的页，见 dictSetHugePages()
+static int dict_huge_pages = DICT_HUGE_PAGES_MADVISE;
 
 /* private prototypes */
 static int _dictExpandIfNeeded(dict * ht);
-static unsigned long _dictNextPower(unsigned long size);
-static int _dictKeyIndex(dict * ht, const void * key);
+static int _dictShrinkIfNeeded(dict * d);
+static long _dictKeyIndex(dict * ht, const void * key, uint64_t hash, dictEntry ** existing);
 static int _dictInit(dict * ht, dictType * type, void * privDataPtr);
+static void _dictBgRehashStart(dict * d);
+static void _dictBgRehashStop(dict * d);
+static int _dictBgRehashPoll(dict * d);
+static void _dictBgRehashPause(dict * d);
+static void _dictBgRehashResume(struct dictRehashWorker * w);
+static struct dictSpinlock * _dictStripeAcquire(dict * d, uint64_t h);
+static void _dictStripeRelease(struct dictSpinlock * lock);
+static dictEntry * _dictAddWithHash(dict * d, void * key, uint64_t hash, void * val, int setVal,
+                                     dictEntry ** existing);
+static void _dictRetire(dict * d, int kind, void * ptr);
+static void _dictRetireTable(dict * d, void * table, unsigned long size);
+static void _dictReclaim(dict * d);
+static void _dictRetiredFreeAll(dict * d);
+static void _dictEpochSynchronize(void);
+static struct dictSnapshotBucket * _dictSnapshotTouch(dict * d, int table, unsigned long idx);
+static dictEntry * _dictUnlink(dict * d, const void * key, struct dictSnapshotBucket ** saved);
+static struct dictSnapshotBucket * _dictSnapshotLookup(dict * d, int table, unsigned long idx, int create);
+static int _dictSnapshotKeep(struct dictSnapshotBucket * b, dictEntry * de, int flag);
+static int _dictSnapshotKeepVal(dict * d, dictEntry * de, uint64_t h);
+static int _dictSnapshotKeepUnlinked(dict * d, dictEntry * de);
+static unsigned long _dictScanCursor(dict * d, unsigned long v, dictScanFunction * fn, void * privData);
+
+//取哈希值的最高 8 位作为分组哈希表的标签，桶的索引使用的是低位，两者互不相关
+#define dictHashTag(h) ((uint8_t)((h) >> (8 * sizeof(h) - 8)))
+
+//返回节点的键的哈希值，节点缓存了哈希值时不必重新计算
+#define dictEntryHashKey(d, he) \
+    (dictStoresHash(d) ? dictGetEntryHash(he) : dictHashKey(d, (he)->key))
+
+//判断节点 he 的键是否等于哈希值为 h 的键 key
+//节点缓存了哈希值时先比对哈希值，哈希值不同就不必解引用节点的键
+#define dictEntryMatch(d, he, key, h) \
+    ((!dictStoresHash(d) || dictGetEntryHash(he) == (h)) && dictCompareKeys(d, key, (he)->key))
+
+//写入无锁读者可能正在读取的指针或字段，保证读者看到的总是完整的值，
+//并且在看到新节点的指针时，一定也能看到节点初始化时写入的内容
+#define dictPublish(ptr, val) __atomic_store_n((ptr), (val), __ATOMIC_RELEASE)
+//无锁读者读取写者可能正在修改的指针或字段，与 dictPublish 配对
+#define dictConsume(ptr) __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+
+//dictRetire 的对象类型
+#define DICT_RETIRED_ENTRY          0   //节点，释放时调用键和值的释放函数
+#define DICT_RETIRED_ENTRY_NOFREE   1   //节点，释放时不调用键和值的释放函数
+#define DICT_RETIRED_VAL            2   //被替换下来的值
+#define DICT_RETIRED_TABLE          3   //哈希表数组的一段
+#define DICT_RETIRED_DIRECTORY      4   //哈希表数组的段目录
+
+//快照保存的节点的状态
+#define DICT_SNAPSHOT_DEAD          (1 << 0)    //节点已经被删除，由快照负责释放
+#define DICT_SNAPSHOT_DEAD_NOFREE   (1 << 1)    //节点已经被 dictDeleteNoFree() 删除，释放时不调用键值的释放函数
+#define DICT_SNAPSHOT_OWN_VAL       (1 << 2)    //快照时的值已经被替换，由快照负责释放
+
+/**
+ * 开始修改无锁读者可能正在访问的哈希表结构（迁移节点、移动组内节点、替换哈希表）
+ *
+ * 写序列号在修改期间为奇数，无锁读者在没有找到键时检查序列号，
+ * 序列号变化过说明这次查找可能因为并发修改而漏掉了键，需要重新查找。
+ */
+static inline void _dictWriteBegin(dict * d)
+{
+    if (!d->concurrent) return;
+
+    __atomic_store_n(&d->seq, d->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+/**
+ * 结束 _dictWriteBegin() 开始的修改
+ */
+static inline void _dictWriteEnd(dict * d)
+{
+    if (!d->concurrent) return;
+
+    __atomic_store_n(&d->seq, d->seq + 1, __ATOMIC_RELEASE);
+}
+
+//字典的每段中桶的数量的 log2 上限，见 DICT_SEGMENT_SHIFT
+#define dictSegmentShift(d) (dictIsGrouped(d) ? DICT_GROUP_SEGMENT_SHIFT : DICT_SEGMENT_SHIFT)
+//哈希表 ht 的段的数量
+#define dictSegmentCount(d, ht) (((ht)->size + (1UL << dictSegmentShift(d)) - 1) >> dictSegmentShift(d))
+//哈希表 ht 的每段中桶的数量，哈希表比一段小时只有一段
+#define dictSegmentSize(d, ht) \
+    ((ht)->size < (1UL << dictSegmentShift(d)) ? (ht)->size : (1UL << dictSegmentShift(d)))
+
+static void * _dictSegmentCreate(dict * d, dictht * ht, unsigned long idx);
+
+/**
+ * 返回链式哈希表 ht 在索引 idx 上的链表表头的地址
+ *
+ * 桶所在的段还没有分配时，create 为 0 返回 NULL ，否则分配这一段
+ *
+ * T = O(1)
+ */
+static inline dictEntry ** _dictChainSlot(dict * d, dictht * ht, unsigned long idx, int create)
+{
+    dictEntry ** seg = dictConsume(&ht->table[idx >> DICT_SEGMENT_SHIFT]);
+
+    if (seg == NULL)
+    {
+        if (!create) return NULL;
+        seg = _dictSegmentCreate(d, ht, idx);
+    }
+
+    return &seg[idx & ((1UL << DICT_SEGMENT_SHIFT) - 1)];
+}
+
+/**
+ * 返回分组哈希表 ht 在索引 idx 上的组，段的处理与 _dictChainSlot() 相同
+ *
+ * T = O(1)
+ */
+static inline dictGroup * _dictGroupAt(dict * d, dictht * ht, unsigned long idx, int create)
+{
+    dictGroup * seg = dictConsume(&ht->groups[idx >> DICT_GROUP_SEGMENT_SHIFT]);
+
+    if (seg == NULL)
+    {
+        if (!create) return NULL;
+        seg = _dictSegmentCreate(d, ht, idx);
+    }
+
+    return &seg[idx & ((1UL << DICT_GROUP_SEGMENT_SHIFT) - 1)];
+}
+
+/**
+ * 返回哈希表 ht 在索引 idx 上的链表的表头节点，对两种哈希表引擎都适用
+ *
+ * T = O(1)
+ */
+static inline dictEntry * _dictBucketHead(dict * d, dictht * ht, unsigned long idx)
+{
+    if (dictIsGrouped(d))
+    {
+        dictGroup * g = _dictGroupAt(d, ht, idx, 0);
+
+        return g ? g->entries[0] : NULL;
+    }
+    else
+    {
+        dictEntry ** slot = _dictChainSlot(d, ht, idx, 0);
+
+        return slot ? *slot : NULL;
+    }
+}
 
 /* Thomas Wang's 32 bit Mix Function */
 unsigned int dictIntHashFunction(unsigned int key)
@@ -61,86 +212,336 @@ unsigned int dictIdentityHashFunction(unsigned int key)
     return key;
 }
 
-static uint32_t dict_hash_function_seed = 5381;
+/**
+ * 哈希函数的 128 位种子（密钥）
+ *
+ * SipHash 直接使用全部 16 个字节作为密钥，wyhash 使用前 8 个字节作为种子。
+ * 服务器应该在启动时用随机字节调用 dictSetHashFunctionSeed() ，
+ * 让攻击者无法构造出碰撞的键。
+ */
+static uint8_t dict_hash_function_seed[16] = {
+    0x05, 0x38, 0x01, 0x00, 0x9e, 0x37, 0x79, 0xb9,
+    0x7f, 0x4a, 0x7c, 0x15, 0xf3, 0x9c, 0xc0, 0x60
+};
 
-void dictSetHashFunctionSeed(uint32_t seed)
+void dictSetHashFunctionSeed(uint8_t * seed)
 {
-    dict_hash_function_seed = seed;
+    memcpy(dict_hash_function_seed, seed, sizeof(dict_hash_function_seed));
 }
 
-uint32_t dictGetHashFunctionSeed(void)
+uint8_t * dictGetHashFunctionSeed(void)
 {
     return dict_hash_function_seed;
 }
 
-/** MurmurHash2, by Austin Appleby
- * Note - This code makes a few assumptions about how your machine behaves -
- * 1. We can read a 4-byte value from any address without crashing
- * 2. sizeof(int) == 4
+/**
+ * 返回 wyhash 使用的 64 位种子
+ */
+static inline uint64_t _dictWyHashSeed(void)
+{
+    uint64_t seed;
+
+    memcpy(&seed, dict_hash_function_seed, sizeof(seed));
+    return seed;
+}
+
+/**
+ * 默认的 64 位哈希函数（wyhash）
+ *
+ * 速度快，适合可信的键。
+ * 64 位的哈希值让哈希表的大小不再受 32 位哈希的限制。
+ *
+ * T = O(N)
+ */
+uint64_t dictGenHashFunction(const void * key, size_t len)
+{
+    return wyHash(key, len, _dictWyHashSeed());
+}
+
+/**
+ * 大小写不敏感的默认哈希函数
+ *
+ * 按字长（以及长键上的 SIMD 指令）折叠大小写，而不是逐字节调用 tolower
+ *
+ * T = O(N)
+ */
+uint64_t dictGenCaseHashFunction(const unsigned char * buf, size_t len)
+{
+    return wyHashNoCase(buf, len, _dictWyHashSeed());
+}
+
+/**
+ * 抗碰撞攻击的 64 位哈希函数（SipHash-1-3）
+ *
+ * 用于来自不可信客户端的键，在不知道种子的情况下无法构造出碰撞的键
+ *
+ * T = O(N)
+ */
+uint64_t dictGenSafeHashFunction(const void * key, size_t len)
+{
+    return sipHash13(key, len, dict_hash_function_seed);
+}
+
+/**
+ * 大小写不敏感的抗碰撞攻击哈希函数
+ *
+ * T = O(N)
+ */
+uint64_t dictGenSafeCaseHashFunction(const unsigned char * buf, size_t len)
+{
+    return sipHash13NoCase(buf, len, dict_hash_function_seed);
+}
+
+/* ----------------------------- 分组哈希表 ----------------------------------*/
+
+/**
+ * 返回组 g 中标签等于 tag 的节点位置的位图，第 i 位为 1 表示 entries[i] 的标签命中
+ *
+ * 支持 SSE2 时，8 个控制字节只需一次比较就可以完成匹配。
+ * 一个组只有 8 个控制字节，所以 AVX2 的 32 字节比较在这里没有收益。
+ *
+ * T = O(1)
+ *
+ * @param g 目标组
+ * @param tag 要匹配的标签
+ * @return 命中位置的位图
+ */
+static inline unsigned int _dictGroupMatch(const dictGroup * g, uint8_t tag)
+{
+    unsigned int n = g->meta & DICT_GROUP_COUNT_MASK;
+    unsigned int mask;
+
+#if defined(__SSE2__)
+    //tags 和 meta 一共 8 个字节，meta 对应的位会被下面的掩码去掉
+    __m128i ctrl = _mm_loadl_epi64((const __m128i *)g->tags);
+    mask = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)tag)));
+#else
+    unsigned int i;
+
+    mask = 0;
+    for (i = 0; i < n; i++)
+        if (g->tags[i] == tag) mask |= 1u << i;
+#endif
+
+    return mask & ((1u << n) - 1);
+}
+
+/**
+ * 在组 g （以及它的溢出链表）中查找给定键
  *
- * And it has a few limitations -
+ * T = O(1)，溢出链表存在时最坏 O(N)
  *
- * 1. It will not work incrementally.
- * 2. It will not produce the same results on little-endian and big-endian
- *    machines.
+ * @param d 字典
+ * @param g 目标组
+ * @param key 要查找的键
+ * @param h 键的哈希值
+ * @param pos 不为 NULL 时，返回节点在组中的位置，节点在溢出链表中时为 -1
+ * @param prev 不为 NULL 时，返回节点在链表中的前驱节点
+ * @return 找到返回节点，找不到返回 NULL
  */
-unsigned int dictGenHashFunction(const void * key, int len)
+static dictEntry * _dictGroupFind(dict * d, dictGroup * g, const void * key, uint64_t h,
+                                  int * pos, dictEntry ** prev)
 {
-    //'m' and 'r' are mixing constants generated offline.
-    //They're not really 'magic', they just happen to work well.
-    uint32_t seed = dict_hash_function_seed;
-    const uint32_t m = 0x5bd1e995;
-    const int r = 24;
+    unsigned int mask = _dictGroupMatch(g, dictHashTag(h));
+    dictEntry * he, * prevHe;
+
+    //只比对标签命中的节点
+    while (mask)
+    {
+        int i = __builtin_ctz(mask);
+
+        he = g->entries[i];
+        if (dictEntryMatch(d, he, key, h))
+        {
+            if (pos) *pos = i;
+            if (prev) *prev = i ? g->entries[i - 1] : NULL;
+            return he;
+        }
+        mask &= mask - 1;
+    }
 
-    //Initialize the hash to a 'random' value
-    uint32_t h = seed ^ len;
+    if (!(g->meta & DICT_GROUP_OVERFLOW))
+        return NULL;
+
+    //组已满，继续查找溢出链表
+    prevHe = g->entries[DICT_GROUP_SLOTS - 1];
+    he = prevHe->next;
+    while (he)
+    {
+        if (dictEntryMatch(d, he, key, h))
+        {
+            if (pos) *pos = -1;
+            if (prev) *prev = prevHe;
+            return he;
+        }
+        prevHe = he;
+        he = he->next;
+    }
+
+    return NULL;
+}
 
-    //Mix 4 bytes at a time into the hash
-    const unsigned char * data = (const unsigned char *)key;
+/**
+ * 将节点 entry 插入到组 g 所代表的链表的表头
+ *
+ * 组已满时，原来的最后一个节点会被挤进溢出链表（它仍然被前一个节点的 next 指向）
+ *
+ * T = O(1)
+ *
+ * @param g 目标组
+ * @param entry 要插入的节点
+ * @param h 节点的键的哈希值
+ */
+static void _dictGroupInsertHead(dictGroup * g, dictEntry * entry, uint64_t h)
+{
+    unsigned int n = g->meta & DICT_GROUP_COUNT_MASK;
+    unsigned int i;
+    dictGroup ctrl;
 
-    while (len >= 4)
+    dictPublish(&entry->next, g->entries[0]);
+    ctrl.ctrl = g->ctrl;
+    if (n == DICT_GROUP_SLOTS)
     {
-        uint32_t k = *(uint32_t *)data;
+        ctrl.meta |= DICT_GROUP_OVERFLOW;
+        n--;
+    }
+
+    //逐个移动指针而不是 memmove ，无锁读者不会读到被撕裂的指针
+    for (i = n; i > 0; i--)
+        dictPublish(&g->entries[i], g->entries[i - 1]);
+    memmove(&ctrl.tags[1], &ctrl.tags[0], n);
+    ctrl.tags[0] = dictHashTag(h);
+    ctrl.meta = (ctrl.meta & DICT_GROUP_OVERFLOW) | (n + 1);
+    dictPublish(&g->entries[0], entry);
+    //控制字最后整体写入
+    dictPublish(&g->ctrl, ctrl.ctrl);
+}
 
-        k *= m;
-        k ^= k >> r;
-        k *= m;
+/**
+ * 将 _dictGroupFind() 找到的节点 he 从组 g 所代表的链表中移除，但不释放节点
+ *
+ * 组中的节点被移除后，如果存在溢出链表，那么溢出链表的第一个节点会被移入组中
+ *
+ * T = O(1)
+ *
+ * @param d 字典
+ * @param g 目标组
+ * @param he 要移除的节点
+ * @param pos 节点在组中的位置，-1 表示在溢出链表中
+ * @param prev 节点的前驱节点
+ */
+static void _dictGroupUnlink(dict * d, dictGroup * g, dictEntry * he, int pos, dictEntry * prev)
+{
+    unsigned int n = g->meta & DICT_GROUP_COUNT_MASK;
+    unsigned int i;
+    dictGroup ctrl;
 
-        h *= m;
-        h ^= k;
+    ctrl.ctrl = g->ctrl;
 
-        data += 4;
-        len -= 4;
+    //节点在溢出链表中
+    if (pos < 0)
+    {
+        dictPublish(&prev->next, he->next);
+        if (prev == g->entries[DICT_GROUP_SLOTS - 1] && he->next == NULL)
+        {
+            ctrl.meta &= ~DICT_GROUP_OVERFLOW;
+            dictPublish(&g->ctrl, ctrl.ctrl);
+        }
+        return;
     }
 
-    //Handle the last few bytes of the input array
-    switch (len)
+    if (prev) dictPublish(&prev->next, he->next);
+    for (i = pos; i + 1 < n; i++)
+        dictPublish(&g->entries[i], g->entries[i + 1]);
+    memmove(&ctrl.tags[pos], &ctrl.tags[pos + 1], n - pos - 1);
+
+    if (ctrl.meta & DICT_GROUP_OVERFLOW)
     {
-        case 3:
-            h ^= data[2] << 16;
-        case 2:
-            h ^= data[1] << 8;
-        case 1:
-            h ^= data[0];
-            h *= m;
-    };
+        //把溢出链表的第一个节点移入组中
+        dictEntry * o = g->entries[n - 2]->next;
 
-    //Do a few final mixes of the hash to ensure the last few bytes are well-incorporated.
-    h ^= h >> 13;
-    h *= m;
-    h ^= h >> 15;
+        dictPublish(&g->entries[n - 1], o);
+        ctrl.tags[n - 1] = dictHashTag(dictEntryHashKey(d, o));
+        if (o->next == NULL)
+            ctrl.meta &= ~DICT_GROUP_OVERFLOW;
+    }
+    else
+    {
+        dictPublish(&g->entries[n - 1], NULL);
+        ctrl.meta = n - 1;
+    }
+    dictPublish(&g->ctrl, ctrl.ctrl);
+}
 
-    return (unsigned int)h;
+/**
+ * 返回字典每个桶平均可以容纳的节点数量，用于决定何时扩展哈希表
+ *
+ * @param d 字典
+ * @return 链式哈希表为 1 ，分组哈希表为 DICT_GROUP_LOAD_FACTOR
+ */
+static unsigned long _dictLoadFactor(dict * d)
+{
+    return dictIsGrouped(d) ? DICT_GROUP_LOAD_FACTOR : 1;
 }
 
-//And a case insensitive hash function (based on jdb hash)
-unsigned int dictGenCaseHashFunction(const unsigned char * buf, int len)
+/**
+ * 返回字典当前的 resize 状态
+ *
+ * @param d 字典
+ * @return DICT_RESIZE_* 之一
+ */
+static int _dictResizeState(dict * d)
 {
-    unsigned int hash = (unsigned int)dict_hash_function_seed;
+    return __atomic_load_n(&d->resizePolicy->state, __ATOMIC_RELAXED);
+}
 
-    while (len--)
-        hash = ((hash << 5) + hash) + (tolower(*buf++));
-    return hash;
+/**
+ * 为字典分配一个节点
+ *
+ * T = O(1)
+ *
+ * @param d 字典
+ * @return 未初始化的节点
+ */
+static inline dictEntry * _dictEntryAlloc(dict * d)
+{
+    if (dictUsesSlab(d))
+        return dictSlabAlloc(&d->slab);
+
+    return z_malloc(dictStoresHash(d) ? sizeof(dictEntryWithHash) : sizeof(dictEntry));
+}
+
+/**
+ * 释放由 _dictEntryAlloc() 分配的节点，不释放节点的键和值
+ *
+ * T = O(1)
+ *
+ * @param d 字典
+ * @param he 要释放的节点
+ */
+static inline void _dictEntryFree(dict * d, dictEntry * he)
+{
+    if (dictUsesSlab(d))
+        dictSlabFree(&d->slab, he);
+    else
+        z_free(he);
+}
+
+/**
+ * 节点 he 被链接到字典（sign 为 1）或者从字典中移除（sign 为 -1）时，更新节点和键占用的字节数
+ *
+ * T = O(1)
+ *
+ * @param d 字典
+ * @param he 节点，键已经设置
+ * @param sign 1 或 -1
+ */
+static inline void _dictAccount(dict * d, dictEntry * he, int sign)
+{
+    if (!dictUsesSlab(d))
+        d->entryBytes += sign * (ssize_t)z_malloc_size(he);
+    if (d->type->keyBytes && !dictKeyIsEmbedded(d, he))
+        d->keyBytes += sign * (ssize_t)d->type->keyBytes(he->key);
 }
 
 //API implementation
@@ -151,12 +552,29 @@ unsigned int dictGenCaseHashFunction(const unsigned char * buf, int len)
  */
 static void _dictReset(dictht * ht)
 {
-    ht->table = NULL;
+    dictPublish(&ht->table, NULL);
     ht->size = 0;
-    ht->sizeMask = 0;
+    dictPublish(&ht->sizeMask, 0);
     ht->used = 0;
 }
 
+/**
+ * 将哈希表 src 的各项属性设置到 dst 中
+ *
+ * 无锁读者会读取 table 和 sizeMask ，所以这两项要原子地写入，
+ * 读者通过写序列号保证读到的两项属于同一个哈希表。
+ *
+ * @param dst 目标哈希表
+ * @param src 源哈希表
+ */
+static void _dictHtAssign(dictht * dst, const dictht * src)
+{
+    dictPublish(&dst->table, src->table);
+    dst->size = src->size;
+    dictPublish(&dst->sizeMask, src->sizeMask);
+    dst->used = src->used;
+}
+
 /**
  * 创建一个新的字典
  *
@@ -194,6 +612,23 @@ int _dictInit(dict * d, dictType * type, void * privDataPtr)
     d->privData = privDataPtr;
     d->rehashIndex = -1;
     d->iterators = 0;
+    d->bgRehash = 0;
+    d->worker = NULL;
+    d->concurrent = 0;
+    d->seq = 0;
+    d->retired = NULL;
+    d->retiredCount = 0;
+    if (dictUsesSlab(d))
+        dictSlabInit(&d->slab, dictEntryHeaderSize(d));
+    //变长的节点无法从固定大小的 slab 中分配
+    assert(!(dictUsesSlab(d) && dictEmbedsKeys(d)));
+    d->embedKeyMax = DICT_EMBED_KEY_MAX;
+    d->resizePolicy = &dict_default_resize_policy;
+    d->snapshot = NULL;
+    d->sampleBlock = 0;
+    d->sampleBound = 0;
+    d->entryBytes = 0;
+    d->keyBytes = 0;
 
     return DICT_OK;
 }
@@ -205,15 +640,15 @@ int _dictInit(dict * d, dictType * type, void * privDataPtr)
  * T = O(N)
  *
  * @param d 给定字典
- * @return  返回 DICT_ERR 表示字典已经在 rehash ，或者 dict_can_resize 为假。
+ * @return  返回 DICT_ERR 表示字典已经在 rehash ，或者策略的状态不是 DICT_RESIZE_ENABLE 。
  *          成功创建体积更小的 ht[1] ，可以开始 resize 时，返回 DICT_OK。
  */
 int dictResize(dict * d)
 {
-    int minimal;
+    unsigned long minimal;
 
-    //不能在关闭rehash或者正在rehash时调用
-    if (!dict_can_resize || dictIsRehashing(d)) return DICT_ERR;
+    //不能在推迟resize或者正在rehash时调用
+    if (_dictResizeState(d) != DICT_RESIZE_ENABLE || dictIsRehashing(d)) return DICT_ERR;
 
     minimal = d->ht[0].used;
     if (minimal < DICT_HT_INITIAL_SIZE)
@@ -223,6 +658,130 @@ int dictResize(dict * d)
     return dictExpand(d, minimal);
 }
 
+/**
+ * 返回有 size 个桶的桶数组（或者一段）的字节数
+ *
+ * @param d 字典
+ * @param size 桶的数量
+ */
+static size_t _dictTableAllocSize(dict * d, unsigned long size)
+{
+    return size * (dictIsGrouped(d) ? sizeof(dictGroup) : sizeof(dictEntry *));
+}
+
+/**
+ * 分配 bytes 字节的桶数组并清零
+ *
+ * 大的桶数组映射到大页上：查找时每次都随机访问一个桶，
+ * 4 KiB 的普通页下几乎每次访问都是一次 TLB 缺失
+ *
+ * @param bytes 字节数，见 _dictTableAllocSize()
+ * @return 桶数组
+ */
+static void * _dictTableAlloc(size_t bytes)
+{
+    if (bytes >= DICT_HUGE_TABLE_MIN_BYTES)
+        return z_calloc_huge(bytes, dict_huge_pages);
+
+    return z_calloc(bytes);
+}
+
+/**
+ * 释放 _dictTableAlloc() 分配的桶数组
+ *
+ * @param table 桶数组
+ * @param bytes 分配时的字节数
+ */
+static void _dictTableFree(void * table, size_t bytes)
+{
+    if (bytes >= DICT_HUGE_TABLE_MIN_BYTES)
+        z_free_huge(table, bytes);
+    else
+        z_free(table);
+}
+
+/**
+ * 分配哈希表 ht 在索引 idx 上的桶所在的段
+ *
+ * 后台 rehash 期间，所属线程添加节点和后台线程迁移节点可能同时为同一段分配，
+ * 通过 CAS 安装，没有安装成功的一方释放自己分配的段
+ *
+ * @param d 字典
+ * @param ht 哈希表
+ * @param idx 桶的索引
+ * @return 已经安装的段
+ */
+static void * _dictSegmentCreate(dict * d, dictht * ht, unsigned long idx)
+{
+    void ** slot = (void **)ht->table + (idx >> dictSegmentShift(d));
+    size_t bytes = _dictTableAllocSize(d, dictSegmentSize(d, ht));
+    void * seg = _dictTableAlloc(bytes), * installed = NULL;
+
+    if (!__atomic_compare_exchange_n(slot, &installed, seg, 0, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE))
+    {
+        _dictTableFree(seg, bytes);
+        return installed;
+    }
+
+    return seg;
+}
+
+/**
+ * 释放 0 号哈希表中已经被 rehash 越过的第 s 段，只能由所属线程调用
+ *
+ * 段里的桶都已经迁移完，无锁读者可能还在访问，所以通过 _dictRetireTable() 释放
+ *
+ * @param d 正在 rehash 的字典
+ * @param s 段的编号
+ */
+static void _dictSegmentRelease(dict * d, unsigned long s)
+{
+    dictht * ht = &d->ht[0];
+    void * seg = ((void **)ht->table)[s];
+
+    if (seg == NULL) return;
+
+    _dictWriteBegin(d);
+    dictPublish((void **)ht->table + s, NULL);
+    _dictWriteEnd(d);
+    _dictRetireTable(d, seg, dictSegmentSize(d, ht));
+}
+
+/**
+ * 立即释放哈希表 ht 的所有段和段目录，不重置 ht
+ *
+ * @param d 字典
+ * @param ht 哈希表
+ */
+static void _dictTableRelease(dict * d, dictht * ht)
+{
+    size_t bytes = _dictTableAllocSize(d, dictSegmentSize(d, ht));
+    unsigned long s, count = dictSegmentCount(d, ht);
+
+    if (ht->table == NULL) return;
+
+    for (s = 0; s < count; s++)
+        if (((void **)ht->table)[s])
+            _dictTableFree(((void **)ht->table)[s], bytes);
+    z_free(ht->table);
+}
+
+/**
+ * 在无锁读者退出之后释放哈希表 ht 的所有段和段目录，用于 rehash 完成之后的旧哈希表
+ *
+ * @param d 字典
+ * @param ht 已经从字典中摘除的哈希表
+ */
+static void _dictTableRetire(dict * d, dictht * ht)
+{
+    unsigned long s, count = dictSegmentCount(d, ht);
+
+    for (s = 0; s < count; s++)
+        if (((void **)ht->table)[s])
+            _dictRetireTable(d, ((void **)ht->table)[s], dictSegmentSize(d, ht));
+    _dictRetire(d, DICT_RETIRED_DIRECTORY, ht->table);
+}
+
 /**
  * 创建一个新的哈希表，并根据字典的情况，选择以下其中一个动作来进行：
  *
@@ -230,7 +789,7 @@ int dictResize(dict * d)
  * 2) 如果字典的 0 号哈希表非空，那么将新哈希表设置为 1 号哈希表，
  *    并打开字典的 rehash 标识，使得程序可以开始对字典进行 rehash
  *
- * T = O(N)
+ * T = O(N / 2^DICT_SEGMENT_SHIFT) ，只分配段目录
  *
  * @param d 给定字典
  * @param size 要创建的字典大小
@@ -240,38 +799,136 @@ int dictResize(dict * d)
 int dictExpand(dict * d, unsigned long size)
 {
     dictht n;
+    unsigned long factor = _dictLoadFactor(d);
 
     //根据size参数，计算哈希表的大小
+    //分组哈希表的每个桶可以容纳多个节点，所以桶的数量要按负载因子折算
     //T = O(1)
-    unsigned long realSize = _dictNextPower(size);
+    unsigned long realSize = dictNextPower((size + factor - 1) / factor);
 
     //不能在字典正在rehash时进行，size的值也应该大于0号哈希表已使用的大小
     if (dictIsRehashing(d) || d->ht[0].used > size)
         return DICT_ERR;
 
+    //只分配段目录，段在第一次写入时分配
     n.size = realSize;
     n.sizeMask = realSize - 1;
-    n.table = z_calloc(realSize * sizeof(dictEntry *));
+    n.table = z_calloc(dictSegmentCount(d, &n) * sizeof(void *));
     n.used = 0;
 
+    _dictWriteBegin(d);
     if (d->ht[0].table == NULL)
     {
-        d->ht[0] = n;   //初始化
+        _dictHtAssign(&d->ht[0], &n);   //初始化
+        _dictWriteEnd(d);
     } else {
-        d->ht[1] = n;   //rehash
+        _dictHtAssign(&d->ht[1], &n);   //rehash
         d->rehashIndex = 0;
+        _dictWriteEnd(d);
+
+        //足够大的哈希表交给后台线程迁移
+        if (d->bgRehash && d->iterators == 0 && d->ht[0].size >= DICT_BG_REHASH_MIN_SIZE)
+            _dictBgRehashStart(d);
     }
 
     return DICT_OK;
 }
 
 /**
- * 执行 N 步渐进式 rehash 。
+ * 将 0 号哈希表在索引 idx 上的桶中的所有节点迁移到 1 号哈希表
  *
- * 注意，每步 rehash 都是以一个哈希表索引（桶）作为单位的，
+ * T = O(N)
+ *
+ * @param d 要rehash的字典
+ * @param idx 0 号哈希表的桶的索引
+ * @return 迁移的节点数量
+ */
+static unsigned long _dictRehashBucket(dict * d, unsigned long idx)
+{
+    dictEntry * de, * nextDe;
+    unsigned long moved = 0;
+
+    //指向该索引的链表表头节点
+    de = _dictBucketHead(d, &d->ht[0], idx);
+    //将链表中的所有节点迁移到新的哈希表
+    //T = O(N)
+    while (de)
+    {
+        uint64_t h;
+
+        //保存下一个节点的指针
+        nextDe = de->next;
+
+        //计算新哈希表的哈希值，以及节点插入的索引位置
+        //节点缓存了哈希值时只需要重新计算掩码
+        h = dictEntryHashKey(d, de);
+
+        //插入节点到新哈希表
+        if (dictIsGrouped(d))
+        {
+            _dictGroupInsertHead(_dictGroupAt(d, &d->ht[1], h & d->ht[1].sizeMask, 1), de, h);
+        }
+        else
+        {
+            dictEntry ** slot = _dictChainSlot(d, &d->ht[1], h & d->ht[1].sizeMask, 1);
+
+            dictPublish(&de->next, *slot);
+            dictPublish(slot, de);
+        }
+
+        moved++;
+        de = nextDe;
+    }
+    //将刚迁移完的哈希表索引的指针设置为空，空桶所在的段可能没有分配
+    if (moved == 0)
+        return 0;
+    if (dictIsGrouped(d))
+    {
+        dictGroup * g = _dictGroupAt(d, &d->ht[0], idx, 0);
+        int i;
+
+        dictPublish(&g->ctrl, 0);
+        for (i = 0; i < DICT_GROUP_SLOTS; i++)
+            dictPublish(&g->entries[i], NULL);
+    }
+    else
+    {
+        dictPublish(_dictChainSlot(d, &d->ht[0], idx, 0), NULL);
+    }
+
+    return moved;
+}
+
+/**
+ * 把 rehashIndex 移到下一个桶，越过一段的末尾时释放这一段
+ *
+ * 没有分配的段中的桶都是空的，直接跳到下一段
+ *
+ * T = O(1)
+ *
+ * @param d 正在 rehash 的字典
+ */
+static void _dictRehashAdvance(dict * d)
+{
+    unsigned int shift = dictSegmentShift(d);
+    unsigned long s = (unsigned long)d->rehashIndex >> shift;
+
+    if (((void **)d->ht[0].table)[s] == NULL)
+        d->rehashIndex = (long)((s + 1) << shift);
+    else if (((unsigned long)++d->rehashIndex & ((1UL << shift) - 1)) == 0)
+        _dictSegmentRelease(d, s);
+}
+
+/**
+ * 执行 N 步渐进式 rehash 。
+ *
+ * 注意，每步 rehash 都是以一个哈希表索引（桶）作为单位的，
  * 一个桶里可能会有多个节点，
  * 被 rehash 的桶里的所有节点都会被移动到新哈希表。
  *
+ * 如果 rehash 正由后台线程进行，那么这个函数不迁移任何节点，
+ * 只在后台线程完成时收尾。
+ *
  * T = O(N)
  *
  * @param d 要rehash的字典
@@ -282,61 +939,51 @@ int dictExpand(dict * d, unsigned long size)
 int dictRehash(dict * d, int n)
 {
     //只有在rehash进行中时执行
-    if (!dictIsRehashing(d))
+    //快照期间节点不能在桶之间移动，也不能交换两个哈希表
+    if (!dictIsRehashing(d) || d->snapshot)
         return 0;
 
+    //后台线程正在迁移
+    if (d->worker)
+        return _dictBgRehashPoll(d);
+
     //进行N步迁移， T = O(N)
     while (n--)
     {
-        dictEntry * de, * nextDe;
+        unsigned long moved;
 
         //如果0号哈希表为空，那么表示rehash执行完成
         if (d->ht[0].used == 0)
         {
-            z_free(d->ht[0].table);
+            dictht old = d->ht[0];
+
             //此处存在性能上优化的可能
             //可以通过互换指针的值，从而避免了复制哈希表的开销
-            d->ht[0] = d->ht[1];
+            _dictWriteBegin(d);
+            _dictHtAssign(&d->ht[0], &d->ht[1]);
             _dictReset(&d->ht[1]);
             d->rehashIndex = -1;
+            _dictWriteEnd(d);
+            //无锁读者可能还在访问旧的哈希表数组
+            _dictTableRetire(d, &old);
 
             return 0;
         }
 
         //确保rehashIndex没有越界
         //assert
-        assert(d->ht[0].size > (unsigned)d->rehashIndex);
+        assert(d->ht[0].size > (unsigned long)d->rehashIndex);
 
         //略过数组中为空的索引，找到下一个非空索引
-        while (d->ht[0].table[d->rehashIndex] == NULL)
-            d->rehashIndex++;
-
-        //指向该索引的链表表头节点
-        de = d->ht[0].table[d->rehashIndex];
-        //将链表中的所有节点迁移到新的哈希表
-        //T = O(N)
-        while (de)
-        {
-            unsigned int h;
-
-            //保存下一个节点的指针
-            nextDe = de->next;
-
-            //计算新哈希表的哈希值，以及节点插入的索引位置
-            h = dictHashKey(d, de->key) & d->ht[1].sizeMask;
-
-            //插入节点到新哈希表
-            de->next = d->ht[1].table[h];
-            d->ht[1].table[h] = de;
-
-            d->ht[0].used--;
-            d->ht[1].used++;
-
-            de = nextDe;
-        }
-        //将刚迁移完的哈希表索引的指针设置为空
-        d->ht[0].table[d->rehashIndex] = NULL;
-        d->rehashIndex++;
+        while (_dictBucketHead(d, &d->ht[0], d->rehashIndex) == NULL)
+            _dictRehashAdvance(d);
+
+        _dictWriteBegin(d);
+        moved = _dictRehashBucket(d, d->rehashIndex);
+        _dictWriteEnd(d);
+        d->ht[0].used -= moved;
+        d->ht[1].used += moved;
+        _dictRehashAdvance(d);
     }
 
     return 1;
@@ -371,6 +1018,17 @@ int dictRehashMilliseconds(dict * d, int ms)
     long long start = timeInMilliseconds();
     int rehashes = 0;
 
+    //后台线程正在迁移时，只检查它是否已经完成
+    if (d->worker)
+    {
+        dictRehash(d, 1);
+        return 0;
+    }
+
+    //顺便释放无锁读者已经不再访问的对象
+    if (d->retired)
+        _dictReclaim(d);
+
     while (dictRehash(d, 100))
     {
         rehashes += 100;
@@ -398,572 +1056,2650 @@ static void _dictRehashStep(dict * d)
     if (d->iterators == 0) dictRehash(d, 1);
 }
 
+/* ----------------------------- 后台 rehash ----------------------------------*/
+
 /**
- * 尝试将给定键值对添加到字典中
- *
- * 只有给定键 key 不存在于字典时，添加操作才会成功
- *
- * 最坏 T = O(N) ，平摊 O(1)
+ * 自旋锁
  *
- * @param d 要添加的字典
- * @param key 键
- * @param val 值
- * @return 添加成功返回 DICT_OK ，失败返回 DICT_ERR
+ * 后台 rehash 期间，每个分段锁只会被字典的所属线程和后台线程争用，
+ * 持有时间不超过迁移一个桶，所以自旋比睡眠更合适。
  */
-int dictAdd(dict * d, void * key, void * val)
+typedef struct dictSpinlock
 {
-    dictEntry * entry = dictAddRaw(d, key);
-
-    //键已存在，添加失败
-    if (!entry)
-        return DICT_ERR;
+    char locked;
+} __attribute__((aligned(64))) dictSpinlock;
 
-    //键不存在，设置节点的值
-    dictSetVal(d, entry, val);
+static inline void _dictSpinLock(dictSpinlock * lock)
+{
+    while (__atomic_test_and_set(&lock->locked, __ATOMIC_ACQUIRE))
+    {
+        while (__atomic_load_n(&lock->locked, __ATOMIC_RELAXED))
+        {
+#if defined(__SSE2__)
+            _mm_pause();
+#else
+            sched_yield();
+#endif
+        }
+    }
+}
 
-    return DICT_OK;
+static inline void _dictSpinUnlock(dictSpinlock * lock)
+{
+    __atomic_clear(&lock->locked, __ATOMIC_RELEASE);
 }
 
 /**
- * 尝试将键插入到字典中
+ * 后台 rehash 线程的状态
  *
- * T = O(N)
+ * 协调规则：
+ * 1) 哈希值的低位同时决定了键在 0 号和 1 号哈希表中的桶（扩展时由 0 号哈希表的掩码决定，
+ *    收缩时由 1 号哈希表的掩码决定），所以按 hash & stripeMask 分段加锁，
+ *    后台线程迁移一个桶、所属线程查找、添加或删除一个键时，都只需要持有同一个分段锁。
+ * 2) 迭代器、dictScan 和随机取样会访问很多桶，它们持有 pauseLock 暂停后台线程。
+ * 3) 只有所属线程修改 dict 的字段：后台线程不修改 rehashIndex 和两个哈希表的 used ，
+ *    迁移进度记录在 cursor 和 moved 中，由所属线程在收尾时合并，
+ *    所以 dictSize() 在后台 rehash 期间仍然是准确的。
+ */
+typedef struct dictRehashWorker
+{
+    dict * d;                       //正在 rehash 的字典
+    pthread_t thread;               //后台线程
+    pthread_mutex_t pauseLock;      //暂停锁，后台线程迁移每批桶时持有
+    int pauses;                     //所属线程对暂停锁的嵌套持有次数
+    unsigned long cursor;           //下一个要迁移的 0 号哈希表的桶
+    unsigned long moved;            //已经迁移的节点数量
+    unsigned long released;         //所属线程已经释放的 0 号哈希表的段的数量
+    int stop;                       //要求后台线程退出
+    int done;                       //后台线程已经迁移完所有的桶
+    unsigned long stripeMask;       //分段锁的掩码
+    dictSpinlock stripes[DICT_BG_REHASH_STRIPES];  //分段锁
+} dictRehashWorker;
+
+/**
+ * 后台 rehash 线程的主函数
  *
- * @param d 目标字典
- * @param key 要添加的键
- * @return
- *      如果键已经在字典存在，那么返回 NULL；
- *      如果键不存在，那么程序创建新的哈希节点，将节点和键关联，并插入到字典，然后返回节点本身。
+ * 注意：后台线程会调用字典的哈希函数，所以哈希函数必须是线程安全的。
  */
-dictEntry * dictAddRaw(dict * d, void * key)
+static void * _dictBgRehashMain(void * arg)
 {
-    int index;
-    dictEntry * entry;
-    dictht * ht;
+    dictRehashWorker * w = arg;
+    dict * d = w->d;
+    unsigned long size = d->ht[0].size;
+    unsigned long idx = w->cursor, moved = 0;
 
-    //如果条件允许，进行单步rehash
-    //T = O(1)
-    if (dictIsRehashing(d))
-        _dictRehashStep(d);
+    while (idx < size && !__atomic_load_n(&w->stop, __ATOMIC_ACQUIRE))
+    {
+        unsigned long end = idx + DICT_BG_REHASH_BATCH;
 
-    //计算键在哈希表中的索引值
-    //如果值为-1，那么表示键已经存在
-    //T = O(N)
-    if ( (index = _dictKeyIndex(d, key)) == -1)
-        return NULL;
+        if (end > size) end = size;
 
-    //如果字典正在rehash，那么将新键添加到1号哈希表中，否则添加到0号哈希表中
-    ht = dictIsRehashing(d) ? &d->ht[1] : &d->ht[0];
-    entry = z_malloc(sizeof(dictEntry));
-    entry->next = ht->table[index];
-    ht->table[index] = entry;
-    ht->used++;
+        pthread_mutex_lock(&w->pauseLock);
+        for (; idx < end; idx++)
+        {
+            dictSpinlock * lock = &w->stripes[idx & w->stripeMask];
 
-    //设置新节点的值
-    dictSetKey(d, entry, key);
+            _dictSpinLock(lock);
+            moved += _dictRehashBucket(d, idx);
+            _dictSpinUnlock(lock);
+        }
+        __atomic_store_n(&w->cursor, idx, __ATOMIC_RELEASE);
+        __atomic_store_n(&w->moved, moved, __ATOMIC_RELEASE);
+        pthread_mutex_unlock(&w->pauseLock);
+    }
 
-    return entry;
+    if (idx == size)
+        __atomic_store_n(&w->done, 1, __ATOMIC_RELEASE);
+
+    return NULL;
 }
 
 /**
- * 将给定的键值对添加到字典中，如果键已经存在，那么删除旧有的键值对。
+ * 为正在 rehash 的字典创建后台线程
  *
- * T = O(N)
+ * 线程创建失败时，字典继续使用渐进式 rehash
  *
- * @param d 给定字典
- * @param key 键
- * @param val 值
- * @return 如果键值对为全新添加，那么返回 1 。
- * 如果键值对是通过对原有的键值对更新得来的，那么返回 0 。
+ * @param d 刚开始 rehash 的字典
  */
-int dictReplace(dict * d, void * key, void * val)
+static void _dictBgRehashStart(dict * d)
 {
-    dictEntry * entry, auxEntry;
+    dictRehashWorker * w = z_malloc(sizeof(dictRehashWorker));
+    unsigned long minSize = d->ht[0].size < d->ht[1].size ? d->ht[0].size : d->ht[1].size;
 
-    // 尝试直接将键值对添加到字典
-    // 如果键 key 不存在的话，添加会成功
-    // T = O(N)
-    if (dictAdd(d, key, val) == DICT_OK)
-        return 1;
+    if (w == NULL) return;
 
-    // 运行到这里，说明键 key 已经存在，那么找出包含这个 key 的节点
-    // T = O(1)
-    entry = dictFind(d, key);
-    auxEntry = *entry;
-    dictSetVal(d, entry, val);
-    dictFreeVal(d, &auxEntry);
+    memset(w, 0, sizeof(*w));
+    w->d = d;
+    w->cursor = d->rehashIndex;
+    w->released = (unsigned long)d->rehashIndex >> dictSegmentShift(d);
+    w->stripeMask = (minSize < DICT_BG_REHASH_STRIPES ? minSize : DICT_BG_REHASH_STRIPES) - 1;
+    pthread_mutex_init(&w->pauseLock, NULL);
 
-    return 0;
+    //d->worker 必须在线程启动之前设置，之后所属线程的操作都要加锁
+    d->worker = w;
+    if (pthread_create(&w->thread, NULL, _dictBgRehashMain, w) != 0)
+    {
+        d->worker = NULL;
+        pthread_mutex_destroy(&w->pauseLock);
+        z_free(w);
+    }
 }
 
 /**
- * dictAddRaw() 根据给定 key 释放存在，执行以下动作：
- *
- * 1) key 已经存在，返回包含该 key 的字典节点
- * 2) key 不存在，那么将 key 添加到字典
+ * 释放 0 号哈希表中后台线程已经越过的段，只能由所属线程调用
  *
- * T = O(N)
+ * 后台线程按顺序迁移，cursor 之前的段不会再被它访问
  *
- * @param d 目标字典
- * @param key 给定的键
- * @return 不论发生以上的哪一种情况，dictAddRaw() 都总是返回包含给定 key 的字典节点。
+ * @param d 正在后台 rehash 的字典
  */
-dictEntry * dictReplaceRaw(dict * d, void * key)
+static void _dictBgRehashRelease(dict * d)
 {
-    dictEntry * entry = dictFind(d, key);
+    dictRehashWorker * w = d->worker;
+    unsigned long passed = __atomic_load_n(&w->cursor, __ATOMIC_ACQUIRE) >> dictSegmentShift(d);
 
-    //如果找到节点直接返回该节点，否则添加并返回一个新节点
-    // T = O(N)
-    return entry ? entry : dictAddRaw(d, key);
+    for (; w->released < passed; w->released++)
+        _dictSegmentRelease(d, w->released);
 }
 
 /**
- * 查找并删除包含给定键的节点
- *
- * 参数 nofree 决定是否调用键和值的释放函数
- * 0 表示调用，1 表示不调用
+ * 停止后台线程，并把它的进度合并到字典中
  *
- * T = O(1)
+ * 之后 rehash 从后台线程停下的位置以渐进式的方式继续
  *
- * @param d
- * @param key
- * @param nofree
- * @return 找到并成功删除返回 DICT_OK ，没找到则返回 DICT_ERR
+ * @param d 字典
  */
-static int dictGenericDelete(dict * d, const void * key, int nofree)
+static void _dictBgRehashStop(dict * d)
 {
-    unsigned int h, index;
-    dictEntry * he, *prevHe;
-    int table;
+    dictRehashWorker * w = d->worker;
 
-    //字典的哈希表为空
-    if (d->ht[0].size == 0) return DICT_ERR;
+    if (w == NULL) return;
 
-    //进行单步rehash，T = O(1)
-    if (dictIsRehashing(d)) _dictRehashStep(d);
-    //计算哈希值
-    h = dictHashKey(d, key);
+    //不能在迭代器或者 dictScan 暂停后台线程期间停止它
+    assert(w->pauses == 0);
 
-    //遍历哈希表
-    for (table = 0; table <= 1; table++)
-    {
-        index = h & d->ht[table].sizeMask;
-        he = d->ht[table].table[index];
-        prevHe = NULL;
+    __atomic_store_n(&w->stop, 1, __ATOMIC_RELEASE);
+    pthread_join(w->thread, NULL);
 
-        //遍历链表上的所有节点
-        while (he)
-        {
-            if (dictCompareKeys(d, key,he->key))
-            {
-                if (prevHe)
-                    prevHe->next = he->next;
-                else
-                    d->ht[table].table[index] = he->next;
+    _dictBgRehashRelease(d);
 
-                //调用释放键和值的函数
-                if (!nofree)
-                {
-                    dictFreeKey(d, he);
-                    dictFreeVal(d, he);
-                }
+    //后台线程迁移的节点仍然计在 0 号哈希表上，在这里转到 1 号哈希表
+    d->ht[0].used -= w->moved;
+    d->ht[1].used += w->moved;
+    d->rehashIndex = w->cursor;
 
-                z_free(he);
-                d->ht[table].used--;
+    d->worker = NULL;
+    pthread_mutex_destroy(&w->pauseLock);
+    z_free(w);
+}
 
-                return DICT_OK;
-            }
+/**
+ * 检查后台线程是否已经完成，完成时由所属线程收尾
+ *
+ * @param d 字典
+ * @return 返回 1 表示 rehash 仍在进行，返回 0 表示 rehash 已经完成
+ */
+static int _dictBgRehashPoll(dict * d)
+{
+    //后台线程被迭代器暂停时，迭代器还持有它，不能收尾
+    if (d->worker->pauses)
+        return 1;
 
-            prevHe = he;
-            he = he->next;
-        }
+    _dictBgRehashRelease(d);
+    if (!__atomic_load_n(&d->worker->done, __ATOMIC_ACQUIRE))
+        return 1;
 
-        // 如果执行到这里，说明在 0 号哈希表中找不到给定键
-        // 那么根据字典是否正在进行 rehash ，决定要不要查找 1 号哈希表
-        if (!dictIsRehashing(d))
-            break;
-    }
+    _dictBgRehashStop(d);
 
-    //未找到
-    return DICT_ERR;
+    //所有的桶都已经迁移，这一步只交换两个哈希表
+    return dictRehash(d, 1);
 }
 
 /**
- * 从字典中删除包含给定键的节点
+ * 暂停后台线程，用于需要访问很多桶的操作，可以嵌套调用
  *
- * 并且调用键值的释放函数来删除键值
+ * @param d 字典
+ */
+static void _dictBgRehashPause(dict * d)
+{
+    if (d->worker && d->worker->pauses++ == 0)
+        pthread_mutex_lock(&d->worker->pauseLock);
+}
+
+/**
+ * 恢复被 _dictBgRehashPause() 暂停的后台线程
  *
- * T = O(1)
+ * @param w 被暂停的后台线程，为 NULL 时什么也不做
+ */
+static void _dictBgRehashResume(dictRehashWorker * w)
+{
+    if (w && --w->pauses == 0)
+        pthread_mutex_unlock(&w->pauseLock);
+}
+
+/**
+ * 后台 rehash 期间，获取哈希值 h 对应的分段锁
  *
- * @param d 目标字典
- * @param key 键
- * @return 找到并成功删除返回 DICT_OK ，没找到则返回 DICT_ERR
+ * @param d 字典
+ * @param h 键的哈希值
+ * @return 获取的锁，没有后台 rehash 时返回 NULL
  */
-int dictDelete(dict * d, const void * key)
+static dictSpinlock * _dictStripeAcquire(dict * d, uint64_t h)
 {
-    return dictGenericDelete(d, key, 0);
+    dictSpinlock * lock;
+
+    if (d->worker == NULL) return NULL;
+
+    lock = &d->worker->stripes[h & d->worker->stripeMask];
+    _dictSpinLock(lock);
+    return lock;
 }
 
 /**
- *  从字典中删除包含给定键的节点
+ * 释放 _dictStripeAcquire() 获取的分段锁
+ */
+static void _dictStripeRelease(dictSpinlock * lock)
+{
+    if (lock) _dictSpinUnlock(lock);
+}
+
+/**
+ * 允许字典使用后台线程进行 rehash
  *
- * 但不调用键值的释放函数来删除键值
+ * 之后 0 号哈希表的大小达到 DICT_BG_REHASH_MIN_SIZE 的 rehash 都会由后台线程迁移节点，
+ * 所属线程可以继续查找、添加和删除键，不再为 rehash 付出每次操作一个桶的代价，
+ * 也不会长时间同时保留两个哈希表。
+ *
+ * 字典仍然只能被一个线程（所属线程）使用，后台线程由字典自己管理。
  *
  * T = O(1)
  *
  * @param d 字典
- * @param key 要删除的键
- * @return 找到并成功删除返回 DICT_OK ，没找到则返回 DICT_ERR
  */
-int dictDeleteNoFree(dict * d, const void * key)
+void dictEnableBackgroundRehash(dict * d)
 {
-    return dictGenericDelete(d, key, 1);
+    //后台线程迁移节点时不会通知无锁读者
+    assert(!d->concurrent);
+    d->bgRehash = 1;
 }
 
 /**
- * 删除哈希表上的所有节点，并重置哈希表的各项属性
+ * 禁止字典使用后台线程进行 rehash
  *
- * T = O(N)
+ * 正在进行的后台 rehash 会被停止，剩余的部分以渐进式 rehash 的方式继续
  *
- * @param d 目标字典
- * @param ht
- * @param callback
- * @return
+ * @param d 字典
  */
-int _dictClear(dict * d, dictht * ht, void (callback)(void *))
+void dictDisableBackgroundRehash(dict * d)
 {
-    unsigned long l;
-
-    //遍历整个哈希表
-    for (l = 0; l < ht->size && ht->used > 0; l++)
-    {
-        dictEntry * de, * nextDe;
+    d->bgRehash = 0;
+    _dictBgRehashStop(d);
+}
 
-        if (callback && (l & 65535) == 0)
-            callback(d->privData);
+/* ------------------------------- 无锁读 -------------------------------------*/
 
-        if ( (de = ht->table[l]) == NULL)   continue;
+/**
+ * 基于 epoch 的内存回收
+ *
+ * 无锁读者在 dictReadBegin() 时把当前的全局 epoch 登记到自己的槽中，dictReadEnd() 时清零。
+ * 写者把节点、值或者哈希表数组从字典中摘除之后，将它们连同（递增前的）全局 epoch t 一起
+ * 放入字典的 retired 链表，只有当所有读者登记的 epoch 都大于 t （或者没有读者）时才真正释放：
+ * 登记的 epoch 大于 t 的读者一定是在对象被摘除之后才开始读取的，不可能再访问到它。
+ *
+ * 所有字典共用同一组槽，每个线程第一次调用 dictReadBegin() 时占用一个槽，线程退出时归还。
+ */
+typedef struct dictEpochSlot
+{
+    uint64_t epoch; //读者进入读区间时登记的 epoch ，不在读区间时为 0
+    int used;       //槽是否已被某个线程占用
+} __attribute__((aligned(64))) dictEpochSlot;
 
-        //遍历整个链表
-        while (de)
-        {
-            nextDe = de->next;
-            dictFreeKey(d, de);
-            dictFreeVal(d, de);
-            z_free(de);
+/**
+ * 等待释放的对象
+ */
+typedef struct dictRetired
+{
+    struct dictRetired * next;  //下一个（更早放入的）对象
+    uint64_t epoch;             //对象被摘除时的全局 epoch
+    int kind;                   //对象的类型，见 DICT_RETIRED_*
+    void * ptr;                 //对象
+    unsigned long size;         //哈希表数组的桶数量，只用于 DICT_RETIRED_TABLE
+} dictRetired;
+
+static dictEpochSlot dict_epoch_slots[DICT_EPOCH_MAX_THREADS];
+//曾经被占用过的槽的数量，回收时只需要检查这些槽
+static int dict_epoch_slots_used = 0;
+//全局 epoch ，从 1 开始，0 表示槽不在读区间中
+static uint64_t dict_epoch_global = 1;
+static pthread_key_t dict_epoch_key;
+static pthread_once_t dict_epoch_once = PTHREAD_ONCE_INIT;
+
+//当前线程占用的槽
+static __thread dictEpochSlot * dict_epoch_slot = NULL;
+//当前线程 dictReadBegin() 的嵌套深度
+static __thread int dict_epoch_depth = 0;
 
-            ht->used--;
-            de = nextDe;
+/**
+ * 线程退出时归还它占用的槽
+ */
+static void _dictEpochThreadExit(void * slot)
+{
+    __atomic_store_n(&((dictEpochSlot *)slot)->used, 0, __ATOMIC_RELEASE);
+}
+
+static void _dictEpochKeyInit(void)
+{
+    pthread_key_create(&dict_epoch_key, _dictEpochThreadExit);
+}
+
+/**
+ * 为当前线程占用一个空闲的槽
+ *
+ * @return 占用的槽
+ */
+static dictEpochSlot * _dictEpochRegister(void)
+{
+    int i;
+
+    pthread_once(&dict_epoch_once, _dictEpochKeyInit);
+
+    for (i = 0; i < DICT_EPOCH_MAX_THREADS; i++)
+    {
+        int expected = 0;
+
+        if (__atomic_compare_exchange_n(&dict_epoch_slots[i].used, &expected, 1, 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+        {
+            int n = __atomic_load_n(&dict_epoch_slots_used, __ATOMIC_RELAXED);
+
+            while (n < i + 1 && !__atomic_compare_exchange_n(&dict_epoch_slots_used, &n, i + 1, 0,
+                                                             __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+                ;
+            pthread_setspecific(dict_epoch_key, &dict_epoch_slots[i]);
+
+            return &dict_epoch_slots[i];
         }
     }
 
-    //释放哈希表
-    z_free(ht->table);
-    _dictReset(ht);
+    //同时进行无锁读取的线程太多
+    assert(i < DICT_EPOCH_MAX_THREADS);
+    return NULL;
+}
 
-    return DICT_OK;
+/**
+ * 返回所有正在读区间中的读者登记的最小 epoch ，没有读者时返回 UINT64_MAX
+ *
+ * T = O(DICT_EPOCH_MAX_THREADS)
+ */
+static uint64_t _dictEpochMin(void)
+{
+    uint64_t min = UINT64_MAX;
+    int i, n = __atomic_load_n(&dict_epoch_slots_used, __ATOMIC_ACQUIRE);
+
+    //对象被摘除的写入必须在读取读者的槽之前完成，与 dictReadBegin() 中的屏障配对
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    for (i = 0; i < n; i++)
+    {
+        uint64_t e = __atomic_load_n(&dict_epoch_slots[i].epoch, __ATOMIC_ACQUIRE);
+
+        if (e && e < min) min = e;
+    }
+
+    return min;
 }
 
 /**
- * 删除并释放整个字典
+ * 等待当前所有正在读区间中的读者退出读区间（之后才进入的读者不必等待）
+ *
+ * 不能在读区间中调用，否则会等待自己
  *
  * T = O(N)
+ */
+static void _dictEpochSynchronize(void)
+{
+    uint64_t t = __atomic_fetch_add(&dict_epoch_global, 1, __ATOMIC_SEQ_CST);
+
+    assert(dict_epoch_depth == 0);
+    while (_dictEpochMin() <= t)
+        sched_yield();
+}
+
+/**
+ * 释放一个等待释放的对象
  *
- * @param d 要释放的字典
+ * @param d 对象所属的字典
+ * @param kind 对象的类型
+ * @param ptr 对象
+ * @param size 哈希表数组的桶数量，只用于 DICT_RETIRED_TABLE
  */
-void dictRelease(dict * d)
+static void _dictRetiredFree(dict * d, int kind, void * ptr, unsigned long size)
 {
-    //删除并清空两个哈希表
-    _dictClear(d, &d->ht[0], NULL);
-    _dictClear(d, &d->ht[1], NULL);
+    dictEntry * he = ptr;
+    dictEntry auxEntry;
 
-    z_free(d);
+    switch (kind)
+    {
+        case DICT_RETIRED_ENTRY:
+            dictFreeKey(d, he);
+            dictFreeVal(d, he);
+            _dictEntryFree(d, he);
+            break;
+        case DICT_RETIRED_ENTRY_NOFREE:
+            _dictEntryFree(d, he);
+            break;
+        case DICT_RETIRED_VAL:
+            auxEntry.v.val = ptr;
+            dictFreeVal(d, &auxEntry);
+            break;
+        case DICT_RETIRED_TABLE:
+            _dictTableFree(ptr, _dictTableAllocSize(d, size));
+            break;
+        case DICT_RETIRED_DIRECTORY:
+            z_free(ptr);
+            break;
+    }
 }
 
 /**
- * 返回字典中包含键 key 的节点
+ * 释放已经从字典中摘除的对象
+ *
+ * 没有开启无锁读时立即释放；否则放入 retired 链表，等所有可能访问它的读者退出之后再释放
+ *
+ * T = O(1) ，平摊到每个对象的回收开销为 O(DICT_EPOCH_MAX_THREADS / DICT_RETIRE_BATCH)
+ *
+ * @param d 对象所属的字典
+ * @param kind 对象的类型
+ * @param ptr 对象
+ * @param size 哈希表数组的桶数量，只用于 DICT_RETIRED_TABLE
+ */
+static void _dictRetireObject(dict * d, int kind, void * ptr, unsigned long size)
+{
+    dictRetired * r;
+
+    if (!d->concurrent)
+    {
+        _dictRetiredFree(d, kind, ptr, size);
+        return;
+    }
+
+    r = z_malloc(sizeof(dictRetired));
+    r->kind = kind;
+    r->ptr = ptr;
+    r->size = size;
+    //摘除对象的写入都发生在这之前，之后才登记的读者不会再访问到它
+    r->epoch = __atomic_fetch_add(&dict_epoch_global, 1, __ATOMIC_SEQ_CST);
+    r->next = d->retired;
+    d->retired = r;
+
+    if (++d->retiredCount >= DICT_RETIRE_BATCH)
+        _dictReclaim(d);
+}
+
+/**
+ * 释放已经从字典中摘除的节点或值，见 _dictRetireObject()
+ */
+static void _dictRetire(dict * d, int kind, void * ptr)
+{
+    _dictRetireObject(d, kind, ptr, 0);
+}
+
+/**
+ * 释放 rehash 完成之后的旧哈希表数组，见 _dictRetireObject()
+ *
+ * @param d 字典
+ * @param table 桶数组
+ * @param size 桶的数量
+ */
+static void _dictRetireTable(dict * d, void * table, unsigned long size)
+{
+    _dictRetireObject(d, DICT_RETIRED_TABLE, table, size);
+}
+
+/**
+ * 释放 retired 链表中所有读者都已经不再访问的对象
+ *
+ * T = O(N)
+ *
+ * @param d 字典
+ */
+static void _dictReclaim(dict * d)
+{
+    uint64_t min = _dictEpochMin();
+    dictRetired ** link = &d->retired, * r;
+
+    //链表按 epoch 从大到小排列，找到第一个可以释放的对象，它之后的对象都可以释放
+    while (*link && (*link)->epoch >= min)
+        link = &(*link)->next;
+
+    r = *link;
+    *link = NULL;
+    while (r)
+    {
+        dictRetired * next = r->next;
+
+        _dictRetiredFree(d, r->kind, r->ptr, r->size);
+        z_free(r);
+        d->retiredCount--;
+        r = next;
+    }
+}
+
+/**
+ * 不等待读者，立即释放 retired 链表中的所有对象，只能在没有读者访问字典时调用
+ *
+ * T = O(N)
+ *
+ * @param d 字典
+ */
+static void _dictRetiredFreeAll(dict * d)
+{
+    while (d->retired)
+    {
+        dictRetired * r = d->retired;
+
+        d->retired = r->next;
+        _dictRetiredFree(d, r->kind, r->ptr, r->size);
+        z_free(r);
+    }
+    d->retiredCount = 0;
+}
+
+/**
+ * 允许其他线程在不加锁的情况下，与字典的所属线程（唯一的写者）并发地查找字典
+ *
+ * 之后：
+ * 1) 读者线程用 dictReadBegin() 和 dictReadEnd() 包围对 dictFindConcurrent() 、
+ *    dictFetchValueConcurrent() 的调用，以及对它们返回的节点和值的访问；
+ * 2) 被删除的节点、被 dictReplace() 替换下来的值和 rehash 完成后的旧哈希表数组
+ *    都会延迟到所有可能访问它们的读者退出读区间之后才释放；
+ * 3) 所属线程的所有操作和原来一样，但除 dictReplace() 之外，
+ *    不能直接修改已经在字典中的节点的值（比如通过 dictSetVal），读者可能正在读取它；
+ *    dictDeleteNoFree() 删除的节点的键和值也要等读者退出之后才能释放。
+ *
+ * 无锁读和后台 rehash 不能同时使用。
+ *
+ * T = O(1)
+ *
+ * @param d 字典
+ */
+void dictEnableConcurrentReads(dict * d)
+{
+    assert(!d->bgRehash);
+    d->concurrent = 1;
+}
+
+/**
+ * 禁止无锁读，并释放所有等待释放的对象
+ *
+ * 调用之后读者不能再访问这个字典，正在读区间中的读者会被等待
+ *
+ * T = O(N)
+ *
+ * @param d 字典
+ */
+void dictDisableConcurrentReads(dict * d)
+{
+    if (!d->concurrent) return;
+
+    _dictEpochSynchronize();
+    _dictRetiredFreeAll(d);
+    d->concurrent = 0;
+}
+
+/**
+ * 当前线程进入读区间，读区间可以嵌套
+ *
+ * 读区间中 dictFindConcurrent() 返回的节点一直有效，直到最外层的 dictReadEnd() 。
+ * 读区间应该尽量短，读区间存在期间写者无法释放被删除的对象。
+ *
+ * T = O(1)
+ */
+void dictReadBegin(void)
+{
+    dictEpochSlot * slot = dict_epoch_slot;
+
+    if (dict_epoch_depth++ > 0) return;
+
+    if (slot == NULL)
+        slot = dict_epoch_slot = _dictEpochRegister();
+
+    __atomic_store_n(&slot->epoch, __atomic_load_n(&dict_epoch_global, __ATOMIC_ACQUIRE), __ATOMIC_RELAXED);
+    //登记必须在读取字典之前对写者可见，与 _dictEpochMin() 中的屏障配对
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+/**
+ * 当前线程退出读区间
+ *
+ * T = O(1)
+ */
+void dictReadEnd(void)
+{
+    assert(dict_epoch_depth > 0);
+    if (--dict_epoch_depth == 0)
+        __atomic_store_n(&dict_epoch_slot->epoch, 0, __ATOMIC_RELEASE);
+}
+
+/**
+ * 检查写序列号自 seq 以来是否变化过
+ *
+ * @param d 字典
+ * @param seq 之前读到的写序列号
+ * @return 变化过返回 1 ，否则返回 0
+ */
+static inline int _dictReadRetry(dict * d, unsigned long seq)
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&d->seq, __ATOMIC_RELAXED) != seq;
+}
+
+/**
+ * 无锁读者在哈希表数组 table 的索引 idx 上的桶中查找键 key
+ *
+ * 写者可能同时在修改这个桶，读到的节点指针总是有效的，
+ * 但组内的标签和节点可能暂时对不上，所以这里只保证找到的节点是正确的，没有找到不一定可信。
+ *
+ * T = O(1)
+ *
+ * @param d 字典
+ * @param table 哈希表数组的段目录
+ * @param idx 桶的索引
+ * @param key 键
+ * @param h 键的哈希值
+ * @return 找到返回节点，找不到返回 NULL
+ */
+static dictEntry * _dictFindConcurrentIn(dict * d, void * table, unsigned long idx, const void * key, uint64_t h)
+{
+    unsigned int shift = dictSegmentShift(d);
+    void * seg = dictConsume((void **)table + (idx >> shift));
+    dictEntry * he;
+
+    //段已经被 rehash 释放，或者还没有节点写入过
+    if (seg == NULL) return NULL;
+    idx &= (1UL << shift) - 1;
+
+    if (dictIsGrouped(d))
+    {
+        dictGroup * g = (dictGroup *)seg + idx;
+        dictGroup ctrl;
+        unsigned int mask;
+
+        //控制字整体读出后再匹配，标签和节点数量来自同一次写入
+        ctrl.ctrl = dictConsume(&g->ctrl);
+        mask = _dictGroupMatch(&ctrl, dictHashTag(h));
+        while (mask)
+        {
+            he = dictConsume(&g->entries[__builtin_ctz(mask)]);
+            if (he && dictEntryMatch(d, he, key, h))
+                return he;
+            mask &= mask - 1;
+        }
+
+        if (!(ctrl.meta & DICT_GROUP_OVERFLOW))
+            return NULL;
+        if ( (he = dictConsume(&g->entries[DICT_GROUP_SLOTS - 1])) == NULL)
+            return NULL;
+        he = dictConsume(&he->next);
+    }
+    else
+    {
+        he = dictConsume(&((dictEntry **)seg)[idx]);
+    }
+
+    while (he)
+    {
+        if (dictEntryMatch(d, he, key, h))
+            return he;
+        he = dictConsume(&he->next);
+    }
+
+    return NULL;
+}
+
+/**
+ * 在不加锁的情况下查找给定键，只能在读区间中、由开启了无锁读的字典的读者线程调用
+ *
+ * 不执行单步 rehash 。找到的节点在读区间结束之前一直有效，节点的值应该用 dictGetValConcurrent() 读取。
+ * 没有找到时，如果查找期间写者修改过哈希表结构（迁移节点、移动组内节点、替换哈希表），
+ * 那么重新查找，所以不会因为并发的 rehash 而漏掉一直存在的键。
+ *
+ * T = O(1)
+ *
+ * @param d 字典
+ * @param key 键
+ * @return 找到返回节点，找不到返回 NULL
+ */
+dictEntry * dictFindConcurrent(dict * d, const void * key)
+{
+    uint64_t h = dictHashKey(d, key);
+    unsigned long seq, masks[2];
+    void * tables[2];
+    dictEntry * he;
+    int table;
+
+retry:
+    //写者正在修改哈希表结构
+    while ( (seq = __atomic_load_n(&d->seq, __ATOMIC_ACQUIRE)) & 1)
+    {
+#if defined(__SSE2__)
+        _mm_pause();
+#else
+        sched_yield();
+#endif
+    }
+
+    for (table = 0; table <= 1; table++)
+    {
+        tables[table] = __atomic_load_n(&d->ht[table].table, __ATOMIC_RELAXED);
+        masks[table] = __atomic_load_n(&d->ht[table].sizeMask, __ATOMIC_RELAXED);
+    }
+    //数组和掩码必须属于同一个哈希表，否则索引可能越界
+    if (_dictReadRetry(d, seq)) goto retry;
+
+    for (table = 0; table <= 1; table++)
+    {
+        if (tables[table] == NULL) continue;
+
+        if ( (he = _dictFindConcurrentIn(d, tables[table], h & masks[table], key, h)) != NULL)
+            return he;
+    }
+
+    //查找期间哈希表结构被修改过，键可能正好被移走了
+    if (_dictReadRetry(d, seq)) goto retry;
+
+    return NULL;
+}
+
+/**
+ * 在不加锁的情况下返回给定键的值，调用条件与 dictFindConcurrent() 相同
+ *
+ * 返回的值在读区间结束之前一直有效
+ *
+ * T = O(1)
+ *
+ * @param d 字典
+ * @param key 键
+ * @return 找到返回值，找不到返回 NULL
+ */
+void * dictFetchValueConcurrent(dict * d, const void * key)
+{
+    dictEntry * he = dictFindConcurrent(d, key);
+
+    return he ? dictGetValConcurrent(he) : NULL;
+}
+
+/**
+ * 尝试将给定键值对添加到字典中
+ *
+ * 只有给定键 key 不存在于字典时，添加操作才会成功
+ *
+ * 最坏 T = O(N) ，平摊 O(1)
+ *
+ * @param d 要添加的字典
+ * @param key 键
+ * @param val 值
+ * @return 添加成功返回 DICT_OK ，失败返回 DICT_ERR
+ */
+int dictAdd(dict * d, void * key, void * val)
+{
+    //值在节点被链接到哈希表之前设置，无锁读者不会看到没有值的节点
+    dictEntry * entry = _dictAddWithHash(d, key, dictHashKey(d, key), val, 1, NULL);
+
+    //键已存在，添加失败
+    return entry ? DICT_OK : DICT_ERR;
+}
+
+/**
+ * 尝试将键插入到字典中
+ *
+ * T = O(N)
+ *
+ * @param d 目标字典
+ * @param key 要添加的键
+ * @return
+ *      如果键已经在字典存在，那么返回 NULL；
+ *      如果键不存在，那么程序创建新的哈希节点，将节点和键关联，并插入到字典，然后返回节点本身。
+ */
+dictEntry * dictAddRaw(dict * d, void * key)
+{
+    return dictAddRawWithHash(d, key, dictHashKey(d, key));
+}
+
+/**
+ * 使用调用者已经计算好的哈希值，尝试将键插入到字典中
+ *
+ * hash 必须等于 dictHashKey(d, key) ，
+ * 已经计算过哈希值的调用者（比如按哈希值路由的分片）可以借此避免重复计算。
+ *
+ * T = O(N)
+ *
+ * @param d 目标字典
+ * @param key 要添加的键
+ * @param hash 键的哈希值
+ * @return 如果键已经在字典存在，那么返回 NULL；否则返回新创建的节点
+ */
+dictEntry * dictAddRawWithHash(dict * d, void * key, uint64_t hash)
+{
+    return _dictAddWithHash(d, key, hash, NULL, 0, NULL);
+}
+
+/**
+ * 查找给定的键，键不存在时将它添加到字典中
+ *
+ * 查找和添加共用一次探测，适合"有则修改、无则创建"的操作（比如 INCR ）：
+ * 键已经存在时返回原有的节点，键不会被复制，调用者仍然拥有 key ；
+ * 键不存在时返回新创建的节点，节点的值被初始化为 0 ，由调用者设置。
+ *
+ * 最坏 T = O(N) ，平摊 O(1)
+ *
+ * @param d 目标字典
+ * @param key 键
+ * @param existed 不为 NULL 时，键已经存在设为 1 ，新添加设为 0
+ * @return 包含给定键的节点，只有扩展哈希表失败时返回 NULL
+ */
+dictEntry * dictAddOrFind(dict * d, void * key, int * existed)
+{
+    return dictAddOrFindWithHash(d, key, dictHashKey(d, key), existed);
+}
+
+/**
+ * 使用调用者已经计算好的哈希值执行 dictAddOrFind()
+ *
+ * hash 必须等于 dictHashKey(d, key)
+ *
+ * 最坏 T = O(N) ，平摊 O(1)
+ *
+ * @param d 目标字典
+ * @param key 键
+ * @param hash 键的哈希值
+ * @param existed 不为 NULL 时，键已经存在设为 1 ，新添加设为 0
+ * @return 包含给定键的节点，只有扩展哈希表失败时返回 NULL
+ */
+dictEntry * dictAddOrFindWithHash(dict * d, void * key, uint64_t hash, int * existed)
+{
+    dictEntry * existing = NULL;
+    dictEntry * entry = _dictAddWithHash(d, key, hash, NULL, 0, &existing);
+
+    if (existed) *existed = entry == NULL && existing != NULL;
+
+    return entry ? entry : existing;
+}
+
+/**
+ * 创建新节点，并把它链接到哈希表 ht 的索引 index 上
+ *
+ * 节点的键、哈希值和值（setVal 为真时）都在节点被链接到哈希表之前设置，
+ * 所以无锁读者看到节点时，节点总是完整的。setVal 为假时节点的值被初始化为 0 。
+ * 调用者已经确认键不在字典中，并且持有后台 rehash 需要的分段锁（或者暂停了后台线程），
+ * 节点占用的字节数由调用者调用 _dictAccount() 计入。
+ *
+ * T = O(1)
+ *
+ * @param d 目标字典
+ * @param ht 接收节点的哈希表
+ * @param index 桶的索引
+ * @param key 要添加的键
+ * @param hash 键的哈希值
+ * @param val 节点的值
+ * @param setVal 是否设置节点的值
+ * @return 新创建的节点
+ */
+static dictEntry * _dictInsertEntry(dict * d, dictht * ht, unsigned long index, void * key, uint64_t hash,
+                                    void * val, int setVal)
+{
+    size_t embedLen;
+    dictEntry * entry;
+
+    //快照还没迭代到这个桶时，先保存桶的内容，新键不会出现在快照中
+    _dictSnapshotTouch(d, ht == &d->ht[1], index);
+
+    //设置新节点的键和值
+    if (dictEmbedsKeys(d))
+    {
+        size_t hdr = dictEntryHeaderSize(d);
+
+        //足够短的键连同长度保存在变长节点的末尾，否则节点只保存长度 0 ，照常复制键
+        embedLen = d->type->embedKeyLen(key);
+        if (embedLen > d->embedKeyMax) embedLen = 0;
+
+        entry = z_malloc(hdr + sizeof(uint64_t) + embedLen);
+        dictEntryEmbedLen(d, entry) = (uint32_t)embedLen;
+        if (embedLen)
+            entry->key = d->type->embedKey((char *)entry + hdr + sizeof(uint64_t), key);
+        else
+            dictSetKey(d, entry, key);
+    }
+    else
+    {
+        entry = _dictEntryAlloc(d);
+        dictSetKey(d, entry, key);
+    }
+    if (dictStoresHash(d))
+        dictGetEntryHash(entry) = hash;
+    entry->v.u64 = 0;
+    if (setVal)
+        dictSetVal(d, entry, val);
+
+    if (dictIsGrouped(d))
+    {
+        //移动组内的节点可能让无锁读者漏掉其他键，链式哈希表只需要发布一个指针
+        _dictWriteBegin(d);
+        _dictGroupInsertHead(_dictGroupAt(d, ht, index, 1), entry, hash);
+        _dictWriteEnd(d);
+    }
+    else
+    {
+        dictEntry ** slot = _dictChainSlot(d, ht, index, 1);
+
+        entry->next = *slot;
+        dictPublish(slot, entry);
+    }
+    ht->used++;
+
+    return entry;
+}
+
+/**
+ * dictAdd() 、 dictAddRawWithHash() 和 dictReplace() 的底层实现
+ *
+ * T = O(N)
+ *
+ * @param d 目标字典
+ * @param key 要添加的键
+ * @param hash 键的哈希值
+ * @param val 节点的值
+ * @param setVal 是否设置节点的值，见 _dictInsertEntry()
+ * @param existing 不为 NULL 时，键已经存在则设为原有的节点
+ * @return 如果键已经在字典存在，那么返回 NULL；否则返回新创建的节点
+ */
+static dictEntry * _dictAddWithHash(dict * d, void * key, uint64_t hash, void * val, int setVal,
+                                     dictEntry ** existing)
+{
+    long index;
+    dictEntry * entry;
+    dictht * ht;
+    dictSpinlock * lock;
+
+    //如果条件允许，进行单步rehash
+    //T = O(1)
+    if (dictIsRehashing(d))
+        _dictRehashStep(d);
+
+    //计算键在哈希表中的索引值
+    //如果值为-1，那么表示键已经存在
+    //T = O(N)
+    //根据需要扩展哈希表，这可能会启动后台 rehash ，所以要在加锁之前进行
+    if (_dictExpandIfNeeded(d) == DICT_ERR)
+        return NULL;
+    lock = _dictStripeAcquire(d, hash);
+    if ( (index = _dictKeyIndex(d, key, hash, existing)) == -1)
+    {
+        _dictStripeRelease(lock);
+        return NULL;
+    }
+
+    //如果字典正在rehash，那么将新键添加到1号哈希表中，否则添加到0号哈希表中
+    ht = dictIsRehashing(d) ? &d->ht[1] : &d->ht[0];
+    entry = _dictInsertEntry(d, ht, index, key, hash, val, setVal);
+    _dictStripeRelease(lock);
+    _dictAccount(d, entry, 1);
+
+    return entry;
+}
+
+/**
+ * dictBulkLoad() 中已经计算好哈希值的键
+ */
+typedef struct dictBulkItem
+{
+    uint64_t hash;          //键的哈希值
+    unsigned long pos;      //键在 keys 中的位置
+} dictBulkItem;
+
+/**
+ * dictBulkLoad() 的各个线程共享的任务
+ *
+ * 键按接收哈希表中桶的索引的高位划分为 parts 个分区，每个分区对应一段相邻的桶
+ */
+typedef struct dictBulkJob
+{
+    dict * d;
+    void ** keys;
+    unsigned long n;
+    int threads;
+    unsigned long mask;         //接收新节点的哈希表的 sizeMask
+    unsigned int shift;         //桶的索引右移 shift 位得到分区
+    unsigned long parts;        //分区的数量
+    uint64_t * hashes;          //每个键的哈希值，按 keys 的顺序
+    unsigned long * counts;     //threads * parts 个计数，每个线程在每个分区中的键数，之后变为写入位置
+    dictBulkItem * items;       //按分区排列的键
+} dictBulkJob;
+
+/**
+ * dictBulkLoad() 的一个线程，每个线程处理 keys 中连续的一段
+ */
+typedef struct dictBulkWorker
+{
+    dictBulkJob * job;
+    int id;
+    int phase;                  //0 为计算哈希值并计数，1 为把键放到所属的分区
+} dictBulkWorker;
+
+/**
+ * dictBulkLoad() 的线程主函数
+ *
+ * @param arg dictBulkWorker
+ * @return NULL
+ */
+static void * _dictBulkWorkerMain(void * arg)
+{
+    dictBulkWorker * w = arg;
+    dictBulkJob * job = w->job;
+    unsigned long start = job->n * w->id / job->threads;
+    unsigned long end = job->n * (w->id + 1) / job->threads, i;
+    unsigned long * counts = job->counts + (unsigned long)w->id * job->parts;
+
+    if (w->phase == 0)
+    {
+        for (i = start; i < end; i++)
+        {
+            uint64_t h = dictHashKey(job->d, job->keys[i]);
+
+            job->hashes[i] = h;
+            counts[(h & job->mask) >> job->shift]++;
+        }
+    }
+    else
+    {
+        for (i = start; i < end; i++)
+        {
+            dictBulkItem * item = &job->items[counts[(job->hashes[i] & job->mask) >> job->shift]++];
+
+            item->hash = job->hashes[i];
+            item->pos = i;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * 用 job->threads 个线程（包括调用者自己）执行 dictBulkLoad() 的一个阶段
+ *
+ * 创建线程失败时，由调用者完成这个线程的那一段
+ *
+ * @param job 任务
+ * @param phase 阶段，见 dictBulkWorker
+ */
+static void _dictBulkRun(dictBulkJob * job, int phase)
+{
+    pthread_t tids[DICT_BULK_LOAD_MAX_THREADS];
+    dictBulkWorker workers[DICT_BULK_LOAD_MAX_THREADS];
+    int started[DICT_BULK_LOAD_MAX_THREADS];
+    int i;
+
+    for (i = 0; i < job->threads; i++)
+    {
+        workers[i].job = job;
+        workers[i].id = i;
+        workers[i].phase = phase;
+    }
+    for (i = 1; i < job->threads; i++)
+        started[i] = pthread_create(&tids[i], NULL, _dictBulkWorkerMain, &workers[i]) == 0;
+    _dictBulkWorkerMain(&workers[0]);
+    for (i = 1; i < job->threads; i++)
+    {
+        if (started[i])
+            pthread_join(tids[i], NULL);
+        else
+            _dictBulkWorkerMain(&workers[i]);
+    }
+}
+
+/**
+ * 为 dictBulkLoad() 准备接收新节点的哈希表：完成正在进行的 rehash ，再一次扩展到可以容纳所有节点的大小
+ *
+ * 正在进行的 rehash 的目标大小是按之前的节点数量计算的，装入之后很可能还要再扩展，所以先完成它。
+ * 快照、迭代器或者暂停了后台线程的操作存在时节点不能移动，这时返回 NULL ，由调用者逐个添加。
+ *
+ * T = O(N) ，N 为正在进行的 rehash 还没有迁移的节点数量
+ *
+ * @param d 目标字典
+ * @param n 要装入的键的数量
+ * @return 接收新节点的哈希表，不能直接插入时返回 NULL
+ */
+static dictht * _dictBulkPrepare(dict * d, unsigned long n)
+{
+    unsigned long used = dictSize(d) + n, target;
+
+    if (dictIsRehashing(d))
+    {
+        if (d->snapshot || d->iterators || (d->worker && d->worker->pauses))
+            return NULL;
+        _dictBgRehashStop(d);
+        while (dictRehash(d, 1024)) ;
+    }
+
+    //创建 0 号哈希表不是 resize ，直接按目标负载分配；已有的哈希表按 resize 策略扩展
+    if (d->ht[0].size == 0)
+        target = used * 100 / d->resizePolicy->targetPercent;
+    else
+        target = dictResizeGrowTarget(d->resizePolicy, d->ht[0].size * _dictLoadFactor(d), used);
+    if (target && dictExpand(d, target) == DICT_ERR)
+        return NULL;
+
+    return dictIsRehashing(d) ? &d->ht[1] : &d->ht[0];
+}
+
+/**
+ * 一次装入 n 个键值对，用于加载快照和批量导入
+ *
+ * 与逐个调用 dictAdd() 相比：
+ *  1) 哈希表只按最终的节点数量扩展一次，插入期间不进行扩展检查，也不进行单步 rehash ；
+ *  2) 哈希值由最多 DICT_BULK_LOAD_MAX_THREADS 个线程并行计算，哈希函数必须是线程安全的；
+ *  3) 键按桶的索引分区之后再插入，每个分区只覆盖最多 2^(log2(size) - DICT_BULK_LOAD_PARTITION_BITS)
+ *     个相邻的桶，插入时对桶数组的访问是局部的，而不是随机的；
+ *  4) 带有 DICT_BULK_ASSUME_UNIQUE 时跳过重复检查，调用者保证键互不相同并且都不在字典中。
+ *
+ * 没有 DICT_BULK_ASSUME_UNIQUE 时，已经在字典中的键，以及在 keys 中重复出现的键（第一次出现的被添加）
+ * 不会被添加，字典不会接管它们的键和值，调用者通过 out 中对应的 NULL 找到它们并负责释放。
+ * 字典正在 rehash 并且不能立即完成时（比如存在快照或安全迭代器），退化为使用预先计算的哈希值逐个添加。
+ *
+ * T = O(N)
+ *
+ * @param d 目标字典
+ * @param keys 键
+ * @param vals 值，为 NULL 时所有节点的值被初始化为 0
+ * @param n 键值对的数量
+ * @param flags DICT_BULK_* 标识
+ * @param out 不为 NULL 时，out[i] 保存 keys[i] 的新节点，没有被添加的键为 NULL ，至少要有 n 个元素的空间
+ * @return 添加的键值对的数量
+ */
+unsigned long dictBulkLoad(dict * d, void ** keys, void ** vals, unsigned long n, int flags, dictEntry ** out)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned long i, p, pos, added = 0;
+    dictRehashWorker * w;
+    dictBulkJob job;
+    dictht * ht;
+    int t;
+
+    if (n == 0) return 0;
+
+    ht = _dictBulkPrepare(d, n);
+
+    job.d = d;
+    job.keys = keys;
+    job.n = n;
+    job.threads = n / DICT_BULK_LOAD_KEYS_PER_THREAD;
+    if (job.threads > DICT_BULK_LOAD_MAX_THREADS) job.threads = DICT_BULK_LOAD_MAX_THREADS;
+    if (cpus > 0 && job.threads > cpus) job.threads = (int)cpus;
+    if (job.threads < 1) job.threads = 1;
+    //不能直接插入时仍然按新键将要进入的哈希表分区，只为了访问的局部性
+    job.mask = (ht ? ht : &d->ht[dictIsRehashing(d) ? 1 : 0])->sizeMask;
+    for (job.shift = 0; (job.mask >> job.shift) >> DICT_BULK_LOAD_PARTITION_BITS; job.shift++) ;
+    job.parts = (job.mask >> job.shift) + 1;
+    job.hashes = z_malloc(sizeof(uint64_t) * n);
+    job.items = z_malloc(sizeof(dictBulkItem) * n);
+    job.counts = z_calloc(sizeof(unsigned long) * job.parts * job.threads);
+
+    //并行计算哈希值，统计每个线程在每个分区中的键数
+    _dictBulkRun(&job, 0);
+    //计数换算成写入位置：分区依次排列，同一分区中按线程的顺序，也就是键在 keys 中的顺序
+    for (p = 0, pos = 0; p < job.parts; p++)
+    {
+        for (t = 0; t < job.threads; t++)
+        {
+            unsigned long * c = &job.counts[(unsigned long)t * job.parts + p];
+            unsigned long count = *c;
+
+            *c = pos;
+            pos += count;
+        }
+    }
+    //并行地把键放到所属的分区
+    _dictBulkRun(&job, 1);
+    z_free(job.counts);
+    z_free(job.hashes);
+
+    if (ht == NULL)
+    {
+        for (i = 0; i < n; i++)
+        {
+            dictBulkItem * item = &job.items[i];
+
+            dictEntry * entry = _dictAddWithHash(d, keys[item->pos], item->hash,
+                                                 vals ? vals[item->pos] : NULL, vals != NULL, NULL);
+
+            if (out) out[item->pos] = entry;
+            if (entry) added++;
+        }
+        z_free(job.items);
+        return added;
+    }
+
+    //后台线程暂停期间桶不会被迁移，不需要分段锁
+    _dictBgRehashPause(d);
+    w = d->worker;
+    for (i = 0; i < n; i++)
+    {
+        dictBulkItem * item = &job.items[i];
+        dictEntry * entry;
+        void * key;
+        long index;
+
+        //分区内的键在 keys 中的位置是随机的，分两级预取 keys 的元素和键本身
+        if (i + 2 * DICT_BULK_LOAD_PREFETCH < n)
+            __builtin_prefetch(&keys[job.items[i + 2 * DICT_BULK_LOAD_PREFETCH].pos]);
+        if (i + DICT_BULK_LOAD_PREFETCH < n)
+            __builtin_prefetch(keys[job.items[i + DICT_BULK_LOAD_PREFETCH].pos]);
+        key = keys[item->pos];
+
+        if (flags & DICT_BULK_ASSUME_UNIQUE)
+            index = item->hash & ht->sizeMask;
+        else if ((index = _dictKeyIndex(d, key, item->hash, NULL)) == -1)
+        {
+            if (out) out[item->pos] = NULL;
+            continue;
+        }
+        entry = _dictInsertEntry(d, ht, index, key, item->hash, vals ? vals[item->pos] : NULL, vals != NULL);
+        _dictAccount(d, entry, 1);
+        if (out) out[item->pos] = entry;
+        added++;
+    }
+    _dictBgRehashResume(w);
+    z_free(job.items);
+
+    return added;
+}
+
+/**
+ * 将给定的键值对添加到字典中，如果键已经存在，那么删除旧有的键值对。
+ *
+ * T = O(N)
+ *
+ * @param d 给定字典
+ * @param key 键
+ * @param val 值
+ * @return 如果键值对为全新添加，那么返回 1 。
+ * 如果键值对是通过对原有的键值对更新得来的，那么返回 0 。
+ */
+int dictReplace(dict * d, void * key, void * val)
+{
+    dictEntry * entry = NULL, auxEntry;
+    uint64_t h = dictHashKey(d, key);
+    void * oldVal;
+    int keep;
+
+    // 尝试直接将键值对添加到字典
+    // 如果键 key 不存在的话，添加会成功
+    // 键已经存在时，添加过程中的探测同时找出包含这个 key 的节点，不必再查找一次
+    // T = O(N)
+    if (_dictAddWithHash(d, key, h, val, 1, &entry) != NULL)
+        return 1;
+
+    // 运行到这里，说明键 key 已经存在
+    oldVal = entry->v.val;
+    // 快照还需要旧值时，由快照负责释放旧值
+    keep = _dictSnapshotKeepVal(d, entry, h);
+    // 新值原子地替换旧值，旧值要等无锁读者不再访问之后才释放
+    dictSetVal(d, (&auxEntry), val);
+    dictPublish(&entry->v.val, auxEntry.v.val);
+    if (!keep)
+        _dictRetire(d, DICT_RETIRED_VAL, oldVal);
+
+    return 0;
+}
+
+/**
+ * dictAddRaw() 根据给定 key 释放存在，执行以下动作：
+ *
+ * 1) key 已经存在，返回包含该 key 的字典节点
+ * 2) key 不存在，那么将 key 添加到字典
+ *
+ * T = O(N)
+ *
+ * @param d 目标字典
+ * @param key 给定的键
+ * @return 不论发生以上的哪一种情况，dictAddRaw() 都总是返回包含给定 key 的字典节点。
+ */
+dictEntry * dictReplaceRaw(dict * d, void * key)
+{
+    //如果找到节点直接返回该节点，否则添加并返回一个新节点
+    // T = O(N)
+    return dictAddOrFind(d, key, NULL);
+}
+
+/**
+ * 查找包含给定键的节点，并将它从哈希表中移除，但不释放节点
+ *
+ * T = O(1)
+ *
+ * @param d 目标字典
+ * @param key 键
+ * @param saved 不为 NULL 时，设为快照替节点所在的桶保存的内容，没有时设为 NULL
+ * @return 被移除的节点，没找到返回 NULL
+ */
+static dictEntry * _dictUnlink(dict * d, const void * key, struct dictSnapshotBucket ** saved)
+{
+    uint64_t h;
+    unsigned long index;
+    dictEntry * he, *prevHe;
+    int table;
+    dictSpinlock * lock;
+    struct dictSnapshotBucket * b = NULL;
+
+    //字典的哈希表为空
+    if (d->ht[0].size == 0) return NULL;
+
+    //进行单步rehash，T = O(1)
+    if (dictIsRehashing(d)) _dictRehashStep(d);
+    //计算哈希值
+    h = dictHashKey(d, key);
+    lock = _dictStripeAcquire(d, h);
+
+    //遍历哈希表
+    for (table = 0; table <= 1; table++)
+    {
+        index = h & d->ht[table].sizeMask;
+
+        //分组哈希表先通过标签定位节点，再将它从组中移除
+        if (dictIsGrouped(d))
+        {
+            int pos;
+            dictGroup * g = _dictGroupAt(d, &d->ht[table], index, 0);
+
+            he = g ? _dictGroupFind(d, g, key, h, &pos, &prevHe) : NULL;
+            if (he)
+            {
+                b = _dictSnapshotTouch(d, table, index);
+                _dictWriteBegin(d);
+                _dictGroupUnlink(d, g, he, pos, prevHe);
+                _dictWriteEnd(d);
+                goto found;
+            }
+        }
+        else
+        {
+            dictEntry ** slot = _dictChainSlot(d, &d->ht[table], index, 0);
+
+            he = slot ? *slot : NULL;
+            prevHe = NULL;
+
+            //遍历链表上的所有节点
+            while (he)
+            {
+                if (dictEntryMatch(d, he, key, h))
+                {
+                    b = _dictSnapshotTouch(d, table, index);
+                    //被移除节点的 next 保持不变，正在访问它的无锁读者仍然可以继续遍历
+                    if (prevHe)
+                        dictPublish(&prevHe->next, he->next);
+                    else
+                        dictPublish(slot, he->next);
+                    goto found;
+                }
+
+                prevHe = he;
+                he = he->next;
+            }
+        }
+
+        // 如果执行到这里，说明在 0 号哈希表中找不到给定键
+        // 那么根据字典是否正在进行 rehash ，决定要不要查找 1 号哈希表
+        if (!dictIsRehashing(d))
+            break;
+    }
+
+    //未找到
+    _dictStripeRelease(lock);
+    return NULL;
+
+found:
+    d->ht[table].used--;
+    _dictStripeRelease(lock);
+    _dictAccount(d, he, -1);
+    if (saved) *saved = b;
+
+    return he;
+}
+
+/**
+ * 查找并删除包含给定键的节点
+ *
+ * 参数 nofree 决定是否调用键和值的释放函数
+ * 0 表示调用，1 表示不调用
+ *
+ * T = O(1)
+ *
+ * @param d
+ * @param key
+ * @param nofree
+ * @return 找到并成功删除返回 DICT_OK ，没找到则返回 DICT_ERR
+ */
+static int dictGenericDelete(dict * d, const void * key, int nofree)
+{
+    struct dictSnapshotBucket * saved;
+    dictEntry * he = _dictUnlink(d, key, &saved);
+
+    if (he == NULL) return DICT_ERR;
+
+    //节点已经从哈希表中移除，可以在锁外调用释放键和值的函数
+    //快照还没迭代到这个节点时，由快照在迭代之后释放
+    if (!_dictSnapshotKeep(saved, he, nofree ? DICT_SNAPSHOT_DEAD_NOFREE : DICT_SNAPSHOT_DEAD))
+        _dictRetire(d, nofree ? DICT_RETIRED_ENTRY_NOFREE : DICT_RETIRED_ENTRY, he);
+
+    //删除之后负载过低时开始收缩
+    _dictShrinkIfNeeded(d);
+
+    return DICT_OK;
+}
+
+/**
+ * 查找包含给定键的节点，并将它从字典中移除，但不释放节点、键和值
+ *
+ * 与 dictFind() 加 dictDelete() 相比只探测一次，适合需要先读取值再删除的操作（比如 GETDEL ）。
+ * 返回的节点已经不在字典中，调用者读取完之后必须用 dictFreeUnlinked() 释放，
+ * 在此之前不能对同一个字典调用 dictEmpty() 或 dictRelease() 。
+ *
+ * T = O(1)
+ *
+ * @param d 目标字典
+ * @param key 键
+ * @return 被移除的节点，没找到返回 NULL
+ */
+dictEntry * dictUnlinkFind(dict * d, const void * key)
+{
+    dictEntry * he = _dictUnlink(d, key, NULL);
+
+    //节点已经不在哈希表中，收缩不会移动它
+    if (he) _dictShrinkIfNeeded(d);
+
+    return he;
+}
+
+/**
+ * 释放 dictUnlinkFind() 返回的节点，并调用键和值的释放函数
+ *
+ * 节点被移除时快照还没迭代到它，那么由快照在迭代之后释放；
+ * 开启了无锁读时，等所有可能访问它的读者退出之后再释放。
+ *
+ * T = O(1)
+ *
+ * @param d 节点原来所在的字典
+ * @param he 要释放的节点，为 NULL 时什么也不做
+ */
+void dictFreeUnlinked(dict * d, dictEntry * he)
+{
+    if (he == NULL) return;
+
+    if (!_dictSnapshotKeepUnlinked(d, he))
+        _dictRetire(d, DICT_RETIRED_ENTRY, he);
+}
+
+/**
+ * 从字典中删除包含给定键的节点
+ *
+ * 并且调用键值的释放函数来删除键值
+ *
+ * T = O(1)
+ *
+ * @param d 目标字典
+ * @param key 键
+ * @return 找到并成功删除返回 DICT_OK ，没找到则返回 DICT_ERR
+ */
+int dictDelete(dict * d, const void * key)
+{
+    return dictGenericDelete(d, key, 0);
+}
+
+/**
+ *  从字典中删除包含给定键的节点
+ *
+ * 但不调用键值的释放函数来删除键值
+ *
+ * T = O(1)
+ *
+ * @param d 字典
+ * @param key 要删除的键
+ * @return 找到并成功删除返回 DICT_OK ，没找到则返回 DICT_ERR
+ */
+int dictDeleteNoFree(dict * d, const void * key)
+{
+    return dictGenericDelete(d, key, 1);
+}
+
+/**
+ * 删除哈希表上的所有节点，并重置哈希表的各项属性
+ *
+ * T = O(N)
+ *
+ * @param d 目标字典
+ * @param ht
+ * @param callback
+ * @return
+ */
+int _dictClear(dict * d, dictht * ht, void (callback)(void *))
+{
+    unsigned long l;
+
+    //节点从 slab 中分配并且键值都不需要释放时，不必遍历节点，
+    //节点所在的页由调用者通过 dictSlabRelease() 一次性释放
+    if (dictUsesSlab(d) && !d->type->keyDestructor && !d->type->valDestructor)
+        ht->used = 0;
+
+    //遍历整个哈希表
+    for (l = 0; l < ht->size && ht->used > 0; l++)
+    {
+        dictEntry * de, * nextDe;
+
+        if (callback && (l & 65535) == 0)
+            callback(d->privData);
+
+        if ( (de = _dictBucketHead(d, ht, l)) == NULL)   continue;
+
+        //遍历整个链表
+        while (de)
+        {
+            nextDe = de->next;
+            dictFreeKey(d, de);
+            dictFreeVal(d, de);
+            //slab 中的节点随着页一起释放
+            if (!dictUsesSlab(d))
+                z_free(de);
+
+            ht->used--;
+            de = nextDe;
+        }
+    }
+
+    //释放哈希表
+    _dictTableRelease(d, ht);
+    _dictReset(ht);
+
+    return DICT_OK;
+}
+
+/**
+ * 删除并释放整个字典
+ *
+ * T = O(N)
+ *
+ * @param d 要释放的字典
+ */
+void dictRelease(dict * d)
+{
+    assert(d->snapshot == NULL);
+    _dictBgRehashStop(d);
+    _dictRetiredFreeAll(d);
+
+    //删除并清空两个哈希表
+    _dictClear(d, &d->ht[0], NULL);
+    _dictClear(d, &d->ht[1], NULL);
+    if (dictUsesSlab(d))
+        dictSlabRelease(&d->slab);
+
+    z_free(d);
+}
+
+/**
+ * 在字典的哈希表中查找哈希值为 h 的键 key ，不执行单步 rehash
+ *
+ * T = O(1)
+ *
+ * @param d 要查找的字典
+ * @param key 目标键
+ * @param h 键的哈希值
+ * @return 找到返回节点，找不到返回 NULL
+ */
+static dictEntry * _dictFind(dict * d, const void * key, uint64_t h)
+{
+    dictEntry * de = NULL;
+    unsigned long index;
+    int table;
+    dictSpinlock * lock = _dictStripeAcquire(d, h);
+
+    //在字典的哈希表中查找这个键
+    for (table = 0; table <= 1; table++)
+    {
+        //计算索引值
+        index = h & d->ht[table].sizeMask;
+
+        //分组哈希表只需比对标签命中的节点
+        if (dictIsGrouped(d))
+        {
+            dictGroup * g = _dictGroupAt(d, &d->ht[table], index, 0);
+
+            de = g ? _dictGroupFind(d, g, key, h, NULL, NULL) : NULL;
+        }
+        else
+        {
+            //遍历给定索引上的链表的所有节点， 查找key
+            de = _dictBucketHead(d, &d->ht[table], index);
+            while (de)
+            {
+                if (dictEntryMatch(d, de, key, h))
+                    break;
+
+                de = de->next;
+            }
+        }
+
+        // 如果程序遍历完 0 号哈希表，仍然没找到指定的键的节点
+        // 那么程序会检查字典是否在进行 rehash ，
+        // 然后才决定是直接返回 NULL ，还是继续查找 1 号哈希表
+        if (de || !dictIsRehashing(d)) break;
+    }
+
+    _dictStripeRelease(lock);
+    return de;
+}
+
+/**
+ * 返回字典中包含键 key 的节点
+ *
+ * T = O(1)
+ *
+ * @param d 要查找的字典
+ * @param key 目标键
+ * @return 找到返回节点，找不到返回 NULL
+ */
+dictEntry * dictFind(dict * d, const void * key)
+{
+    //字典的哈希表为空
+    if (d->ht[0].size == 0) return NULL;
+
+    return dictFindWithHash(d, key, dictHashKey(d, key));
+}
+
+/**
+ * 使用调用者已经计算好的哈希值，返回字典中包含键 key 的节点
+ *
+ * hash 必须等于 dictHashKey(d, key)
+ *
+ * T = O(1)
+ *
+ * @param d 要查找的字典
+ * @param key 目标键
+ * @param hash 键的哈希值
+ * @return 找到返回节点，找不到返回 NULL
+ */
+dictEntry * dictFindWithHash(dict * d, const void * key, uint64_t hash)
+{
+    //字典的哈希表为空
+    if (d->ht[0].size == 0) return NULL;
+
+    if (dictIsRehashing(d)) _dictRehashStep(d);
+
+    return _dictFind(d, key, hash);
+}
+
+/**
+ * 使用调用者已经计算好的哈希值查找键，但不执行单步 rehash
+ *
+ * 这个函数不修改字典，所以多个线程可以在持有同一个读锁的情况下并发调用它，
+ * dictSharded 的读操作就是这样做的。
+ *
+ * T = O(1)
+ *
+ * @param d 要查找的字典
+ * @param key 目标键
+ * @param hash 键的哈希值
+ * @return 找到返回节点，找不到返回 NULL
+ */
+dictEntry * dictPeekWithHash(dict * d, const void * key, uint64_t hash)
+{
+    //字典的哈希表为空
+    if (d->ht[0].size == 0) return NULL;
+
+    return _dictFind(d, key, hash);
+}
+
+/**
+ * 返回哈希表 ht 在索引 idx 上的桶的地址，用于预取，桶所在的段没有分配时返回 NULL
+ */
+static inline const void * _dictBucketAddr(dict * d, dictht * ht, unsigned long idx)
+{
+    return dictIsGrouped(d) ? (const void *)_dictGroupAt(d, ht, idx, 0) : (const void *)_dictChainSlot(d, ht, idx, 0);
+}
+
+/**
+ * 批量查找 n 个键，结果按顺序保存到 out 数组中，找不到的键对应的位置为 NULL
+ *
+ * 每 DICT_FIND_MANY_BATCH 个键为一批，分三轮处理：
+ * 1) 计算所有键的哈希值，并预取它们在 0 号（以及 rehash 时的 1 号）哈希表中的桶
+ * 2) 读取桶中的表头节点并预取，此时桶大多已经在缓存中
+ * 3) 真正比对键
+ * 这样多个键的内存访问延迟可以相互重叠，而不是逐个串行地等待。
+ *
+ * 整批查找只执行一次单步 rehash ，而不是每个键执行一次。
+ *
+ * T = O(N)
+ *
+ * @param d 要查找的字典
+ * @param keys 要查找的键
+ * @param n 键的数量
+ * @param out 保存查找结果的数组，至少要有 n 个元素的空间
+ * @return 找到的键的数量
+ */
+unsigned long dictFindMany(dict * d, const void ** keys, unsigned long n, dictEntry ** out)
+{
+    uint64_t hashes[DICT_FIND_MANY_BATCH];
+    unsigned long found = 0, base, i, batch;
+    int rehashing;
+
+    //字典的哈希表为空
+    if (d->ht[0].size == 0)
+    {
+        for (i = 0; i < n; i++) out[i] = NULL;
+        return 0;
+    }
+
+    if (dictIsRehashing(d)) _dictRehashStep(d);
+    rehashing = dictIsRehashing(d);
+
+    for (base = 0; base < n; base += batch)
+    {
+        batch = n - base < DICT_FIND_MANY_BATCH ? n - base : DICT_FIND_MANY_BATCH;
+
+        //计算哈希值并预取桶
+        for (i = 0; i < batch; i++)
+        {
+            hashes[i] = dictHashKey(d, keys[base + i]);
+            __builtin_prefetch(_dictBucketAddr(d, &d->ht[0], hashes[i] & d->ht[0].sizeMask));
+            if (rehashing)
+                __builtin_prefetch(_dictBucketAddr(d, &d->ht[1], hashes[i] & d->ht[1].sizeMask));
+        }
+
+        //预取 0 号哈希表中桶的表头节点
+        //后台 rehash 期间桶可能正在被迁移，不能在不加锁的情况下读取
+        for (i = 0; i < batch && d->worker == NULL; i++)
+        {
+            dictEntry * head = _dictBucketHead(d, &d->ht[0], hashes[i] & d->ht[0].sizeMask);
+            if (head) __builtin_prefetch(head);
+        }
+
+        //比对键
+        for (i = 0; i < batch; i++)
+        {
+            out[base + i] = _dictFind(d, keys[base + i], hashes[i]);
+            if (out[base + i]) found++;
+        }
+    }
+
+    return found;
+}
+
+/**
+ * 获取包含给定键的节点的值
+ *
+ * T = O(1)
+ *
+ * @param d 目标字典
+ * @param key 给定键
+ * @return 如果节点不为空，返回节点的值; 否则返回 NULL
+ */
+void * dictFetchValue(dict * d, const void * key)
+{
+    dictEntry * de;
+    de = dictFind(d, key);
+
+    return de ? dictGetVal(de) : NULL;
+}
+
+/**
+ * 指纹是一个64位的数字，表示字典的状态
+ * 在给定的时间，它只是几个dict属性xor在一起。
+ * 当一个不安全的迭代器被初始化时，我们得到dict指纹，并检查
+ * 当迭代器被释放时，再次使用指纹。
+ * 如果两个指纹不同，意味着迭代器的用户
+ * 迭代时对字典执行禁止的操作。
+ *
+ * @param d 字典
+ * @return 给定字典的指纹
+ */
+long long dictFingerprint(dict * d)
+{
+    long long integers[6], hash = 0;
+    int j;
+
+    integers[0] = (long)d->ht[0].table;
+    integers[1] = d->ht[0].size;
+    integers[2] = d->ht[0].used;
+    integers[3] = (long)d->ht[1].table;
+    integers[4] = d->ht[1].size;
+    integers[5] = d->ht[1].used;
+
+    for (j = 0; j < 6; j++)
+    {
+        hash += integers[j];
+        hash = (~hash) + (hash << 21);
+        hash = hash ^ (hash >> 24);
+        hash = (hash + (hash << 3)) + (hash << 8);  //hash * 265
+        hash = hash ^ (hash >> 14);
+        hash = (hash + (hash << 2)) + (hash << 4);  //hash * 21
+        hash = hash ^ (hash >> 28);
+        hash = hash + (hash << 31);
+    }
+    return hash;
+}
+
+/**
+ * 创建并返回给定字典的不安全迭代器
+ *
+ * T = O(1)
+ *
+ * @param d 给定字典
+ * @return 字典的不安全迭代器
+ */
+dictIterator * dictGetIterator(dict * d)
+{
+    dictIterator * iter = z_malloc(sizeof(dictIterator));
+
+    iter->d = d;
+    iter->table = 0;
+    iter->index = -1;
+    iter->safe = 0;
+    iter->entry = NULL;
+    iter->nextEntry = NULL;
+    iter->pausedWorker = NULL;
+
+    return iter;
+}
+
+/**
+ * 创建并返回给定节点的安全迭代器
+ *
+ * T = O(1)
+ *
+ * @param d 给定字典
+ * @return 返回字典的安全迭代器
+ */
+dictIterator * dictGetSafeIterator(dict * d)
+{
+    dictIterator * iter = dictGetIterator(d);
+    iter->safe = 1;
+
+    return iter;
+}
+
+/**
+ * 返回迭代器指向的当前节点
+ *
+ * T = O(1)
+ *
+ * @param iter 目标迭代器
+ * @return 字典迭代完毕时，返回 NULL
+ */
+dictEntry * dictNext(dictIterator * iter)
+{
+    while (1)
+    {
+        // 进入这个循环有两种可能：
+        // 1) 这是迭代器第一次运行
+        // 2) 当前索引链表中的节点已经迭代完（NULL 为链表的表尾）
+        if (iter->entry == NULL)
+        {
+            //指向被迭代的哈希表
+            dictht * ht = &iter->d->ht[iter->table];
+            //初次迭代时执行
+            if (iter->index == -1 && iter->table == 0)
+            {
+                //迭代期间暂停后台 rehash ，节点不会在迭代器的眼皮底下被移动
+                _dictBgRehashPause(iter->d);
+                iter->pausedWorker = iter->d->worker;
+
+                if (iter->safe) //如果是安全迭代器，那么更新安全迭代器计数器
+                    iter->d->iterators++;
+                else            //如果不是安全迭代器，那么计算指纹
+                    iter->fingerprint = dictFingerprint(iter->d);
+            }
+            iter->index++;
+
+            // 如果迭代器的当前索引大于当前被迭代的哈希表的大小
+            // 那么说明这个哈希表已经迭代完毕
+            if (iter->index >= (long) ht->size)
+            {
+                // 如果正在 rehash 的话，那么说明 1 号哈希表也正在使用中
+                // 那么继续对 1 号哈希表进行迭代
+                if (dictIsRehashing(iter->d) && iter->table == 0)
+                {
+                    iter->table++;
+                    iter->index = 0;
+                    ht = &iter->d->ht[1];
+                }
+                // 如果没有 rehash ，那么说明迭代已经完成
+                else
+                    break;
+            }
+
+            // 如果进行到这里，说明这个哈希表并未迭代完
+            // 更新节点指针，指向下个索引链表的表头节点
+            iter->entry = _dictBucketHead(iter->d, ht, iter->index);
+        }
+        else
+        {
+            // 执行到这里，说明程序正在迭代某个链表
+            // 将节点指针指向链表的下一个节点
+            iter->entry = iter->nextEntry;
+        }
+
+        // 如果当前节点不为空，那么也记录下该节点的下个节点
+        // 因为安全迭代器有可能会将迭代器返回的当前节点删除
+        if (iter->entry)
+        {
+            iter->nextEntry = iter->entry->next;
+            return iter->entry;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * 释放给定字典迭代器
+ *
+ * T = O(1)
+ *
+ * @param iter 要释放的字典
+ */
+void dictReleaseIterator(dictIterator * iter)
+{
+    if (!(iter->index == -1 && iter->table == 0))
+    {
+        if (iter->safe) //释放安全迭代器
+            iter->d->iterators--;
+        else
+            assert(iter->fingerprint == dictFingerprint(iter->d));//assert
+        _dictBgRehashResume(iter->pausedWorker);
+    }
+    z_free(iter);
+}
+
+/* ------------------------------- 快照迭代器 ----------------------------------*/
+
+/**
+ * 快照替一个桶保存的节点
+ */
+typedef struct dictSnapshotItem
+{
+    dictEntry * de;     //节点，快照结束之前不会被释放，键也不会改变
+    union {
+        void * val;
+        uint64_t u64;
+        int64_t  s64;
+    } v;                //快照时节点的值
+    int flags;          //DICT_SNAPSHOT_* 标识
+} dictSnapshotItem;
+
+/**
+ * 快照替一个桶保存的内容，在桶第一次被修改之前创建
+ */
+typedef struct dictSnapshotBucket
+{
+    unsigned long n;            //桶中节点的数量
+    dictSnapshotItem items[];   //桶中的节点
+} dictSnapshotBucket;
+
+/**
+ * 字典的快照迭代器
+ *
+ * 按桶的顺序遍历快照开始时的两个哈希表，(table, index) 之前的桶已经迭代过。
+ * 还没有迭代到的桶在第一次被修改之前，先把桶中的节点和值保存到 saved 中，
+ * 迭代到这个桶时从 saved 中读取，所以新添加的键不会出现，被删除的键和被替换的值仍然可见。
+ */
+struct dictSnapshot
+{
+    dict * d;                       //被快照的字典
+    unsigned long size[2];          //快照开始时两个哈希表的大小，之后创建的哈希表大小记为 0
+    int table;                      //正在迭代的哈希表，迭代完成后为 2
+    long index;                     //正在迭代的桶
+    dictSnapshotBucket * cur;       //正在迭代的桶的内容
+    unsigned long pos;              //下一个要返回的节点在 cur 中的位置
+    dict * saved;                   //桶的编号 -> 修改之前保存的桶的内容
+    dictEntry entry;                //返回给调用者的节点
+    struct dictRehashWorker * pausedWorker; //快照期间被暂停的后台 rehash 线程
+};
+
+static uint64_t _dictSnapshotHash(const void * key)
+{
+    return dictGenHashFunction(&key, sizeof(key));
+}
+
+//快照保存的桶的类型，键为桶的编号
+static dictType dictSnapshotSavedType = {
+    _dictSnapshotHash,  /* hash function */
+    NULL,               /* key dup */
+    NULL,               /* val dup */
+    NULL,               /* key compare */
+    NULL,               /* key destructor */
+    NULL,               /* val destructor */
+    0,                  /* flags */
+    NULL,               /* embed key len */
+    NULL,               /* embed key */
+    NULL                /* key bytes */
+};
+
+//返回哈希表 table 中索引为 idx 的桶的编号
+#define dictSnapshotBucketId(table, idx) ((void *)(((uintptr_t)(table) << 63) | (uintptr_t)(idx)))
+
+/**
+ * 复制哈希表 table 在索引 idx 上的桶中的所有节点和值
+ *
+ * T = O(N) ，N 为桶中节点的数量
+ *
+ * @param d 字典
+ * @param table 哈希表
+ * @param idx 桶的索引
+ * @return 保存的桶的内容，桶为空时 n 为 0
+ */
+static dictSnapshotBucket * _dictSnapshotCapture(dict * d, int table, unsigned long idx)
+{
+    dictEntry * head = _dictBucketHead(d, &d->ht[table], idx), * de;
+    dictSnapshotBucket * b;
+    unsigned long n = 0;
+
+    for (de = head; de; de = de->next)
+        n++;
+
+    b = z_malloc(sizeof(dictSnapshotBucket) + n * sizeof(dictSnapshotItem));
+    b->n = n;
+    for (de = head, n = 0; de; de = de->next, n++)
+    {
+        b->items[n].de = de;
+        b->items[n].v.u64 = de->v.u64;
+        b->items[n].flags = 0;
+    }
+
+    return b;
+}
+
+/**
+ * 释放保存的桶，以及快照替调用者推迟释放的节点和值
+ *
+ * T = O(N) ，N 为桶中节点的数量
+ *
+ * @param d 字典
+ * @param b 保存的桶
+ */
+static void _dictSnapshotBucketFree(dict * d, dictSnapshotBucket * b)
+{
+    unsigned long i;
+
+    for (i = 0; i < b->n; i++)
+    {
+        dictSnapshotItem * item = &b->items[i];
+
+        if (item->flags & DICT_SNAPSHOT_OWN_VAL)
+            _dictRetire(d, DICT_RETIRED_VAL, item->v.val);
+        if (item->flags & DICT_SNAPSHOT_DEAD)
+            _dictRetire(d, DICT_RETIRED_ENTRY, item->de);
+        else if (item->flags & DICT_SNAPSHOT_DEAD_NOFREE)
+            _dictRetire(d, DICT_RETIRED_ENTRY_NOFREE, item->de);
+    }
+    z_free(b);
+}
+
+/**
+ * 哈希表 table 在索引 idx 上的桶将被修改，快照还没有迭代到这个桶时，先保存它
+ *
+ * T = O(1) ，第一次修改桶时为 O(N) ，N 为桶中节点的数量
+ *
+ * @param d 字典
+ * @param table 哈希表
+ * @param idx 桶的索引
+ * @return 快照保存的桶的内容；没有快照，或者桶不属于快照，或者已经迭代过，返回 NULL
+ */
+static dictSnapshotBucket * _dictSnapshotTouch(dict * d, int table, unsigned long idx)
+{
+    return _dictSnapshotLookup(d, table, idx, 1);
+}
+
+/**
+ * 查找快照替哈希表 table 在索引 idx 上的桶保存的内容
+ *
+ * T = O(1) ，create 为真并且第一次保存桶时为 O(N) ，N 为桶中节点的数量
+ *
+ * @param d 字典
+ * @param table 哈希表
+ * @param idx 桶的索引
+ * @param create 桶还没有被保存时是否保存它
+ * @return 快照保存的桶的内容；没有快照，或者桶不属于快照，或者已经迭代过，
+ *         或者 create 为假并且桶还没有被保存，返回 NULL
+ */
+static dictSnapshotBucket * _dictSnapshotLookup(dict * d, int table, unsigned long idx, int create)
+{
+    dictSnapshot * s = d->snapshot;
+    dictSnapshotBucket * b;
+    dictEntry * he;
+    void * id;
+
+    if (s == NULL || idx >= s->size[table]) return NULL;
+
+    //已经迭代过的桶
+    if (table < s->table || (table == s->table && (long)idx < s->index))
+        return NULL;
+    //正在迭代的桶
+    if (table == s->table && (long)idx == s->index)
+        return s->cur;
+
+    id = dictSnapshotBucketId(table, idx);
+    if ((he = dictFind(s->saved, id)) != NULL)
+        return dictGetVal(he);
+    if (!create) return NULL;
+
+    //空桶也要保存，否则之后添加的节点会被迭代到
+    b = _dictSnapshotCapture(d, table, idx);
+    dictAdd(s->saved, id, b);
+
+    return b;
+}
+
+/**
+ * 被保存的桶中的节点 de 被删除或者值被替换时，由快照接管节点或旧值的释放
+ *
+ * T = O(N) ，N 为桶中节点的数量
+ *
+ * @param b 快照保存的桶的内容，可以为 NULL
+ * @param de 节点
+ * @param flag DICT_SNAPSHOT_DEAD 、 DICT_SNAPSHOT_DEAD_NOFREE 或 DICT_SNAPSHOT_OWN_VAL
+ * @return 快照接管了释放返回 1 ，调用者照常释放返回 0
+ */
+static int _dictSnapshotKeep(dictSnapshotBucket * b, dictEntry * de, int flag)
+{
+    unsigned long i;
+
+    if (b == NULL) return 0;
+
+    for (i = 0; i < b->n; i++)
+    {
+        dictSnapshotItem * item = &b->items[i];
+
+        if (item->de != de) continue;
+        //值被再次替换时，中间的值不属于快照，照常释放
+        if (flag == DICT_SNAPSHOT_OWN_VAL &&
+            ((item->flags & DICT_SNAPSHOT_OWN_VAL) || item->v.val != de->v.val))
+            return 0;
+        item->flags |= flag;
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * 节点 de 的值将被替换，快照还需要旧值时由快照接管旧值的释放
+ *
+ * @param d 字典
+ * @param de 节点
+ * @param h 节点的键的哈希值
+ * @return 快照接管了旧值返回 1 ，调用者照常释放返回 0
+ */
+static int _dictSnapshotKeepVal(dict * d, dictEntry * de, uint64_t h)
+{
+    int table;
+
+    if (d->snapshot == NULL) return 0;
+
+    //节点可能在任意一个哈希表中，替换值不会修改桶，保存两个候选桶不影响正确性
+    for (table = 0; table <= (dictIsRehashing(d) ? 1 : 0); table++)
+    {
+        if (_dictSnapshotKeep(_dictSnapshotTouch(d, table, h & d->ht[table].sizeMask),
+                              de, DICT_SNAPSHOT_OWN_VAL))
+            return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * dictUnlinkFind() 移除的节点 de 将被释放，快照还需要它时由快照接管释放
+ *
+ * 节点在快照期间被移除时，所在的桶已经被快照保存；之后如果快照已经迭代过这个桶，
+ * 保存的内容随之释放，节点也就不再被快照需要。
+ * 快照期间不进行 rehash ，节点所在的桶可以由哈希值和快照开始时的哈希表大小重新算出。
+ *
+ * T = O(N) ，N 为桶中节点的数量
+ *
+ * @param d 字典
+ * @param de 已经从哈希表中移除的节点
+ * @return 快照接管了释放返回 1 ，调用者照常释放返回 0
+ */
+static int _dictSnapshotKeepUnlinked(dict * d, dictEntry * de)
+{
+    dictSnapshot * s = d->snapshot;
+    uint64_t h;
+    int table;
+
+    if (s == NULL) return 0;
+
+    h = dictEntryHashKey(d, de);
+    for (table = 0; table <= 1; table++)
+    {
+        if (s->size[table] &&
+            _dictSnapshotKeep(_dictSnapshotLookup(d, table, h & (s->size[table] - 1), 0), de, DICT_SNAPSHOT_DEAD))
+            return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * 为字典创建一个时间点一致的快照
+ *
+ * 快照返回的正好是创建快照时字典中的所有键值对，不受之后的添加、删除和 dictReplace() 的影响，
+ * 不需要 fork 子进程，也不需要复制整个字典：
+ * 只有快照还没迭代到的桶在第一次被修改时才会被复制，复制的桶在迭代到之后立即释放，
+ * 被删除的节点和被替换的值也在快照迭代到它们之后才释放。
+ *
+ * 快照期间字典不进行 rehash ，可以扩展但新的哈希表要等快照结束之后才开始迁移。
+ * 快照只保存键和值的指针：直接通过 dictSetVal() 修改节点的值、原地修改值指向的对象，
+ * 或者在 dictDeleteNoFree() 之后立即释放键值，都不在快照的保护范围之内。
+ * dictUnlinkFind() 移除的节点交给 dictFreeUnlinked() 释放时，快照仍然可以看到它。
+ * 每个字典同一时间只能有一个快照，快照期间不能调用 dictEmpty() 和 dictRelease() 。
+ *
+ * T = O(1)
+ *
+ * @param d 字典
+ * @return 快照迭代器
+ */
+dictSnapshot * dictSnapshotCreate(dict * d)
+{
+    dictSnapshot * s;
+
+    assert(d->snapshot == NULL);
+
+    s = z_malloc(sizeof(dictSnapshot));
+    s->d = d;
+    s->size[0] = d->ht[0].size;
+    s->size[1] = dictIsRehashing(d) ? d->ht[1].size : 0;
+    s->table = 0;
+    s->index = -1;
+    s->cur = NULL;
+    s->pos = 0;
+    s->saved = dictCreate(&dictSnapshotSavedType, NULL);
+
+    //快照期间节点不能在桶之间移动，和安全迭代器一样停止 rehash
+    _dictBgRehashPause(d);
+    s->pausedWorker = d->worker;
+    d->iterators++;
+    d->snapshot = s;
+
+    return s;
+}
+
+/**
+ * 返回快照中的下一个键值对
+ *
+ * 返回的节点由快照持有，只有键和值有效，在下一次调用之前有效
+ *
+ * T = O(1) ，平摊
+ *
+ * @param s 快照迭代器
+ * @return 快照迭代完毕时返回 NULL
+ */
+dictEntry * dictSnapshotNext(dictSnapshot * s)
+{
+    dict * d = s->d;
+
+    while (1)
+    {
+        dictEntry * he;
+
+        if (s->cur && s->pos < s->cur->n)
+        {
+            dictSnapshotItem * item = &s->cur->items[s->pos++];
+
+            s->entry.key = item->de->key;
+            s->entry.v.u64 = item->v.u64;
+            s->entry.next = NULL;
+            return &s->entry;
+        }
+
+        //当前桶已经迭代完，释放快照替它推迟释放的节点和值
+        if (s->cur)
+        {
+            _dictSnapshotBucketFree(d, s->cur);
+            s->cur = NULL;
+        }
+        if (s->table == 2) return NULL;
+
+        //移动到下一个桶
+        s->index++;
+        while ((unsigned long)s->index >= s->size[s->table])
+        {
+            if (++s->table == 2) return NULL;
+            s->index = 0;
+        }
+
+        //桶在快照期间被修改过，从 saved 中取出修改之前的内容
+        if (dictSize(s->saved) &&
+            (he = dictFind(s->saved, dictSnapshotBucketId(s->table, s->index))) != NULL)
+        {
+            s->cur = dictGetVal(he);
+            dictDelete(s->saved, dictGetKey(he));
+        }
+        //桶没有被修改过，复制它当前的内容，之后的修改不会再影响它
+        else if (_dictBucketHead(d, &d->ht[s->table], s->index) != NULL)
+        {
+            s->cur = _dictSnapshotCapture(d, s->table, s->index);
+        }
+        s->pos = 0;
+    }
+}
+
+/**
+ * 释放快照，快照可以在迭代完成之前释放
+ *
+ * T = O(N) ，N 为快照保存的桶中的节点数量
+ *
+ * @param s 快照迭代器
+ */
+void dictSnapshotRelease(dictSnapshot * s)
+{
+    dict * d = s->d;
+    dictIterator * iter;
+    dictEntry * he;
+
+    if (s->cur)
+        _dictSnapshotBucketFree(d, s->cur);
+
+    iter = dictGetIterator(s->saved);
+    while ((he = dictNext(iter)) != NULL)
+        _dictSnapshotBucketFree(d, dictGetVal(he));
+    dictReleaseIterator(iter);
+    dictRelease(s->saved);
+
+    d->snapshot = NULL;
+    d->iterators--;
+    _dictBgRehashResume(s->pausedWorker);
+    z_free(s);
+}
+
+/**
+ * 返回一个 64 位的伪随机数（splitmix64）
+ *
+ * 每个线程使用自己的状态，第一次调用时用时间和线程私有变量的地址作为种子。
+ * rand() 只有 31 位，无法覆盖超过 2^31 个桶的哈希表。
  *
  * T = O(1)
- *
- * @param d 要查找的字典
- * @param key 目标键
- * @return 找到返回节点，找不到返回 NULL
  */
-dictEntry * dictFind(dict * d, const void * key)
+static uint64_t _dictRandom(void)
 {
-    dictEntry * de;
-    unsigned int h, index, table;
-
-    //字典的哈希表为空
-    if (d->ht[0].size == 0) return NULL;
-
-    if (dictIsRehashing(d)) _dictRehashStep(d);
+    static __thread uint64_t state;
+    uint64_t z;
 
-    h = dictHashKey(d, key);
-    //在字典的哈希表中查找这个键
-    for (table = 0; table <= 1; table++)
+    if (state == 0)
     {
-        //计算索引值
-        index = h & d->ht[table].sizeMask;
+        struct timeval tv;
 
-        //遍历给定索引上的链表的所有节点， 查找key
-        de = d->ht[table].table[index];
-        while (de)
-        {
-            if (dictCompareKeys(d, de->key, key))
-                return de;
-
-            de = de->next;
-        }
-
-        // 如果程序遍历完 0 号哈希表，仍然没找到指定的键的节点
-        // 那么程序会检查字典是否在进行 rehash ，
-        // 然后才决定是直接返回 NULL ，还是继续查找 1 号哈希表
-        if (!dictIsRehashing(d)) return NULL;
+        gettimeofday(&tv, NULL);
+        state = ((uint64_t)tv.tv_sec * 1000000 + tv.tv_usec) ^ (uint64_t)(uintptr_t)&state;
     }
 
-    // 进行到这里时，说明两个哈希表都没找到
-    return NULL;
+    z = (state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
 }
 
 /**
- * 获取包含给定键的节点的值
+ * 返回 [0, n) 之间均匀分布的随机数
  *
- * T = O(1)
+ * 丢弃落在 2^64 除以 n 的余数部分的随机数，避免取模带来的偏差
  *
- * @param d 目标字典
- * @param key 给定键
- * @return 如果节点不为空，返回节点的值; 否则返回 NULL
+ * T = O(1) ，期望
+ *
+ * @param n 上界，必须大于 0
  */
-void * dictFetchValue(dict * d, const void * key)
+static unsigned long _dictRandomBelow(unsigned long n)
 {
-    dictEntry * de;
-    de = dictFind(d, key);
+    uint64_t r, limit = -(uint64_t)n % n;
 
-    return de ? dictGetVal(de) : NULL;
+    do
+        r = _dictRandom();
+    while (r < limit);
+
+    return r % n;
 }
 
 /**
- * 指纹是一个64位的数字，表示字典的状态
- * 在给定的时间，它只是几个dict属性xor在一起。
- * 当一个不安全的迭代器被初始化时，我们得到dict指纹，并检查
- * 当迭代器被释放时，再次使用指纹。
- * 如果两个指纹不同，意味着迭代器的用户
- * 迭代时对字典执行禁止的操作。
+ * 返回哈希表 ht 在索引 idx 上的桶中的节点数量
  *
- * @param d 字典
- * @return 给定字典的指纹
+ * 分组哈希表的组内节点数量保存在控制字节中，只有溢出链表需要遍历
+ *
+ * T = O(N) ，N 为链表（溢出链表）的长度
  */
-long long dictFingerprint(dict * d)
+static unsigned long _dictBucketLen(dict * d, dictht * ht, unsigned long idx)
 {
-    long long integers[6], hash = 0;
-    int j;
+    unsigned long len = 0;
+    dictEntry * de;
 
-    integers[0] = (long)d->ht[0].table;
-    integers[1] = d->ht[0].size;
-    integers[2] = d->ht[0].used;
-    integers[3] = (long)d->ht[1].table;
-    integers[4] = d->ht[1].size;
-    integers[5] = d->ht[1].used;
+    if (dictIsGrouped(d))
+    {
+        dictGroup * g = _dictGroupAt(d, ht, idx, 0);
 
-    for (j = 0; j < 6; j++)
+        if (g == NULL) return 0;
+        len = g->meta & DICT_GROUP_COUNT_MASK;
+        if (!(g->meta & DICT_GROUP_OVERFLOW)) return len;
+        de = g->entries[DICT_GROUP_SLOTS - 1]->next;
+    }
+    else
     {
-        hash += integers[j];
-        hash = (~hash) + (hash << 21);
-        hash = hash ^ (hash >> 24);
-        hash = (hash + (hash << 3)) + (hash << 8);  //hash * 265
-        hash = hash ^ (hash >> 14);
-        hash = (hash + (hash << 2)) + (hash << 4);  //hash * 21
-        hash = hash ^ (hash >> 28);
-        hash = hash + (hash << 31);
+        de = _dictBucketHead(d, ht, idx);
     }
-    return hash;
+
+    for (; de; de = de->next)
+        len++;
+
+    return len;
 }
 
 /**
- * 创建并返回给定字典的不安全迭代器
- *
- * T = O(1)
+ * 返回哈希表 ht 在索引 idx 上的桶中的第 n 个节点（从 0 开始），n 必须小于桶中的节点数量
  *
- * @param d 给定字典
- * @return 字典的不安全迭代器
+ * T = O(N)
  */
-dictIterator * dictGetIterator(dict * d)
+static dictEntry * _dictBucketNth(dict * d, dictht * ht, unsigned long idx, unsigned long n)
 {
-    dictIterator * iter = z_malloc(sizeof(dictIterator));
+    dictEntry * de;
 
-    iter->d = d;
-    iter->table = 0;
-    iter->index = -1;
-    iter->safe = 0;
-    iter->entry = NULL;
-    iter->nextEntry = NULL;
+    if (dictIsGrouped(d))
+    {
+        dictGroup * g = _dictGroupAt(d, ht, idx, 0);
 
-    return iter;
+        if (n < DICT_GROUP_SLOTS) return g->entries[n];
+        de = g->entries[DICT_GROUP_SLOTS - 1];
+        n -= DICT_GROUP_SLOTS - 1;
+    }
+    else
+    {
+        de = _dictBucketHead(d, ht, idx);
+    }
+
+    while (n--)
+        de = de->next;
+
+    return de;
 }
 
 /**
- * 创建并返回给定节点的安全迭代器
+ * 为随机取样选择块的大小
  *
- * T = O(1)
+ * 块的平均节点数量在 (0.5, 1] 之间，块不能跨越较小的哈希表。
+ * 块的大小变化之后，之前学到的上界不再适用，按块的平均节点数量重新估计。
  *
- * @param d 给定字典
- * @return 返回字典的安全迭代器
+ * T = O(log N)
+ *
+ * @param d 字典，必须非空
+ * @return 每块包含的桶的数量
  */
-dictIterator * dictGetSafeIterator(dict * d)
+static unsigned long _dictSampleBlock(dict * d)
 {
-    dictIterator * iter = dictGetIterator(d);
-    iter->safe = 1;
+    unsigned long slots = d->ht[0].size, block = 1;
 
-    return iter;
+    if (dictIsRehashing(d))
+        slots += d->ht[1].size;
+
+    while (block < DICT_SAMPLE_MAX_BLOCK && block * 2 * dictSize(d) <= slots &&
+           block * 2 <= d->ht[0].size && (!dictIsRehashing(d) || block * 2 <= d->ht[1].size))
+        block *= 2;
+
+    if (d->sampleBlock != block)
+    {
+        d->sampleBlock = block;
+        d->sampleBound = 2 * ((block * dictSize(d) + slots - 1) / slots) + 2;
+    }
+
+    return block;
 }
 
 /**
- * 返回迭代器指向的当前节点
+ * 从字典中均匀地随机取出一个节点，调用者保证字典非空、已经暂停后台 rehash ，
+ * 并且已经通过 _dictSampleBlock() 选择了块的大小
  *
- * T = O(1)
+ * 把两个哈希表的桶划分为每 block 个连续桶一块，随机选择一块，数出块中的节点数量 len ，
+ * 再在 [0, sampleBound) 中随机选择一个位置，位置小于 len 时返回块中这个位置上的节点，否则重试。
+ * 每次尝试中每个节点被选中的概率都是 1 / (块的数量 * sampleBound) ，
+ * 所以只要每块的节点数量都不超过 sampleBound ，结果就是严格均匀的，长链表中的节点不会被少取。
+ * 遇到节点数量超过 sampleBound 的块时，提高 sampleBound 并重试，上界只增不减。
  *
- * @param iter 目标迭代器
- * @return 字典迭代完毕时，返回 NULL
+ * 稀疏的哈希表（比如大量删除之后）会使用更大的块，让每块的平均节点数量保持在 1 左右，
+ * 每次尝试顺序地读取一块连续的桶，期望的尝试次数不随哈希表变得稀疏而增长。
+ *
+ * T = O(1) ，期望
+ *
+ * @param d 字典
+ * @return 随机节点
  */
-dictEntry * dictNext(dictIterator * iter)
+static dictEntry * _dictSampleOne(dict * d)
 {
+    unsigned long block = d->sampleBlock, blocks0, blocks;
+
+    blocks0 = d->ht[0].size / block;
+    blocks = blocks0 + (dictIsRehashing(d) ? d->ht[1].size / block : 0);
+
     while (1)
     {
-        // 进入这个循环有两种可能：
-        // 1) 这是迭代器第一次运行
-        // 2) 当前索引链表中的节点已经迭代完（NULL 为链表的表尾）
-        if (iter->entry == NULL)
-        {
-            //指向被迭代的哈希表
-            dictht * ht = &iter->d->ht[iter->table];
-            //初次迭代时执行
-            if (iter->index == -1 && iter->table == 0)
-            {
-                if (iter->safe) //如果是安全迭代器，那么更新安全迭代器计数器
-                    iter->d->iterators++;
-                else            //如果不是安全迭代器，那么计算指纹
-                    iter->fingerprint = dictFingerprint(iter->d);
-            }
-            iter->index++;
+        unsigned long b = _dictRandomBelow(blocks), first, len = 0, i, n;
+        dictht * ht = b < blocks0 ? &d->ht[0] : &d->ht[1];
 
-            // 如果迭代器的当前索引大于当前被迭代的哈希表的大小
-            // 那么说明这个哈希表已经迭代完毕
-            if (iter->index >= (signed) ht->size)
-            {
-                // 如果正在 rehash 的话，那么说明 1 号哈希表也正在使用中
-                // 那么继续对 1 号哈希表进行迭代
-                if (dictIsRehashing(iter->d) && iter->table == 0)
-                {
-                    iter->table++;
-                    iter->index = 0;
-                    ht = &iter->d->ht[1];
-                }
-                // 如果没有 rehash ，那么说明迭代已经完成
-                else
-                    break;
-            }
+        first = (b < blocks0 ? b : b - blocks0) * block;
+        for (i = 0; i < block; i++)
+            len += _dictBucketLen(d, ht, first + i);
 
-            // 如果进行到这里，说明这个哈希表并未迭代完
-            // 更新节点指针，指向下个索引链表的表头节点
-            iter->entry = ht->table[iter->index];
-        }
-        else
+        if (len > d->sampleBound)
         {
-            // 执行到这里，说明程序正在迭代某个链表
-            // 将节点指针指向链表的下一个节点
-            iter->entry = iter->nextEntry;
+            d->sampleBound = len;
+            continue;
         }
 
-        // 如果当前节点不为空，那么也记录下该节点的下个节点
-        // 因为安全迭代器有可能会将迭代器返回的当前节点删除
-        if (iter->entry)
-        {
-            iter->nextEntry = iter->entry->next;
-            return iter->entry;
-        }
-    }
+        n = _dictRandomBelow(d->sampleBound);
+        if (n >= len) continue;
 
-    return NULL;
-}
+        for (i = first; ; i++)
+        {
+            unsigned long l = _dictBucketLen(d, ht, i);
 
-/**
- * 释放给定字典迭代器
- *
- * T = O(1)
- *
- * @param iter 要释放的字典
- */
-void dictReleaseIterator(dictIterator * iter)
-{
-    if (!(iter->index == -1 && iter->table == 0))
-    {
-        if (iter->safe) //释放安全迭代器
-            iter->d->iterators--;
-        else
-            assert(iter->fingerprint == dictFingerprint(iter->d));//assert
+            if (n < l) return _dictBucketNth(d, ht, i, n);
+            n -= l;
+        }
     }
-    z_free(iter);
 }
 
 /**
  * 随机返回字典中任意一个节点。
  *
- * 可用于实现随机化算法。
+ * 可用于实现随机化算法。每个节点被返回的概率相同，见 _dictSampleOne() 。
  *
- * T = O(N)
+ * T = O(1) ，期望
  *
  * @param d 给定字典
  * @return 如果字典为空，返回 NULL 。
  */
 dictEntry * dictGetRandomKey(dict * d)
 {
-    dictEntry * de, * origin;
-    unsigned int h;
-    int listLen, listEle;
+    dictEntry * de;
+    dictRehashWorker * w;
 
     //字典为空
     if (dictSize(d) == 0) return NULL;
 
     if (dictIsRehashing(d)) _dictRehashStep(d);
 
-    // 如果正在 rehash ，那么将 1 号哈希表也作为随机查找的目标
-    if (dictIsRehashing(d))
-    {
-        do
-        {
-            h = rand() % (d->ht[0].size + d->ht[1].size);
-            //random()
-            de = (h >= d->ht[0].size) ? d->ht[1].table[h - d->ht[0].size] : d->ht[0].table[h];
-        }
-        while (de == NULL);
-    }
-    else    //只检查0号的哈希表
+    //随机取样会访问多个桶，期间暂停后台 rehash
+    _dictBgRehashPause(d);
+    w = d->worker;
+    _dictSampleBlock(d);
+    de = _dictSampleOne(d);
+    _dictBgRehashResume(w);
+
+    return de;
+}
+
+/**
+ * 从字典中独立、均匀地随机取出 n 个节点（有放回，同一个节点可能被取出多次）
+ *
+ * 适用于淘汰、SRANDMEMBER 之类需要取样质量的场景；
+ * 需要互不相同的节点时由调用者去重。整批取样只暂停一次后台 rehash ，
+ * 取样期间不执行单步 rehash ，所有样本来自同一个字典状态。
+ *
+ * 逐个取样的期望开销和桶的数量与节点数量之比成正比，
+ * 大量删除之后的稀疏哈希表上，如果逐个取样需要读取的桶比整个哈希表还多，
+ * 就顺序遍历一次哈希表收集所有节点，再从中均匀地取样；
+ * 同时在 resize 策略允许时开始收缩哈希表，之后的取样不再受稀疏的影响。
+ *
+ * T = O(n) ，期望；稀疏时为 O(N) ，N 为桶的数量
+ *
+ * @param d 字典
+ * @param out 保存结果的数组，至少可以容纳 n 个节点
+ * @param n 要取出的节点数量
+ * @return 取出的节点数量，字典为空时返回 0 ，否则返回 n
+ */
+unsigned long dictSampleKeys(dict * d, dictEntry ** out, unsigned long n)
+{
+    unsigned long i;
+    dictRehashWorker * w;
+
+    if (dictSize(d) == 0) return 0;
+
+    //负载过低时开始收缩，迁移由之后的操作逐步完成
+    _dictShrinkIfNeeded(d);
+
+    _dictBgRehashPause(d);
+    w = d->worker;
+
+    //逐个取样平均读取 sampleBound * 桶数量 / 节点数量 个桶，整批超过桶的数量时改为遍历
+    _dictSampleBlock(d);
+    if (n * d->sampleBound >= dictSize(d))
     {
-        do
+        dictEntry ** all = z_malloc(dictSize(d) * sizeof(dictEntry *)), * de;
+        unsigned long used = 0;
+        int table;
+
+        for (table = 0; table <= (dictIsRehashing(d) ? 1 : 0); table++)
         {
-            h = rand() & d->ht[0].sizeMask;
-            de = d->ht[0].table[h];
+            for (i = 0; i < d->ht[table].size; i++)
+            {
+                for (de = _dictBucketHead(d, &d->ht[table], i); de; de = de->next)
+                    all[used++] = de;
+            }
         }
-        while (de == NULL);
-    }
+        assert(used == dictSize(d));
 
-    // 目前 he 已经指向一个非空的节点链表
-    // 程序将从这个链表随机返回一个节点
-    listLen = 0;
-    origin = de;
-    while (de)  //计算节点数量
+        for (i = 0; i < n; i++)
+            out[i] = all[_dictRandomBelow(used)];
+        z_free(all);
+    }
+    else
     {
-        de = de->next;
-        listLen++;
+        for (i = 0; i < n; i++)
+            out[i] = _dictSampleOne(d);
     }
-    listEle = rand() % listLen;
-    de = origin;
 
-    //按索引查找节点
-    while (listEle--) de = de->next;
+    _dictBgRehashResume(w);
 
-    return de;
+    return n;
 }
 
 /**
@@ -996,34 +3732,40 @@ int dictGetRandomKeys(dict * d, dictEntry ** des, int count)
 {
     int j;
     int stored = 0;
+    dictRehashWorker * w;
 
-    if (dictSize(d) < count) count = dictSize(d);
+    if (dictSize(d) < (unsigned long)count) count = dictSize(d);
+
+    //取样期间暂停后台 rehash
+    _dictBgRehashPause(d);
+    w = d->worker;
     while (stored < count)
     {
-        for (j = 0; j < 2; j++)
+        for (j = 0; j < 2 && stored < count; j++)
         {
-            unsigned int i = rand() & d->ht[j].sizeMask;
-            int size = d->ht[j].size;
+            unsigned long i = _dictRandom() & d->ht[j].sizeMask;
+            unsigned long size = d->ht[j].size;
 
-            while (size--)
+            while (size-- && stored < count)
             {
-                dictEntry * de = d->ht[j].table[i];
-                while (de)
+                dictEntry * de = _dictBucketHead(d, &d->ht[j], i);
+                while (de && stored < count)
                 {
                     *des = de;
                     des++;
                     de = de->next;
                     stored++;
-                    if (stored == count) return stored;
                 }
                 i = (i + 1) & d->ht[j].sizeMask;
             }
 
             /* If there is only one table and we iterated it all, we should
              * already have 'count' elements. Assert this condition. */
-            assert(dictIsRehashing(d) != 0);
+            if (stored < count)
+                assert(dictIsRehashing(d) != 0);
         }
     }
+    _dictBgRehashResume(w);
 
     return stored;
 }
@@ -1161,33 +3903,80 @@ static unsigned long rev(unsigned long v) {
  * 这个迭代器是完全无状态的，这是一个巨大的优势，
  * 因为迭代可以在不使用任何额外内存的情况下进行。
  *
- * The disadvantages resulting from this design are:
- * 这个设计的缺陷在于：
+ * The disadvantages resulting from this design are:
+ * 这个设计的缺陷在于：
+ *
+ * 1) It is possible that we return duplicated elements. However this is usually
+ *    easy to deal with in the application level.
+ *    函数可能会返回重复的元素，不过这个问题可以很容易在应用层解决。
+ * 2) The iterator must return multiple elements per call, as it needs to always
+ *    return all the keys chained in a given bucket, and all the expansions, so
+ *    we are sure we don't miss keys moving.
+ *    为了不错过任何元素，
+ *    迭代器需要返回给定桶上的所有键，
+ *    以及因为扩展哈希表而产生出来的新表，
+ *    所以迭代器必须在一次迭代中返回多个元素。
+ * 3) The reverse cursor is somewhat hard to understand at first, but this
+ *    comment is supposed to help.
+ *    对游标进行翻转（reverse）的原因初看上去比较难以理解，
+ *    不过阅读这份注释应该会有所帮助。
+ */
+unsigned long dictScan(dict * d, unsigned long v, dictScanFunction * fn, void * privData)
+{
+    unsigned long m0;
+    dictRehashWorker * w;
+
+    //跳过空字典
+    if (dictSize(d) == 0) return 0;
+
+    //访问桶期间暂停后台 rehash
+    _dictBgRehashPause(d);
+    w = d->worker;
+    m0 = _dictScanCursor(d, v, fn, privData);
+    _dictBgRehashResume(w);
+
+    return dictScanCursorNext(v, m0);
+}
+
+/**
+ * 计算 dictScan() 的下一个游标：只保留较小哈希表掩码 m0 中的位，对翻转后的游标加一
+ *
+ * 通用字典和 DICT_DEFINE() 生成的字典共用这个计算。
+ *
+ * T = O(1)
+ *
+ * @param v 当前游标
+ * @param m0 较小哈希表的掩码
+ * @return 下一个游标，为 0 表示迭代完成
+ */
+unsigned long dictScanCursorNext(unsigned long v, unsigned long m0)
+{
+    v |= ~m0;
+    v = rev(v);
+    v++;
+    v = rev(v);
+
+    return v;
+}
+
+/**
+ * 访问游标 v 对应的所有桶中的节点：较小哈希表中的桶 v & m0 ，
+ * 以及 rehash 时较大哈希表中由这个桶扩展出来的所有桶
+ *
+ * T = O(N) ，N 为这些桶中节点的数量
  *
- * 1) It is possible that we return duplicated elements. However this is usually
- *    easy to deal with in the application level.
- *    函数可能会返回重复的元素，不过这个问题可以很容易在应用层解决。
- * 2) The iterator must return multiple elements per call, as it needs to always
- *    return all the keys chained in a given bucket, and all the expansions, so
- *    we are sure we don't miss keys moving.
- *    为了不错过任何元素，
- *    迭代器需要返回给定桶上的所有键，
- *    以及因为扩展哈希表而产生出来的新表，
- *    所以迭代器必须在一次迭代中返回多个元素。
- * 3) The reverse cursor is somewhat hard to understand at first, but this
- *    comment is supposed to help.
- *    对游标进行翻转（reverse）的原因初看上去比较难以理解，
- *    不过阅读这份注释应该会有所帮助。
+ * @param d 字典
+ * @param v 游标
+ * @param fn 对每个节点调用的函数
+ * @param privData 传给 fn 的参数
+ * @return 较小哈希表的掩码 m0
  */
-unsigned long dictScan(dict * d, unsigned long v, dictScanFunction * fn, void * privData)
+static unsigned long _dictScanCursor(dict * d, unsigned long v, dictScanFunction * fn, void * privData)
 {
     dictht * t0, * t1;
     const dictEntry * de;
     unsigned long m0, m1;
 
-    //跳过空字典
-    if (dictSize(d) == 0) return 0;
-
     //迭代只有一个哈希表的字典
     if (!dictIsRehashing(d))
     {
@@ -1195,7 +3984,7 @@ unsigned long dictScan(dict * d, unsigned long v, dictScanFunction * fn, void *
         m0 = t0->sizeMask;
 
         //指向哈希桶
-        de = t0->table[v & m0];
+        de = _dictBucketHead(d, t0, v & m0);
         while (de)
         {
             fn(privData, de);
@@ -1218,7 +4007,7 @@ unsigned long dictScan(dict * d, unsigned long v, dictScanFunction * fn, void *
         m1 = t1->sizeMask;
 
         //指向桶，并迭代桶中的所有节点
-        de = t0->table[v & m0];
+        de = _dictBucketHead(d, t0, v & m0);
         while (de)
         {
             fn(privData, de);
@@ -1229,7 +4018,7 @@ unsigned long dictScan(dict * d, unsigned long v, dictScanFunction * fn, void *
         // that are the expansion of the index pointed to   // 这些桶被索引的 expansion 所指向
         do
         {
-            de = t1->table[v & m1];
+            de = _dictBucketHead(d, t1, v & m1);
             while (de)
             {
                 fn(privData, de);
@@ -1241,18 +4030,106 @@ unsigned long dictScan(dict * d, unsigned long v, dictScanFunction * fn, void *
         while (v & (m0 ^ m1));
     }
 
-    v |= ~m0;
-    v = rev(v);
-    v++;
-    v = rev(v);
+    return m0;
+}
 
-    return v;
+/**
+ * dictScanParallel() 的各个线程共享的任务
+ */
+typedef struct dictScanJob
+{
+    dict * d;
+    dictScanFunction * fn;
+    void * privData;
+    unsigned long cursors;  //游标空间的大小，即较小哈希表的桶的数量
+    unsigned long next;     //下一个还没有被领取的游标区间的起点，原子地递增
+} dictScanJob;
+
+/**
+ * dictScanParallel() 的线程主函数，每次领取 DICT_SCAN_PARALLEL_CHUNK 个连续的游标，
+ * 直到游标空间被领取完
+ *
+ * @param arg dictScanJob
+ * @return NULL
+ */
+static void * _dictScanWorkerMain(void * arg)
+{
+    dictScanJob * job = arg;
+    unsigned long start, end, v;
+
+    while ((start = __atomic_fetch_add(&job->next, DICT_SCAN_PARALLEL_CHUNK, __ATOMIC_RELAXED)) < job->cursors)
+    {
+        end = start + DICT_SCAN_PARALLEL_CHUNK;
+        if (end > job->cursors) end = job->cursors;
+
+        for (v = start; v < end; v++)
+            _dictScanCursor(job->d, v, job->fn, job->privData);
+    }
+
+    return NULL;
+}
+
+/**
+ * 使用多个线程遍历字典中的所有节点
+ *
+ * 把 dictScan() 的游标空间（较小哈希表的桶的索引）划分为互不相交的区间，由 threads 个线程
+ * （包括调用者自己）并行处理。每个游标和 dictScan() 一样访问较小哈希表中的一个桶，
+ * 以及较大哈希表中由它扩展出来的所有桶，所以两个哈希表中的每个桶都正好被访问一次，
+ * 不会漏掉也不会重复返回任何节点。
+ *
+ * 遍历期间字典被冻结：不进行 rehash ，也不能被修改。
+ * fn 会在多个线程中同时被调用，必须是线程安全的，并且不能修改字典。
+ *
+ * T = O(N / threads)
+ *
+ * @param d 字典
+ * @param threads 线程的数量，不超过 DICT_SCAN_PARALLEL_MAX_THREADS
+ * @param fn 对每个节点调用的函数
+ * @param privData 传给 fn 的参数
+ */
+void dictScanParallel(dict * d, int threads, dictScanFunction * fn, void * privData)
+{
+    pthread_t tids[DICT_SCAN_PARALLEL_MAX_THREADS];
+    dictScanJob job;
+    dictRehashWorker * w;
+    int i, started = 0;
+
+    if (dictSize(d) == 0) return;
+    if (threads < 1) threads = 1;
+    if (threads > DICT_SCAN_PARALLEL_MAX_THREADS) threads = DICT_SCAN_PARALLEL_MAX_THREADS;
+
+    //冻结字典：暂停后台 rehash ，并且和安全迭代器一样阻止单步 rehash
+    _dictBgRehashPause(d);
+    w = d->worker;
+    d->iterators++;
+
+    job.d = d;
+    job.fn = fn;
+    job.privData = privData;
+    job.next = 0;
+    job.cursors = d->ht[0].size;
+    if (dictIsRehashing(d) && d->ht[1].size < job.cursors)
+        job.cursors = d->ht[1].size;
+
+    //创建线程失败时由已有的线程完成剩下的游标
+    for (i = 1; i < threads; i++)
+    {
+        if (pthread_create(&tids[started], NULL, _dictScanWorkerMain, &job) != 0)
+            break;
+        started++;
+    }
+    _dictScanWorkerMain(&job);
+    for (i = 0; i < started; i++)
+        pthread_join(tids[i], NULL);
+
+    d->iterators--;
+    _dictBgRehashResume(w);
 }
 
 /* private function */
 
 /**
- * 根据需要，初始化字典（的哈希表），或者对字典（的现有哈希表）进行扩展
+ * 根据需要，初始化字典（的哈希表），或者对字典（的现有哈希表）进行扩展或收缩
  *
  * T = O(N)
  *
@@ -1261,6 +4138,8 @@ unsigned long dictScan(dict * d, unsigned long v, dictScanFunction * fn, void *
  */
 static int _dictExpandIfNeeded(dict * d)
 {
+    unsigned long target;
+
     //渐进式rehash已经在进行了，直接返回
     if (dictIsRehashing(d)) return DICT_OK;
 
@@ -1268,17 +4147,97 @@ static int _dictExpandIfNeeded(dict * d)
     // T = O(1)
     if (d->ht[0].size == 0) return dictExpand(d, DICT_HT_INITIAL_SIZE);
 
-    // 一下两个条件之一为真时，对字典进行扩展
-    // 1）字典已使用节点数和字典大小之间的比率接近 1：1
-    //    并且 dict_can_resize 为真
-    // 2）已使用节点数和字典大小之间的比率超过 dict_force_resize_ratio
-    if (d->ht[0].used >= d->ht[0].size &&
-        (dict_can_resize || d->ht[0].used / d->ht[0].size > dict_force_resize_ratio))
+    // 字典的容量等于桶的数量乘以负载因子，链式哈希表的负载因子为 1
+    target = dictResizeGrowTarget(d->resizePolicy, d->ht[0].size * _dictLoadFactor(d), d->ht[0].used);
+    if (target) return dictExpand(d, target);
+
+    //大量删除之后，添加节点时也可能需要收缩
+    return _dictShrinkIfNeeded(d);
+}
+
+/**
+ * 字典的负载低于策略的收缩阈值时，开始渐进式地收缩字典
+ *
+ * 有子进程正在保存时不收缩：收缩不是必须的，推迟到之后的删除或添加操作即可。
+ *
+ * T = O(1)
+ *
+ * @param d 目标字典
+ * @return 不需要收缩或者成功开始收缩返回 DICT_OK ，无法开始收缩返回 DICT_ERR
+ */
+static int _dictShrinkIfNeeded(dict * d)
+{
+    unsigned long target;
+
+    //正在 rehash ，或者已经是最小的哈希表
+    if (dictIsRehashing(d) || d->ht[0].size <= DICT_HT_INITIAL_SIZE) return DICT_OK;
+
+    target = dictResizeShrinkTarget(d->resizePolicy, d->ht[0].size * _dictLoadFactor(d), d->ht[0].used);
+    if (target == 0) return DICT_OK;
+
+    return dictExpand(d, target);
+}
+
+/**
+ * 按照策略判断容量为 capacity 、已有 used 个节点的哈希表是否需要扩展
+ *
+ * 以下两个条件之一为真时扩展：
+ * 1）已使用节点数达到容量的 growPercent ，并且策略允许 resize
+ * 2）策略只是推迟 resize ，但已使用节点数和容量之间的比率超过 forceRatio
+ *
+ * 通用字典和 DICT_DEFINE() 生成的字典共用这个判断。
+ *
+ * T = O(1)
+ *
+ * @param policy resize 策略，为 NULL 时使用全局策略
+ * @param capacity 哈希表的容量
+ * @param used 已有节点的数量
+ * @return 需要扩展时返回扩展的目标大小（节点数量），否则返回 0
+ */
+unsigned long dictResizeGrowTarget(dictResizePolicy * policy, unsigned long capacity, unsigned long used)
+{
+    dictResizePolicy * p = policy ? policy : &dict_default_resize_policy;
+    int state = __atomic_load_n(&p->state, __ATOMIC_RELAXED);
+
+    if (used * 100 >= capacity * p->growPercent &&
+        (state == DICT_RESIZE_ENABLE ||
+         (state == DICT_RESIZE_AVOID && used / capacity > p->forceRatio)))
     {
-        return dictExpand(d, d->ht[0].used * 2);
+        //扩展到目标负载
+        return used * 100 / p->targetPercent;
     }
 
-    return DICT_OK;
+    return 0;
+}
+
+/**
+ * 按照策略判断容量为 capacity 、已有 used 个节点的哈希表是否需要收缩
+ *
+ * 收缩到目标负载，收缩之后的负载不低于 targetPercent 的一半，
+ * 所以不会紧接着再次收缩，也不会因为少量添加就重新扩展。
+ * 调用者负责检查哈希表是否已经是最小的。
+ *
+ * T = O(1)
+ *
+ * @param policy resize 策略，为 NULL 时使用全局策略
+ * @param capacity 哈希表的容量
+ * @param used 已有节点的数量
+ * @return 需要收缩时返回收缩的目标大小（节点数量），否则返回 0
+ */
+unsigned long dictResizeShrinkTarget(dictResizePolicy * policy, unsigned long capacity, unsigned long used)
+{
+    dictResizePolicy * p = policy ? policy : &dict_default_resize_policy;
+    unsigned long minimal;
+
+    if (p->shrinkPercent == 0 || __atomic_load_n(&p->state, __ATOMIC_RELAXED) != DICT_RESIZE_ENABLE)
+        return 0;
+    if (used * 100 >= capacity * p->shrinkPercent) return 0;
+
+    minimal = used * 100 / p->targetPercent;
+    if (minimal < DICT_HT_INITIAL_SIZE)
+        minimal = DICT_HT_INITIAL_SIZE;
+
+    return minimal;
 }
 
 /**
@@ -1289,7 +4248,7 @@ static int _dictExpandIfNeeded(dict * d)
  * @param size 要扩展的字典的大小
  * @return 扩展后的字典大小
  */
-static unsigned long _dictNextPower(unsigned long size)
+unsigned long dictNextPower(unsigned long size)
 {
     unsigned long i = DICT_HT_INITIAL_SIZE;
 
@@ -1313,28 +4272,42 @@ static unsigned long _dictNextPower(unsigned long size)
  *
  * @param d 要插入的字典
  * @param key 键
+ * @param h 键的哈希值
+ * @param existing 不为 NULL 时，键已经存在则设为包含键的节点
  * @return 返回可以将 key 插入到哈希表的索引位置；
  *          如果 key 已经存在于哈希表，那么返回 -1
  */
-static int _dictKeyIndex(dict * d, const void * key)
+static long _dictKeyIndex(dict * d, const void * key, uint64_t h, dictEntry ** existing)
 {
-    unsigned int h, index, table;
+    unsigned long index;
+    int table;
     dictEntry * he;
 
-    if (_dictExpandIfNeeded(d) == DICT_ERR)
-        return -1;
-
-    //计算哈希值
-    h = dictHashKey(d, key);
     for (table = 0; table <= 1; table++)
     {
         index = h & d->ht[table].sizeMask;
 
-        he = d->ht[table].table[index];
+        if (dictIsGrouped(d))
+        {
+            dictGroup * g = _dictGroupAt(d, &d->ht[table], index, 0);
+
+            if (g && (he = _dictGroupFind(d, g, key, h, NULL, NULL)) != NULL)
+            {
+                if (existing) *existing = he;
+                return -1;
+            }
+            if (!dictIsRehashing(d)) break;
+            continue;
+        }
+
+        he = _dictBucketHead(d, &d->ht[table], index);
         while (he)
         {
-            if (dictCompareKeys(d, key, he->key))
+            if (dictEntryMatch(d, he, key, h))
+            {
+                if (existing) *existing = he;
                 return -1;
+            }
             he = he->next;
         }
 
@@ -1356,13 +4329,233 @@ static int _dictKeyIndex(dict * d, const void * key)
  */
 void dictEmpty(dict * d, void(callback)(void *))
 {
-    _dictClear(d, &d->ht[0], callback);
-    _dictClear(d, &d->ht[1], callback);
+    dictht old[2];
 
+    assert(d->snapshot == NULL);
+    _dictBgRehashStop(d);
+
+    //先让字典指向空的哈希表，再释放旧的哈希表
+    old[0] = d->ht[0];
+    old[1] = d->ht[1];
+    _dictWriteBegin(d);
+    _dictReset(&d->ht[0]);
+    _dictReset(&d->ht[1]);
     d->rehashIndex = -1;
+    _dictWriteEnd(d);
+
+    //等待可能还在访问旧哈希表的无锁读者退出
+    if (d->concurrent)
+        _dictEpochSynchronize();
+
+    _dictClear(d, &old[0], callback);
+    _dictClear(d, &old[1], callback);
+    d->entryBytes = 0;
+    d->keyBytes = 0;
+    if (dictUsesSlab(d))
+    {
+        //等待释放的节点也在 slab 的页中，读者已经全部退出，可以先释放
+        _dictRetiredFreeAll(d);
+        dictSlabRelease(&d->slab);
+    }
+
     d->iterators = 0;
 }
 
+/**
+ * 返回字典的节点 slab 的占用情况，没有使用 slab 的字典返回全 0
+ *
+ * T = O(1)
+ *
+ * @param d 字典
+ * @param stats 用于保存结果
+ */
+void dictGetSlabStats(dict * d, dictSlabStats * stats)
+{
+    if (!dictUsesSlab(d))
+    {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+
+    dictSlabGetStats(&d->slab, stats);
+}
+
+/**
+ * 返回哈希表的段目录和已经分配的段占用的字节数
+ *
+ * T = O(N / 2^DICT_SEGMENT_SHIFT)
+ *
+ * @param d 字典
+ * @param ht 哈希表
+ */
+static size_t _dictTableBytes(dict * d, dictht * ht)
+{
+    size_t segBytes = _dictTableAllocSize(d, dictSegmentSize(d, ht)), bytes;
+    unsigned long s, count = dictSegmentCount(d, ht);
+
+    if (ht->table == NULL) return 0;
+
+    bytes = z_malloc_size(ht->table);
+    for (s = 0; s < count; s++)
+    {
+        void * seg = dictConsume((void **)ht->table + s);
+
+        if (seg)
+            bytes += segBytes >= DICT_HUGE_TABLE_MIN_BYTES ? z_huge_size(segBytes) : z_malloc_size(seg);
+    }
+
+    return bytes;
+}
+
+/**
+ * 统计一个哈希表的链长分布
+ *
+ * 只检查最多 DICT_STATS_SAMPLE_BUCKETS 个从随机位置开始的连续桶；
+ * rehash 时 0 号哈希表中 low 之前的桶已经迁移完，总是空的，不参与统计。
+ *
+ * T = O(1) ，最多检查 DICT_STATS_SAMPLE_BUCKETS 个桶
+ *
+ * @param d 字典
+ * @param table 哈希表的编号
+ * @param low 0 号哈希表中还没有迁移的第一个桶，对 1 号哈希表无意义
+ * @param hs 用于保存结果
+ */
+static void _dictGetHtStats(dict * d, int table, unsigned long low, dictHtStats * hs)
+{
+    dictht * ht = &d->ht[table];
+    unsigned long span, start, i;
+
+    hs->size = ht->size;
+    hs->used = ht->used;
+    hs->tableBytes = _dictTableBytes(d, ht);
+    if (ht->size == 0) return;
+
+    if (table != 0 || !dictIsRehashing(d)) low = 0;
+    span = ht->size - low;
+    hs->sampled = span < DICT_STATS_SAMPLE_BUCKETS ? span : DICT_STATS_SAMPLE_BUCKETS;
+    start = span > hs->sampled ? _dictRandomBelow(span) : 0;
+
+    for (i = 0; i < hs->sampled; i++)
+    {
+        unsigned long len = _dictBucketLen(d, ht, low + (start + i) % span);
+
+        hs->chains[len < DICT_STATS_CHAIN_SLOTS ? len : DICT_STATS_CHAIN_SLOTS - 1]++;
+        if (len) hs->nonEmpty++;
+        if (len > hs->maxChain) hs->maxChain = len;
+    }
+}
+
+/**
+ * 返回字典的统计信息：大小、负载、rehash 进度、链长分布和内存占用
+ *
+ * 内存占用是精确值，由添加和删除节点时维护的计数器得到；
+ * 链长分布只检查有限数量的桶，见 DICT_STATS_SAMPLE_BUCKETS 。
+ * 与 dictPrintStats() 不同，这个函数不输出任何内容，可以在服务器中定期调用。
+ *
+ * T = O(M) ，M 为段的数量，最多检查 2 * DICT_STATS_SAMPLE_BUCKETS 个桶
+ *
+ * @param d 字典
+ * @param stats 用于保存结果
+ */
+void dictGetStats(dict * d, dictStats * stats)
+{
+    dictRehashWorker * w;
+    dictht * target;
+    unsigned long rehashIndex, moved = 0;
+    int table;
+
+    memset(stats, 0, sizeof(*stats));
+
+    //访问桶期间暂停后台 rehash
+    _dictBgRehashPause(d);
+    w = d->worker;
+    //后台线程的进度在所属线程轮询之前只记录在线程中，暂停期间它不会变化
+    rehashIndex = d->rehashIndex;
+    if (w)
+    {
+        rehashIndex = __atomic_load_n(&w->cursor, __ATOMIC_ACQUIRE);
+        moved = __atomic_load_n(&w->moved, __ATOMIC_ACQUIRE);
+    }
+    for (table = 0; table <= 1; table++)
+        _dictGetHtStats(d, table, rehashIndex, &stats->ht[table]);
+    stats->ht[0].used -= moved;
+    stats->ht[1].used += moved;
+
+    stats->buckets = dictSlots(d);
+    stats->used = dictSize(d);
+    stats->rehashing = dictIsRehashing(d);
+    stats->rehashIndex = stats->rehashing ? (long)rehashIndex : -1;
+    stats->rehashProgress = stats->rehashing ? (double)rehashIndex / d->ht[0].size : 1.0;
+    target = stats->rehashing ? &d->ht[1] : &d->ht[0];
+    stats->loadFactor = target->size ? (double)stats->used / target->size : 0;
+    _dictBgRehashResume(w);
+
+    stats->tableBytes = stats->ht[0].tableBytes + stats->ht[1].tableBytes;
+    stats->entryBytes = dictUsesSlab(d) ? d->slab.numPages * DICT_SLAB_PAGE_SIZE : d->entryBytes;
+    stats->keyBytes = d->keyBytes;
+    stats->totalBytes = sizeof(dict) + stats->tableBytes + stats->entryBytes + stats->keyBytes;
+}
+
+/**
+ * 返回字典占用的总字节数，与 dictGetStats() 的 totalBytes 相同，但不统计链长
+ *
+ * T = O(M) ，M 为段的数量，即 N / 2^DICT_SEGMENT_SHIFT
+ *
+ * @param d 字典
+ * @return 字节数
+ */
+size_t dictMemoryUsage(dict * d)
+{
+    size_t bytes = sizeof(dict) + _dictTableBytes(d, &d->ht[0]) + _dictTableBytes(d, &d->ht[1]);
+
+    bytes += dictUsesSlab(d) ? d->slab.numPages * DICT_SLAB_PAGE_SIZE : d->entryBytes;
+
+    return bytes + d->keyBytes;
+}
+
+/**
+ * 设置字典内嵌键的长度上限，只影响之后添加的键
+ *
+ * 上限越大，能内嵌的键越多，但节点也越大，64 字节以内的键和节点头部一起大约占用两条缓存行
+ *
+ * T = O(1)
+ *
+ * @param d 使用 DICT_TYPE_EMBED_KEY 的字典
+ * @param max embedKeyLen 返回值的上限，为 0 时不再内嵌任何键（embedKeyLen 的返回值不能为 0）
+ */
+void dictSetEmbedKeyMax(dict * d, size_t max)
+{
+    assert(max <= UINT32_MAX);
+    d->embedKeyMax = max;
+}
+
+/**
+ * 以 C 字符串为键的字典的 embedKeyLen 函数：字符串连同结尾的 '\0' 一起内嵌
+ *
+ * T = O(N)
+ *
+ * @param key C 字符串
+ * @return 内嵌需要的字节数
+ */
+size_t dictCStringEmbedLen(const void * key)
+{
+    return strlen(key) + 1;
+}
+
+/**
+ * 以 C 字符串为键的字典的 embedKey 函数
+ *
+ * T = O(N)
+ *
+ * @param buf 节点末尾的缓冲区
+ * @param key C 字符串
+ * @return 内嵌后的字符串，就是 buf
+ */
+void * dictCStringEmbed(void * buf, const void * key)
+{
+    return memcpy(buf, key, strlen(key) + 1);
+}
+
 /**
  * 开启自动 rehash
  *
@@ -1371,7 +4564,7 @@ void dictEmpty(dict * d, void(callback)(void *))
  */
 void dictEnableResize(void)
 {
-    dict_can_resize = 1;
+    dictSetResizeState(NULL, DICT_RESIZE_ENABLE);
 }
 
 /**
@@ -1382,7 +4575,68 @@ void dictEnableResize(void)
  */
 void dictDisableResize(void)
 {
-    dict_can_resize = 0;
+    dictSetResizeState(NULL, DICT_RESIZE_AVOID);
+}
+
+/**
+ * 设置之后分配的桶数组的段（不小于 DICT_HUGE_TABLE_MIN_BYTES 字节时）使用的页
+ *
+ * 已经分配的段不受影响，之后新分配的段使用新的设置。
+ * DICT_HUGE_PAGES_OFF 时大的段同样通过 mmap 分配，但禁止透明大页，用于对比大页的效果。
+ *
+ * T = O(1)
+ *
+ * @param mode DICT_HUGE_PAGES_OFF 、DICT_HUGE_PAGES_MADVISE 或 DICT_HUGE_PAGES_HUGETLB
+ */
+void dictSetHugePages(int mode)
+{
+    dict_huge_pages = mode;
+}
+
+/**
+ * 为字典指定 resize 策略
+ *
+ * 策略由调用者持有，必须比使用它的字典活得更久，多个字典可以共享同一个策略。
+ * 为了避免反复扩展和收缩，要求 shrinkPercent 小于 targetPercent 的一半，
+ * 并且 targetPercent 小于 growPercent 。
+ *
+ * T = O(1)
+ *
+ * @param d 目标字典
+ * @param policy resize 策略，为 NULL 时恢复使用默认策略
+ * @return 设置成功返回 DICT_OK ，阈值之间没有足够的间隔时返回 DICT_ERR
+ */
+int dictSetResizePolicy(dict * d, dictResizePolicy * policy)
+{
+    if (policy == NULL)
+        policy = &dict_default_resize_policy;
+
+    if (policy->targetPercent == 0 || policy->targetPercent >= policy->growPercent ||
+        policy->shrinkPercent * 2 >= policy->targetPercent)
+        return DICT_ERR;
+
+    d->resizePolicy = policy;
+
+    return DICT_OK;
+}
+
+/**
+ * 修改策略的 resize 状态
+ *
+ * 创建子进程之前设置为 DICT_RESIZE_AVOID ，子进程退出之后恢复为 DICT_RESIZE_ENABLE 。
+ * 可以在任意线程中调用，使用该策略的字典在下一次添加或删除节点时看到新的状态。
+ *
+ * T = O(1)
+ *
+ * @param policy resize 策略，为 NULL 时修改默认策略
+ * @param state DICT_RESIZE_* 之一
+ */
+void dictSetResizeState(dictResizePolicy * policy, int state)
+{
+    if (policy == NULL)
+        policy = &dict_default_resize_policy;
+
+    __atomic_store_n(&policy->state, state, __ATOMIC_RELAXED);
 }
 
 #if 0
@@ -1447,7 +4701,7 @@ void dictPrintStats(dict *d) {
 
 /* ----------------------- StringCopy Hash Table Type ------------------------*/
 
-static unsigned int _dictStringCopyHTHashFunction(const void *key)
+static uint64_t _dictStringCopyHTHashFunction(const void *key)
 {
     return dictGenHashFunction(key, strlen(key));
 }
@@ -1508,4 +4762,4 @@ dictType dictTypeHeapStringCopyKeyValue = {
     _dictStringDestructor,         /* key destructor */
     _dictStringDestructor,         /* val destructor */
 };
-#endif
\ No newline at end of file
+#endif
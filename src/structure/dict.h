@@ -6,6 +6,9 @@
 #define REDIS_DESIGN_DICT_H
 
 #include <stdint.h>
+#include <stddef.h>
+
+#include "dictslab.h"
 
 //字典的操作状态
 #define DICT_OK 0   //操作成功
@@ -27,6 +30,53 @@
      struct dictEntry * next;   //指向下个哈希表节点，形成链表，解决了键冲突
  } dictEntry;
 
+/**
+ * 缓存了键的哈希值的哈希表节点，只在 DICT_TYPE_STORE_HASH 时使用
+ *
+ * entry 必须是第一个成员，这样它可以和 dictEntry 相互转换
+ */
+typedef struct dictEntryWithHash
+{
+    dictEntry entry;    //哈希表节点
+    uint64_t hash;      //键的完整哈希值
+} dictEntryWithHash;
+
+/**
+ * 分组哈希表中，每个桶（组）可以直接容纳的节点数量
+ *
+ * 8 字节的控制字节加上 7 个节点指针，一个组恰好占用一条 64 字节的缓存行
+ */
+#define DICT_GROUP_SLOTS 7
+
+//dictGroup.meta 中表示组内节点数量的掩码
+#define DICT_GROUP_COUNT_MASK 0x07
+//dictGroup.meta 中表示组后面还挂有溢出链表的标识
+#define DICT_GROUP_OVERFLOW 0x08
+
+/**
+ * 分组哈希表的桶（组）
+ *
+ * 借鉴 Swiss table 的控制字节：tags 保存组内每个节点哈希值的高 8 位，
+ * 查找时先用一条 SIMD 指令同时比对组内所有的 tag ，
+ * 只有 tag 命中的节点才需要解引用并比对键，
+ * 从而把每次探测的缓存未命中降到大约一次。
+ *
+ * entries[0 .. n-1] 总是该桶链表的前 n 个节点（节点之间仍然通过 next 串联），
+ * 超出组容量的节点挂在 entries[DICT_GROUP_SLOTS - 1]->next 之后，形成溢出链表。
+ * 因为桶的索引依然是 hash & sizeMask ，所以渐进式 rehash 和 dictScan 的语义不变。
+ */
+typedef struct dictGroup
+{
+    union {
+        struct {
+            uint8_t tags[DICT_GROUP_SLOTS]; //组内各节点的哈希标签
+            uint8_t meta;                   //组内节点数量以及溢出标识
+        };
+        uint64_t ctrl;                      //tags 和 meta 合成的控制字，可以被原子地整体读写
+    };
+    dictEntry * entries[DICT_GROUP_SLOTS];  //组内的节点
+} dictGroup;
+
 /**
  * 字典类型特定函数
  *
@@ -37,8 +87,10 @@
 */
 typedef struct dictType
 {
-    //计算哈希值的函数
-    unsigned int (*hashFunction)(const void * key);
+    //计算 64 位哈希值的函数
+    //可信的键使用 dictGenHashFunction （wyhash），
+    //来自不可信客户端的键使用 dictGenSafeHashFunction （SipHash-1-3）
+    uint64_t (*hashFunction)(const void * key);
     //复制键的函数
     void * (*keyDup)(void * privData, const void * key);
     //复制值的函数
@@ -49,21 +101,104 @@ typedef struct dictType
     void (*keyDestructor)(void * privData, void * key);
     //销毁值的函数
     void (*valDestructor)(void * privData, void * obj);
+    //字典的特性标识，见 DICT_TYPE_* 宏
+    int flags;
+    //返回将键内嵌到节点中需要的字节数，只在 DICT_TYPE_EMBED_KEY 时使用
+    size_t (*embedKeyLen)(const void * key);
+    //将键写入节点末尾的缓冲区 buf （大小为 embedKeyLen 的返回值），
+    //返回节点保存的键指针，它必须指向 buf 之内，只在 DICT_TYPE_EMBED_KEY 时使用
+    void * (*embedKey)(void * buf, const void * key);
+    //返回键在节点之外占用的字节数，用于 dictGetStats() 统计键的内存，为 NULL 时不统计
+    //键在字典中的期间，返回值不能改变
+    size_t (*keyBytes)(const void * key);
 } dictType;
 
+/**
+ * dictType 的特性标识
+ */
+//使用分组（控制字节 + SIMD 标签匹配）的哈希表引擎代替链式哈希表
+#define DICT_TYPE_GROUPED (1 << 0)
+//在节点中缓存键的哈希值，rehash 时不必重新计算，查找时先比对哈希值再比对键
+#define DICT_TYPE_STORE_HASH (1 << 1)
+//从字典自己的 slab 中分配节点，代替逐个 z_malloc / z_free
+#define DICT_TYPE_SLAB (1 << 2)
+//较短的键直接保存在变长节点的末尾，比对键时不必再访问另一块内存，不能和 DICT_TYPE_SLAB 同时使用
+#define DICT_TYPE_EMBED_KEY (1 << 3)
+
+/**
+ * 内嵌键的默认长度上限（embedKeyLen 的返回值），超过上限的键仍然通过 keyDup 单独保存
+ */
+#define DICT_EMBED_KEY_MAX 64
+
+/**
+ * 分组哈希表的平均负载因子
+ *
+ * 每个组可以容纳 DICT_GROUP_SLOTS 个节点，
+ * 所以分组哈希表在平均每个桶有 4 个节点时才进行扩展，溢出链表的出现概率约为 5%
+ */
+#define DICT_GROUP_LOAD_FACTOR 4
+
+/**
+ * 桶数组分段保存：链式哈希表每段最多 2^DICT_SEGMENT_SHIFT 个桶，
+ * 分组哈希表每段最多 2^DICT_GROUP_SEGMENT_SHIFT 个组，满的段都正好是 2 MiB ，即一个大页
+ */
+#define DICT_SEGMENT_SHIFT          18
+#define DICT_GROUP_SEGMENT_SHIFT    15
+
 /**
 * 哈希表结构的声明
  *
  * 每个字典包含了两个哈希表，从而实现了渐进式rehash
+ *
+ * 桶数组不是一整块连续的内存，而是由若干段组成，table 是段的目录。
+ * 扩展时只分配目录，段在第一次有节点写入时才分配；
+ * rehash 越过 0 号哈希表的一段之后立即释放这一段，
+ * 所以扩展不会一次性分配并清零两倍大小的数组，rehash 期间额外占用的内存也随进度增减。
+ * 没有分配的段中的桶都是空的。
 */
 typedef struct dictht
 {
-    dictEntry ** table;     //哈希表数组
+    union {
+        dictEntry *** table;    //哈希表数组的段目录
+        dictGroup ** groups;    //分组哈希表数组的段目录，只在 DICT_TYPE_GROUPED 时使用
+    };
     unsigned long size;     //哈希表大小
     unsigned long sizeMask; //哈希表大小的掩码，用于计算索引值,总是等于size-1
     unsigned long used;     //该哈希表已有节点的数量
 } dictht;
 
+/**
+ * 字典的 resize 状态
+ */
+#define DICT_RESIZE_ENABLE  0   //按阈值自动扩展和收缩
+#define DICT_RESIZE_AVOID   1   //有子进程正在保存（fork in progress），尽量避免 resize 以减少写时复制的页
+#define DICT_RESIZE_FORBID  2   //禁止 resize
+
+/**
+ * 字典的 resize 策略
+ *
+ * 所有百分比都相对于字典的容量（桶的数量乘以负载因子）。
+ * 扩展和收缩之后负载都落在 (targetPercent / 2, targetPercent] 之间，
+ * 只要 shrinkPercent 小于 targetPercent 的一半、targetPercent 小于 growPercent ，
+ * 刚 resize 完的字典就不会立即触发反方向的 resize ，从而避免反复扩展和收缩。
+ *
+ * 多个字典可以共享同一个策略，修改 state 即可同时推迟它们的 resize ，
+ * state 可能被其他线程修改，所以通过原子操作访问。
+ */
+typedef struct dictResizePolicy
+{
+    unsigned int growPercent;   //负载达到容量的这个百分比时扩展
+    unsigned int shrinkPercent; //负载低于容量的这个百分比时收缩，为 0 表示不自动收缩
+    unsigned int targetPercent; //resize 之后的目标负载百分比
+    unsigned int forceRatio;    //DICT_RESIZE_AVOID 状态下，负载超过容量的这个倍数时仍然扩展
+    int state;                  //DICT_RESIZE_* 之一
+} dictResizePolicy;
+
+/**
+ * 默认的 resize 策略：负载达到 100% 时扩展，低于 10% 时收缩，resize 到 50% 的负载
+ */
+#define DICT_RESIZE_POLICY_DEFAULT { 100, 10, 50, 5, DICT_RESIZE_ENABLE }
+
  /**
   * 字典结构的声明
   * ht包含两个哈希表，一般使用第一个，只有在对第二个进行rehash是才使用。
@@ -73,8 +208,22 @@ typedef struct dictht
      dictType * type;   //类型特定的操作函数
      void * privData;   //私有数据，保存了需要传递给类型特定函数的可选参数
      dictht ht[2];      //哈希表
-     int rehashIndex;   //rehash索引，当rehash不在进行时，值为-1
+     long rehashIndex;  //rehash索引，当rehash不在进行时，值为-1
      int iterators;     //目前正在运行的安全迭代器数量
+     int bgRehash;      //是否允许使用后台线程进行 rehash
+     struct dictRehashWorker * worker;  //正在进行 rehash 的后台线程，没有时为 NULL
+     int concurrent;    //是否允许其他线程通过 dictFindConcurrent() 无锁读取
+     unsigned long seq; //写序列号，修改哈希表结构期间为奇数，无锁读者借此发现并发修改
+     struct dictRetired * retired;  //等待读者退出后才能释放的节点、值和哈希表数组
+     unsigned long retiredCount;    //retired 链表的长度
+     dictSlab slab;     //节点的 slab 分配器，只在 DICT_TYPE_SLAB 时使用
+     size_t embedKeyMax;    //内嵌键的长度上限，只在 DICT_TYPE_EMBED_KEY 时使用
+     dictResizePolicy * resizePolicy;   //resize 策略，默认为全局策略
+     struct dictSnapshot * snapshot;    //正在进行的快照，没有时为 NULL
+     unsigned long sampleBlock; //随机取样时每块包含的桶的数量，为 0 表示还没有取样过
+     unsigned long sampleBound; //随机取样时每块节点数量的上界，遇到更多节点的块时提高
+     size_t entryBytes;  //字典中的节点占用的字节数，包括内嵌的键，不包括从 slab 分配的节点
+     size_t keyBytes;    //字典中的键在节点之外占用的字节数，由 type->keyBytes 计算
  } dict;
 
 /**
@@ -91,9 +240,10 @@ typedef struct dictIterator
     dict * d;   //被迭代的字典
 
     //table : 正在被迭代的哈希表号码，0或者1
-    //index : 迭代器目前所指向的哈希表索引位置
     //safe : 标识迭代器是否安全
-    int table, index, safe;
+    int table, safe;
+    //index : 迭代器目前所指向的哈希表索引位置
+    long index;
 
     // entry ：当前迭代到的节点的指针
     // nextEntry ：当前迭代节点的下一个节点
@@ -103,15 +253,152 @@ typedef struct dictIterator
     dictEntry * entry, * nextEntry;
 
     long long fingerprint;
+
+    //迭代期间被暂停的后台 rehash 线程
+    struct dictRehashWorker * pausedWorker;
 } dictIterator;
 
+/**
+ * 字典的快照迭代器，返回创建快照时字典中的所有键值对，见 dictSnapshotCreate()
+ */
+typedef struct dictSnapshot dictSnapshot;
+
 typedef void (dictScanFunction)(void * privData, const dictEntry * de);
 
+/**
+ * 链长直方图的项数，最后一项统计链长不小于 DICT_STATS_CHAIN_SLOTS - 1 的桶
+ */
+#define DICT_STATS_CHAIN_SLOTS 16
+
+/**
+ * dictGetStats() 统计链长时每个哈希表最多检查的桶的数量
+ *
+ * 较大的哈希表从随机位置开始检查连续的桶，结果是对整个哈希表的估计，
+ * 所以统计的耗时与字典的大小无关，可以在线上的字典上定期调用
+ */
+#define DICT_STATS_SAMPLE_BUCKETS 4096
+
+/**
+ * 一个哈希表的统计信息
+ */
+typedef struct dictHtStats
+{
+    unsigned long size;         //桶的数量
+    unsigned long used;         //节点的数量
+    unsigned long sampled;      //统计链长时检查的桶的数量，等于可能非空的桶的数量时以下各项是精确值
+    unsigned long nonEmpty;     //被检查的桶中非空的桶的数量
+    unsigned long maxChain;     //被检查的桶中最长的链的长度
+    unsigned long chains[DICT_STATS_CHAIN_SLOTS];   //被检查的桶中链长为 i 的桶的数量
+    size_t tableBytes;          //桶数组占用的字节数
+} dictHtStats;
+
+/**
+ * 字典的统计信息，见 dictGetStats()
+ */
+typedef struct dictStats
+{
+    unsigned long buckets;      //两个哈希表的桶的总数
+    unsigned long used;         //节点的总数
+    double loadFactor;          //节点总数除以 rehash 完成之后哈希表的桶的数量
+    int rehashing;              //是否正在 rehash
+    long rehashIndex;           //rehash 的进度，没有在 rehash 时为 -1
+    double rehashProgress;      //rehashIndex 占 0 号哈希表大小的比例，没有在 rehash 时为 1
+    dictHtStats ht[2];          //两个哈希表各自的统计信息
+    size_t tableBytes;          //桶数组占用的字节数
+    size_t entryBytes;          //节点占用的字节数，使用 slab 时为 slab 的页占用的字节数
+    size_t keyBytes;            //键在节点之外占用的字节数，dictType 没有 keyBytes 函数时为 0
+    size_t totalBytes;          //字典占用的总字节数，包括字典结构本身
+} dictStats;
+
 /**
  * 哈希表的初始大小
  */
 #define DICT_HT_INITIAL_SIZE    4
 
+/**
+ * 0 号哈希表的桶数量达到这个值时，允许后台 rehash 的字典才会使用后台线程进行 rehash
+ * 较小的哈希表用渐进式 rehash 很快就能完成，不值得创建线程
+ */
+#define DICT_BG_REHASH_MIN_SIZE (1UL << 16)
+
+/**
+ * 桶数组的一段达到这个字节数时不再通过 z_calloc() 分配，而是通过 z_calloc_huge() 映射到大页上，
+ * 见 dictSetHugePages() 。等于一个大页的大小，也就是满的段的大小，更小的段用不满一个大页
+ */
+#define DICT_HUGE_TABLE_MIN_BYTES (2UL * 1024 * 1024)
+
+/**
+ * 大的桶数组使用的页，取值与 zmalloc.h 的 Z_HUGE_* 相同
+ */
+#define DICT_HUGE_PAGES_OFF     0   //普通页
+#define DICT_HUGE_PAGES_MADVISE 1   //透明大页（默认）
+#define DICT_HUGE_PAGES_HUGETLB 2   //hugetlbfs 预留的大页，不够时退回透明大页
+
+/**
+ * 后台 rehash 期间用于协调两个线程的分段锁的数量
+ */
+#define DICT_BG_REHASH_STRIPES  1024
+
+/**
+ * 后台 rehash 线程每次持有暂停锁时迁移的桶的数量
+ */
+#define DICT_BG_REHASH_BATCH    64
+
+/**
+ * dictFindMany() 每一批同时计算哈希值并预取的键的数量
+ */
+#define DICT_FIND_MANY_BATCH    16
+
+/**
+ * 随机取样时每块最多包含的桶的数量，限制了极其稀疏的哈希表上每次尝试的开销
+ */
+#define DICT_SAMPLE_MAX_BLOCK   256
+
+/**
+ * dictScanParallel() 的线程每次领取的连续游标的数量
+ */
+#define DICT_SCAN_PARALLEL_CHUNK        1024
+
+/**
+ * dictScanParallel() 可以使用的线程数量上限
+ */
+#define DICT_SCAN_PARALLEL_MAX_THREADS  64
+
+/**
+ * dictBulkLoad() 的每个线程至少计算哈希值的键的数量，键较少时使用较少的线程
+ */
+#define DICT_BULK_LOAD_KEYS_PER_THREAD  65536
+
+/**
+ * dictBulkLoad() 可以使用的线程数量上限
+ */
+#define DICT_BULK_LOAD_MAX_THREADS      16
+
+/**
+ * dictBulkLoad() 按桶的索引划分键时，分区数量的 log2 上限
+ */
+#define DICT_BULK_LOAD_PARTITION_BITS   12
+
+/**
+ * dictBulkLoad() 插入时提前预取的键的数量
+ */
+#define DICT_BULK_LOAD_PREFETCH         8
+
+/**
+ * dictBulkLoad() 的标识：调用者保证键互不相同并且都不在字典中，跳过重复检查
+ */
+#define DICT_BULK_ASSUME_UNIQUE (1 << 0)
+
+/**
+ * 可以同时处于 dictReadBegin() 读区间中的线程数量上限
+ */
+#define DICT_EPOCH_MAX_THREADS  256
+
+/**
+ * 无锁读模式下，等待释放的对象积累到这个数量时，写线程尝试回收一次
+ */
+#define DICT_RETIRE_BATCH       64
+
 /* ------------------------------- Macros ------------------------------------*/
 // 释放给定字典节点的值
 #define dictFreeVal(d, entry) \
@@ -134,9 +421,9 @@ typedef void (dictScanFunction)(void * privData, const dictEntry * de);
 #define dictSetUnsignedIntegerVal(entry, _val_) \
     do { entry->v.u64 = _val_; } while(0)
 
-// 释放给定字典节点的键
+// 释放给定字典节点的键，内嵌的键随节点一起释放
 #define dictFreeKey(d, entry) \
-    if ((d)->type->keyDestructor) \
+    if ((d)->type->keyDestructor && !dictKeyIsEmbedded(d, entry)) \
         (d)->type->keyDestructor((d)->privData, (entry)->key)
 
 // 设置给定字典节点的键
@@ -159,6 +446,8 @@ typedef void (dictScanFunction)(void * privData, const dictEntry * de);
 #define dictGetKey(he) ((he)->key)
 // 返回获取给定节点的值
 #define dictGetVal(he) ((he)->v.val)
+// 无锁读者读取给定节点的值，与 dictReplace() 对值的替换同步
+#define dictGetValConcurrent(he) __atomic_load_n(&(he)->v.val, __ATOMIC_ACQUIRE)
 // 返回获取给定节点的有符号整数值
 #define dictGetSignedIntegerVal(he) ((he)->v.s64)
 // 返回给定节点的无符号整数值
@@ -169,37 +458,92 @@ typedef void (dictScanFunction)(void * privData, const dictEntry * de);
 #define dictSize(d) ((d)->ht[0].used+(d)->ht[1].used)
 // 查看字典是否正在 rehash
 #define dictIsRehashing(ht) ((ht)->rehashIndex != -1)
+// 查看字典是否使用分组哈希表引擎
+#define dictIsGrouped(d) ((d)->type->flags & DICT_TYPE_GROUPED)
+// 查看字典的节点是否缓存了哈希值
+#define dictStoresHash(d) ((d)->type->flags & DICT_TYPE_STORE_HASH)
+// 查看字典的节点是否从 slab 中分配
+#define dictUsesSlab(d) ((d)->type->flags & DICT_TYPE_SLAB)
+// 查看字典是否把较短的键内嵌在节点中
+#define dictEmbedsKeys(d) ((d)->type->flags & DICT_TYPE_EMBED_KEY)
+// 返回节点中键值以及缓存的哈希值部分的大小
+#define dictEntryHeaderSize(d) (dictStoresHash(d) ? sizeof(dictEntryWithHash) : sizeof(dictEntry))
+// 返回 DICT_TYPE_EMBED_KEY 字典的节点中内嵌键的长度，为 0 表示键没有内嵌
+// 长度保存在节点头部之后的 8 个字节中，内嵌的键从长度之后开始
+#define dictEntryEmbedLen(d, he) (*(uint32_t *)((char *)(he) + dictEntryHeaderSize(d)))
+// 查看节点的键是否内嵌在节点中
+#define dictKeyIsEmbedded(d, he) (dictEmbedsKeys(d) && dictEntryEmbedLen(d, he) != 0)
+// 返回节点中缓存的哈希值，只能用于 DICT_TYPE_STORE_HASH 的字典
+#define dictGetEntryHash(he) (((dictEntryWithHash *)(he))->hash)
 
 /* API */
 dict * dictCreate(dictType * type, void * privDataPtr);
 int dictExpand(dict * d, unsigned long size);
 int dictAdd(dict * d, void * key, void * val);
 dictEntry * dictAddRaw(dict * d, void * key);
+dictEntry * dictAddRawWithHash(dict * d, void * key, uint64_t hash);
 int dictReplace(dict * d, void * key, void * val);
 dictEntry * dictReplaceRaw(dict * d, void * key);
+dictEntry * dictAddOrFind(dict * d, void * key, int * existed);
+dictEntry * dictAddOrFindWithHash(dict * d, void * key, uint64_t hash, int * existed);
+unsigned long dictBulkLoad(dict * d, void ** keys, void ** vals, unsigned long n, int flags, dictEntry ** out);
 int dictDelete(dict * d, const void * key);
 int dictDeleteNoFree(dict * d, const void * key);
+dictEntry * dictUnlinkFind(dict * d, const void * key);
+void dictFreeUnlinked(dict * d, dictEntry * he);
 void dictRelease(dict * d);
 dictEntry * dictFind(dict * d, const void * key);
+dictEntry * dictFindWithHash(dict * d, const void * key, uint64_t hash);
+dictEntry * dictPeekWithHash(dict * d, const void * key, uint64_t hash);
+unsigned long dictFindMany(dict * d, const void ** keys, unsigned long n, dictEntry ** out);
 void * dictFetchValue(dict * d, const void * key);
 int dictResize(dict * d);
 dictIterator * dictGetIterator(dict * d);
 dictIterator * dictGetSafeIterator(dict * d);
 dictEntry * dictNext(dictIterator * iter);
 void dictReleaseIterator(dictIterator * iter);
+dictSnapshot * dictSnapshotCreate(dict * d);
+dictEntry * dictSnapshotNext(dictSnapshot * s);
+void dictSnapshotRelease(dictSnapshot * s);
 dictEntry * dictGetRandomKey(dict * d);
 int dictGetRandomKeys(dict * d, dictEntry ** des, int count);
+unsigned long dictSampleKeys(dict * d, dictEntry ** out, unsigned long n);
 void dictPrintStats(dict * d);
-unsigned int dictGenHashFunction(const void * key, int len);
-unsigned int dictGenCaseHashFunction(const unsigned char * buf, int len);
+void dictGetSlabStats(dict * d, dictSlabStats * stats);
+void dictGetStats(dict * d, dictStats * stats);
+size_t dictMemoryUsage(dict * d);
+void dictSetEmbedKeyMax(dict * d, size_t max);
+size_t dictCStringEmbedLen(const void * key);
+void * dictCStringEmbed(void * buf, const void * key);
+uint64_t dictGenHashFunction(const void * key, size_t len);
+uint64_t dictGenCaseHashFunction(const unsigned char * buf, size_t len);
+uint64_t dictGenSafeHashFunction(const void * key, size_t len);
+uint64_t dictGenSafeCaseHashFunction(const unsigned char * buf, size_t len);
 void dictEmpty(dict * d, void(callback)(void *));
 void dictEnableResize(void);
 void dictDisableResize(void);
+void dictSetHugePages(int mode);
+int dictSetResizePolicy(dict * d, dictResizePolicy * policy);
+void dictSetResizeState(dictResizePolicy * policy, int state);
+unsigned long dictResizeGrowTarget(dictResizePolicy * policy, unsigned long capacity, unsigned long used);
+unsigned long dictResizeShrinkTarget(dictResizePolicy * policy, unsigned long capacity, unsigned long used);
+unsigned long dictNextPower(unsigned long size);
 int dictRehash(dict * d, int n);
 int dictRehashMilliseconds(dict * d, int ms);
-void dictSetHashFunctionSeed(unsigned int initVal);
-unsigned int dictGetHashFunctionSeed(void);
+long long timeInMilliseconds(void);
+void dictEnableBackgroundRehash(dict * d);
+void dictDisableBackgroundRehash(dict * d);
+void dictEnableConcurrentReads(dict * d);
+void dictDisableConcurrentReads(dict * d);
+void dictReadBegin(void);
+void dictReadEnd(void);
+dictEntry * dictFindConcurrent(dict * d, const void * key);
+void * dictFetchValueConcurrent(dict * d, const void * key);
+void dictSetHashFunctionSeed(uint8_t * seed);
+uint8_t * dictGetHashFunctionSeed(void);
 unsigned long dictScan(dict * d, unsigned long v, dictScanFunction * fn, void * privData);
+unsigned long dictScanCursorNext(unsigned long v, unsigned long m0);
+void dictScanParallel(dict * d, int threads, dictScanFunction * fn, void * privData);
 
 /* Hash table types */
 extern dictType dictTypeHeapStringCopyKey;
@@ -0,0 +1,1135 @@
+//
+// Created by Administrator on 2022/3/4.
+//
+
+#ifdef DICT_BENCHMARK_MAIN
+/* 字典的基准测试套件
+ *
+ * gcc -O2 -DDICT_BENCHMARK_MAIN -I../other dictbench.c dict.c dicthash.c dictslab.c dictmapped.c sds.c ../other/zmalloc.c -lpthread -lm
+ * ./a.out [最大的表大小] [bg_rehash 组的目标桶数量的 log2] > result.json
+ *
+ * 表大小从 1e3 开始按 10 倍递增到给定的最大值（默认 1e6 ，最大 1e8 ，1e8 个 sds 键需要几十 GB 内存），
+ * 每个大小分别测试整数键、短 sds 键（约 20 字节）和长 sds 键（约 128 字节）：
+ *
+ *     ops 组：add 、find（命中，均匀分布和 Zipf 分布）、miss 、replace（两种分布）、delete ，
+ *             以及 rehash 进行中的命中查找 find_rehashing ，它与 find 之差就是每次操作附带的单步 rehash 的开销；
+ *             整数键还有开启后台 rehash 时的 add_bg
+ *     rehash 组：rehash_step 为逐次调用 dictRehash(d, 1) ，即 _dictRehashStep() 所做的全部工作，
+ *               rehash_bulk 为每次 dictRehash(d, 100) ，两者都迁移全部节点
+ *     scan 组：dictScanParallel() 在不同线程数量下的耗时
+ *     define 组：DICT_DEFINE() 生成的字典与通用字典的对比
+ *     huge 组：桶数组使用普通页和透明大页时的命中查找，附带每次查找的 dTLB 读缺失数
+ *             （perf_event_open ，没有权限时为 -1）和进程中透明大页的总量
+ *     save 组：逐个 dictAdd() 重建字典与 dictSave() 、dictLoadMapped() 以及映射之后查找的对比
+ *     bg_rehash 组：哈希表扩展到 2^27 个桶（默认，可以由第二个参数修改，0 表示跳过）的 rehash 期间，
+ *               整数键的随机命中查找的延迟，分别关闭和开启后台 rehash ，以及扩展之前同一个表上的查找作为基准。
+ *               2^27 个桶需要大约 5 GB 内存
+ *     bulk 组：逐个 dictAdd() 与 dictBulkLoad()（检查重复和 DICT_BULK_ASSUME_UNIQUE）装入空字典的对比
+ *
+ * 结果以 JSON 输出到标准输出，进度输出到标准错误。每个结果包含总耗时算出的吞吐量，
+ * 以及按固定间隔抽样单次操作得到的 p50 / p99 / p999 延迟（已经减去计时本身的开销）。
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "dict.h"
+#include "dictmapped.h"
+#include "dictdefine.h"
+#include "sds.h"
+#include "zmalloc.h"
+#include "redisassert.h"
+
+/**
+ * 每种操作至少执行的次数，较小的表重复多轮
+ */
+#define BENCH_MIN_OPS (1UL << 20)
+
+/**
+ * 每种操作最多抽样这么多次单次操作的延迟
+ */
+#define BENCH_LATENCY_SAMPLES (1UL << 18)
+
+/**
+ * 预先生成的访问序列的长度，更多的操作循环使用
+ */
+#define BENCH_TRACE_LEN (1UL << 22)
+
+/**
+ * Zipf 分布的指数
+ */
+#define BENCH_ZIPF_THETA 0.99
+
+#define BENCH_KEY_INT   0
+#define BENCH_KEY_SHORT 1
+#define BENCH_KEY_LONG  2
+
+#define BENCH_DIST_UNIFORM  0
+#define BENCH_DIST_ZIPF     1
+
+static const char * bench_key_names[] = { "int", "short_sds", "long_sds" };
+static const char * bench_dist_names[] = { "uniform", "zipf" };
+
+void _redisAssert(char * estr, char * file, int line)
+{
+    fprintf(stderr, "=== ASSERTION FAILED ===\n==> %s:%d '%s' is not true\n", file, line, estr);
+}
+
+/**
+ * sds.c 使用安全函数库的 memcpy_s ，glibc 没有提供，独立构建基准测试时在这里补上
+ */
+int memcpy_s(void * dest, size_t destMax, const void * src, size_t count)
+{
+    if (count > destMax) return -1;
+    memmove(dest, src, count);
+    return 0;
+}
+
+/* ------------------------------- 计时和统计 --------------------------------*/
+
+static long long benchNs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((long long)ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+//一次 benchNs() 的耗时，从抽样的延迟中减去
+static long long bench_timer_overhead;
+
+/**
+ * 单次操作延迟的抽样
+ */
+typedef struct benchLatency
+{
+    long long * samples;
+    unsigned long count;
+    unsigned long stride;   //每隔 stride 次操作抽样一次
+} benchLatency;
+
+static void benchLatencyInit(benchLatency * lat, unsigned long ops)
+{
+    lat->samples = z_malloc(sizeof(long long) * BENCH_LATENCY_SAMPLES);
+    lat->count = 0;
+    lat->stride = ops / BENCH_LATENCY_SAMPLES + 1;
+}
+
+static inline void benchLatencyAdd(benchLatency * lat, long long ns)
+{
+    ns -= bench_timer_overhead;
+    if (lat->count < BENCH_LATENCY_SAMPLES)
+        lat->samples[lat->count++] = ns > 0 ? ns : 0;
+}
+
+static int benchCompareLongLong(const void * a, const void * b)
+{
+    long long x = *(const long long *)a, y = *(const long long *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static long long benchPercentile(benchLatency * lat, double p)
+{
+    unsigned long idx;
+
+    if (lat->count == 0) return 0;
+    idx = (unsigned long)(p * (lat->count - 1) + 0.5);
+    return lat->samples[idx];
+}
+
+/**
+ * 测量计时本身的开销，取多次测量的中位数
+ */
+static void benchCalibrate(void)
+{
+    benchLatency lat;
+    unsigned long i;
+
+    benchLatencyInit(&lat, 0);
+    for (i = 0; i < 100000; i++)
+    {
+        long long t = benchNs();
+
+        benchLatencyAdd(&lat, benchNs() - t);
+    }
+    qsort(lat.samples, lat.count, sizeof(long long), benchCompareLongLong);
+    bench_timer_overhead = benchPercentile(&lat, 0.5);
+    z_free(lat.samples);
+}
+
+/**
+ * 执行 count 次 expr ，每隔 lat->stride 次单独计时一次，total 累加总耗时
+ */
+#define BENCH_LOOP(lat, count, total, expr)                                     \
+    do {                                                                        \
+        unsigned long _n = (count), _s = (lat)->stride, _k = 0;                 \
+        long long _start = benchNs();                                           \
+        for (i = 0; i < _n; i++)                                                \
+        {                                                                       \
+            if (++_k == _s)                                                     \
+            {                                                                   \
+                long long _t = benchNs();                                       \
+                expr;                                                           \
+                benchLatencyAdd((lat), benchNs() - _t);                         \
+                _k = 0;                                                         \
+            }                                                                   \
+            else                                                                \
+            {                                                                   \
+                expr;                                                           \
+            }                                                                   \
+        }                                                                       \
+        (total) += benchNs() - _start;                                          \
+    } while (0)
+
+/* --------------------------------- JSON 输出 --------------------------------*/
+
+static int bench_results;
+
+/**
+ * 输出一个结果，extra 是追加在对象末尾的其他字段，可以为 NULL
+ */
+static void benchEmit(const char * group, unsigned long size, const char * keys, const char * dist,
+                      const char * op, unsigned long ops, long long totalNs, benchLatency * lat,
+                      const char * extra)
+{
+    if (lat)
+        qsort(lat->samples, lat->count, sizeof(long long), benchCompareLongLong);
+
+    printf("%s    {\"group\": \"%s\", \"size\": %lu, \"keys\": \"%s\", \"dist\": \"%s\", \"op\": \"%s\", "
+           "\"ops\": %lu, \"total_ms\": %.3f, \"ns_per_op\": %.2f, \"mops\": %.3f",
+           bench_results++ ? ",\n" : "", group, size, keys, dist, op,
+           ops, totalNs / 1e6, (double)totalNs / ops, ops * 1e3 / totalNs);
+    if (lat)
+        printf(", \"p50_ns\": %lld, \"p99_ns\": %lld, \"p999_ns\": %lld, \"max_ns\": %lld",
+               benchPercentile(lat, 0.5), benchPercentile(lat, 0.99), benchPercentile(lat, 0.999),
+               lat->count ? lat->samples[lat->count - 1] : 0);
+    if (extra)
+        printf(", %s", extra);
+    printf("}");
+    fflush(stdout);
+
+    fprintf(stderr, "  %-6s %-9s %-8s %-14s %9.1f ns/op", group, keys, dist, op, (double)totalNs / ops);
+    if (lat)
+        fprintf(stderr, "  p99 %lld ns", benchPercentile(lat, 0.99));
+    if (extra)
+        fprintf(stderr, "  %s", extra);
+    fprintf(stderr, "\n");
+}
+
+/* --------------------------------- 键和分布 ---------------------------------*/
+
+static uint64_t benchRandom(uint64_t * state)
+{
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+/**
+ * 第 i 个整数键，不同的 i 得到不同的键（splitmix64 的混合函数是双射）
+ */
+static inline uint64_t benchIntKey(uint64_t i)
+{
+    uint64_t state = i;
+
+    return benchRandom(&state);
+}
+
+/**
+ * 第 i 个 sds 键，长键用一个较长的公共前缀补齐
+ */
+static sds benchSdsKey(int kind, uint64_t i)
+{
+    char buf[160];
+    int len;
+
+    if (kind == BENCH_KEY_SHORT)
+        len = snprintf(buf, sizeof(buf), "key:%016llx", (unsigned long long)benchIntKey(i));
+    else
+        len = snprintf(buf, sizeof(buf), "user:session:%0104llu:%08llx",
+                       (unsigned long long)i, (unsigned long long)(benchIntKey(i) & 0xffffffff));
+
+    return sds_new_len(buf, len);
+}
+
+/**
+ * 一组测试键：编号 [0, n) 的键添加到字典中，编号 [n, 2n) 的键用于未命中的查找
+ *
+ * 整数键直接由编号算出；sds 键预先生成，作为查找时的参数，添加时由字典复制一份
+ */
+typedef struct benchKeys
+{
+    int kind;
+    unsigned long n;
+    sds * sdsKeys;
+} benchKeys;
+
+static void benchKeysInit(benchKeys * ks, int kind, unsigned long n)
+{
+    unsigned long i;
+
+    ks->kind = kind;
+    ks->n = n;
+    ks->sdsKeys = NULL;
+    if (kind == BENCH_KEY_INT) return;
+
+    ks->sdsKeys = z_malloc(sizeof(sds) * n * 2);
+    for (i = 0; i < n * 2; i++)
+        ks->sdsKeys[i] = benchSdsKey(kind, i);
+}
+
+static void benchKeysRelease(benchKeys * ks)
+{
+    unsigned long i;
+
+    if (ks->sdsKeys == NULL) return;
+    for (i = 0; i < ks->n * 2; i++)
+        sds_free(ks->sdsKeys[i]);
+    z_free(ks->sdsKeys);
+}
+
+static inline void * benchKey(benchKeys * ks, unsigned long i)
+{
+    if (ks->kind == BENCH_KEY_INT)
+        return (void *)benchIntKey(i);
+    return ks->sdsKeys[i];
+}
+
+/**
+ * 把 [0, n) 打乱成另一个顺序：2654435761 是素数，与小于它的 n 互素，所以这是一个排列
+ */
+static inline unsigned long benchPermute(unsigned long i, unsigned long n)
+{
+    return (unsigned long)(((unsigned __int128)i * 2654435761u) % n);
+}
+
+/**
+ * 生成长度为 len 的访问序列，元素为 [0, n) 之间的键编号
+ *
+ * Zipf 分布使用 Gray 等人的方法（YCSB 的 ZipfianGenerator），只需要 O(n) 的预计算而不需要 CDF 数组，
+ * 排名再经过 benchPermute() 打散，使热点键不集中在编号相邻的键上
+ */
+static unsigned int * benchTrace(int dist, unsigned long n, unsigned long len, uint64_t seed)
+{
+    unsigned int * trace = z_malloc(sizeof(unsigned int) * len);
+    double theta = BENCH_ZIPF_THETA, zetan = 0, zeta2, alpha, eta;
+    uint64_t state = seed;
+    unsigned long i;
+
+    if (dist == BENCH_DIST_UNIFORM)
+    {
+        for (i = 0; i < len; i++)
+            trace[i] = (unsigned int)(benchRandom(&state) % n);
+        return trace;
+    }
+
+    for (i = 1; i <= n; i++)
+        zetan += 1.0 / pow((double)i, theta);
+    zeta2 = 1.0 + 1.0 / pow(2.0, theta);
+    alpha = 1.0 / (1.0 - theta);
+    eta = (1.0 - pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / zetan);
+
+    for (i = 0; i < len; i++)
+    {
+        double u = (benchRandom(&state) >> 11) * (1.0 / 9007199254740992.0);
+        double uz = u * zetan;
+        unsigned long rank;
+
+        if (uz < 1.0)
+            rank = 0;
+        else if (uz < zeta2)
+            rank = 1;
+        else
+            rank = (unsigned long)(n * pow(eta * u - eta + 1.0, alpha));
+        if (rank >= n) rank = n - 1;
+        trace[i] = (unsigned int)benchPermute(rank, n);
+    }
+
+    return trace;
+}
+
+/* --------------------------------- 字典类型 ---------------------------------*/
+
+static uint64_t benchHashInt(const void * key)
+{
+    return dictGenHashFunction(&key, sizeof(key));
+}
+
+static uint64_t benchSdsHash(const void * key)
+{
+    return dictGenHashFunction(key, sds_len((sds)key));
+}
+
+static int benchSdsCompare(void * privData, const void * key1, const void * key2)
+{
+    DICT_NOT_USED(privData);
+    return sds_len((sds)key1) == sds_len((sds)key2) && memcmp(key1, key2, sds_len((sds)key1)) == 0;
+}
+
+static void * benchSdsDup(void * privData, const void * key)
+{
+    DICT_NOT_USED(privData);
+    return sds_dup((sds)key);
+}
+
+static void benchSdsDestructor(void * privData, void * key)
+{
+    DICT_NOT_USED(privData);
+    sds_free(key);
+}
+
+//整数键，值为整数
+static dictType benchIntType = {
+    benchHashInt,           /* hash function */
+    NULL,                   /* key dup */
+    NULL,                   /* val dup */
+    NULL,                   /* key compare */
+    NULL,                   /* key destructor */
+    NULL,                   /* val destructor */
+    0,                      /* flags */
+    NULL,                   /* embed key len */
+    NULL,                   /* embed key */
+    NULL                    /* key bytes */
+};
+
+//sds 键，添加时复制键，和服务器为每个新键创建 sds 一样
+static dictType benchSdsType = {
+    benchSdsHash,           /* hash function */
+    benchSdsDup,            /* key dup */
+    NULL,                   /* val dup */
+    benchSdsCompare,        /* key compare */
+    benchSdsDestructor,     /* key destructor */
+    NULL,                   /* val destructor */
+    0,                      /* flags */
+    NULL,                   /* embed key len */
+    NULL,                   /* embed key */
+    NULL                    /* key bytes */
+};
+
+/* --------------------------------- ops / rehash ------------------------------*/
+
+/**
+ * 测试一个表大小和一种键的全部操作
+ */
+static void benchOps(benchKeys * ks)
+{
+    unsigned long n = ks->n, ops = n > BENCH_MIN_OPS ? n : BENCH_MIN_OPS;
+    unsigned long rounds = (BENCH_MIN_OPS + n - 1) / n, round, i, found = 0;
+    unsigned long traceMask = BENCH_TRACE_LEN - 1;
+    dictType * type = ks->kind == BENCH_KEY_INT ? &benchIntType : &benchSdsType;
+    const char * keys = bench_key_names[ks->kind];
+    unsigned int * trace;
+    long long addNs = 0, delNs = 0, total;
+    benchLatency addLat, delLat, lat;
+    dict * d = NULL;
+    int dist;
+
+    //add 和 delete：较小的表重复多轮，最后一轮的字典留给其他测试
+    benchLatencyInit(&addLat, n * rounds);
+    benchLatencyInit(&delLat, n * rounds);
+    for (round = 0; round < rounds; round++)
+    {
+        d = dictCreate(type, NULL);
+        BENCH_LOOP(&addLat, n, addNs, dictAdd(d, benchKey(ks, benchPermute(i, n)), NULL));
+        assert(dictSize(d) == n);
+        if (round + 1 == rounds) break;
+
+        BENCH_LOOP(&delLat, n, delNs, dictDelete(d, benchKey(ks, benchPermute(i, n))));
+        dictRelease(d);
+    }
+    benchEmit("ops", n, keys, "uniform", "add", n * rounds, addNs, &addLat, NULL);
+
+    //命中查找和替换，按两种分布访问
+    for (dist = BENCH_DIST_UNIFORM; dist <= BENCH_DIST_ZIPF; dist++)
+    {
+        trace = benchTrace(dist, n, ops < BENCH_TRACE_LEN ? ops : BENCH_TRACE_LEN, 42 + dist);
+        if (ops < BENCH_TRACE_LEN) traceMask = ~0UL;
+
+        benchLatencyInit(&lat, ops);
+        total = 0;
+        BENCH_LOOP(&lat, ops, total, found += dictFind(d, benchKey(ks, trace[i & traceMask])) != NULL);
+        benchEmit("ops", n, keys, bench_dist_names[dist], "find", ops, total, &lat, NULL);
+        z_free(lat.samples);
+
+        benchLatencyInit(&lat, ops);
+        total = 0;
+        BENCH_LOOP(&lat, ops, total, dictReplace(d, benchKey(ks, trace[i & traceMask]), (void *)i));
+        benchEmit("ops", n, keys, bench_dist_names[dist], "replace", ops, total, &lat, NULL);
+        z_free(lat.samples);
+
+        z_free(trace);
+        traceMask = BENCH_TRACE_LEN - 1;
+    }
+    assert(found == ops * 2);
+    assert(dictSize(d) == n);
+
+    //未命中的查找
+    benchLatencyInit(&lat, ops);
+    total = 0;
+    BENCH_LOOP(&lat, ops, total, found += dictFind(d, benchKey(ks, n + i % n)) != NULL);
+    benchEmit("ops", n, keys, "uniform", "miss", ops, total, &lat, NULL);
+    z_free(lat.samples);
+    assert(found == ops * 2);
+
+    //rehash 进行中的命中查找：每次查找先执行一次单步 rehash ，在 rehash 完成之前停止
+    while (dictRehash(d, 1000));
+    dictExpand(d, n * 2);
+    if (dictIsRehashing(d))
+    {
+        unsigned long steps = d->ht[0].size / 2;
+        uint64_t state = 7;
+
+        benchLatencyInit(&lat, steps);
+        total = 0;
+        BENCH_LOOP(&lat, steps, total, found += dictFind(d, benchKey(ks, benchRandom(&state) % n)) != NULL);
+        benchEmit("ops", n, keys, "uniform", "find_rehashing", steps, total, &lat, NULL);
+        z_free(lat.samples);
+    }
+    while (dictRehash(d, 1000));
+
+    //单步 rehash ：与 _dictRehashStep() 相同，每次调用迁移一个非空桶
+    dictExpand(d, n * 2);
+    if (dictIsRehashing(d))
+    {
+        unsigned long buckets = d->ht[0].size, calls = 0;
+        long long start = benchNs();
+        char extra[128];
+
+        benchLatencyInit(&lat, buckets);
+        while (1)
+        {
+            long long t;
+            int more;
+
+            if (calls++ % lat.stride == 0)
+            {
+                t = benchNs();
+                more = dictRehash(d, 1);
+                benchLatencyAdd(&lat, benchNs() - t);
+            }
+            else
+            {
+                more = dictRehash(d, 1);
+            }
+            if (!more) break;
+        }
+        total = benchNs() - start;
+        snprintf(extra, sizeof(extra), "\"entries\": %lu, \"buckets\": %lu, \"ns_per_entry\": %.2f",
+                 n, buckets, (double)total / n);
+        benchEmit("rehash", n, keys, "uniform", "rehash_step", calls, total, &lat, extra);
+        z_free(lat.samples);
+    }
+
+    //批量 rehash ：收缩回最小的哈希表，每次调用迁移 100 个非空桶
+    if (dictResize(d) == DICT_OK && dictIsRehashing(d))
+    {
+        unsigned long buckets = d->ht[0].size, calls = 0;
+        long long start = benchNs();
+        char extra[128];
+
+        benchLatencyInit(&lat, buckets / 100);
+        while (1)
+        {
+            long long t = benchNs();
+            int more = dictRehash(d, 100);
+
+            benchLatencyAdd(&lat, benchNs() - t);
+            calls++;
+            if (!more) break;
+        }
+        total = benchNs() - start;
+        snprintf(extra, sizeof(extra), "\"entries\": %lu, \"buckets\": %lu, \"ns_per_entry\": %.2f",
+                 n, buckets, (double)total / n);
+        benchEmit("rehash", n, keys, "uniform", "rehash_bulk", calls, total, &lat, extra);
+        z_free(lat.samples);
+    }
+
+    //删除全部键，删除期间字典逐渐收缩
+    BENCH_LOOP(&delLat, n, delNs, dictDelete(d, benchKey(ks, benchPermute(i, n))));
+    assert(dictSize(d) == 0);
+    dictRelease(d);
+    benchEmit("ops", n, keys, "uniform", "delete", n * rounds, delNs, &delLat, NULL);
+
+    //后台 rehash ：大的哈希表由后台线程迁移，添加操作的尾延迟应该比 add 低
+    if (ks->kind == BENCH_KEY_INT && n >= DICT_BG_REHASH_MIN_SIZE)
+    {
+        d = dictCreate(type, NULL);
+        dictEnableBackgroundRehash(d);
+        benchLatencyInit(&lat, n);
+        total = 0;
+        BENCH_LOOP(&lat, n, total, dictAdd(d, benchKey(ks, benchPermute(i, n)), NULL));
+        benchEmit("ops", n, keys, "uniform", "add_bg", n, total, &lat, NULL);
+        z_free(lat.samples);
+        dictRelease(d);
+    }
+
+    z_free(addLat.samples);
+    z_free(delLat.samples);
+}
+
+/* ------------------------------ dictScanParallel ---------------------------*/
+
+/**
+ * 扫描线程的统计，每个线程一条缓存行
+ */
+typedef struct benchScanSlot
+{
+    unsigned long entries;
+    uint64_t checksum;
+} __attribute__((aligned(64))) benchScanSlot;
+
+static benchScanSlot bench_scan_slots[DICT_SCAN_PARALLEL_MAX_THREADS];
+static int bench_scan_run, bench_scan_next;
+static __thread benchScanSlot * bench_scan_slot;
+static __thread int bench_scan_slot_run = -1;
+
+/**
+ * 模拟过期扫描之类的任务：检查每个节点的键和值
+ */
+static void benchScanCallback(void * privData, const dictEntry * de)
+{
+    benchScanSlot * slot = bench_scan_slot;
+
+    DICT_NOT_USED(privData);
+
+    //每个线程在每一轮第一次被调用时领取一个统计槽
+    if (bench_scan_slot_run != bench_scan_run)
+    {
+        slot = bench_scan_slot = &bench_scan_slots[__atomic_fetch_add(&bench_scan_next, 1, __ATOMIC_RELAXED)];
+        bench_scan_slot_run = bench_scan_run;
+    }
+
+    assert(dictGetUnsignedIntegerVal(de) == (uint64_t)dictGetKey(de) * 2);
+    slot->entries++;
+    slot->checksum += dictGenHashFunction(&de->key, sizeof(de->key));
+}
+
+/**
+ * 用 threads 个线程扫描字典，检查每个节点正好被访问一次
+ *
+ * @return 用时，单位为纳秒
+ */
+static long long benchScan(dict * d, int threads, uint64_t expectChecksum)
+{
+    unsigned long entries = 0;
+    uint64_t checksum = 0;
+    long long start;
+    int i;
+
+    memset(bench_scan_slots, 0, sizeof(bench_scan_slots));
+    bench_scan_next = 0;
+    bench_scan_run++;
+
+    start = benchNs();
+    dictScanParallel(d, threads, benchScanCallback, NULL);
+    start = benchNs() - start;
+
+    for (i = 0; i < DICT_SCAN_PARALLEL_MAX_THREADS; i++)
+    {
+        entries += bench_scan_slots[i].entries;
+        checksum += bench_scan_slots[i].checksum;
+    }
+    assert(entries == dictSize(d));
+    assert(checksum == expectChecksum);
+
+    return start;
+}
+
+/**
+ * dictScanParallel() 在不同线程数量下的耗时
+ */
+static void benchScanParallel(unsigned long n)
+{
+    unsigned long i;
+    uint64_t checksum = 0;
+    dict * d;
+    int threads;
+
+    d = dictCreate(&benchIntType, NULL);
+    for (i = 1; i <= n; i++)
+    {
+        dictEntry * de = dictAddRaw(d, (void *)i);
+
+        dictSetUnsignedIntegerVal(de, i * 2);
+        checksum += dictGenHashFunction(&de->key, sizeof(de->key));
+    }
+    while (dictRehash(d, 1000));
+
+    for (threads = 1; threads <= 16; threads *= 2)
+    {
+        char extra[32];
+
+        snprintf(extra, sizeof(extra), "\"threads\": %d", threads);
+        benchEmit("scan", n, "int", "uniform", "scan_parallel", n, benchScan(d, threads, checksum), NULL, extra);
+    }
+
+    //rehash 进行到一半时同样不能漏掉或重复任何节点
+    dictExpand(d, n * 2);
+    dictRehash(d, (int)(d->ht[0].size / 4));
+    assert(dictIsRehashing(d));
+    benchScan(d, 4, checksum);
+
+    dictRelease(d);
+}
+
+/* --------------------------------- DICT_DEFINE ------------------------------*/
+
+/* DICT_DEFINE() 生成的字典与通用字典的对比，两者使用相同的哈希函数，差别只在回调的间接调用 */
+
+static inline uint64_t benchHashU64(uint64_t key)
+{
+    return dictGenHashFunction(&key, sizeof(key));
+}
+
+static inline uint64_t benchHashStr(const char * key)
+{
+    return dictGenHashFunction(key, strlen(key));
+}
+
+static uint64_t benchHashStrCallback(const void * key)
+{
+    return dictGenHashFunction(key, strlen(key));
+}
+
+static int benchStrCompare(void * privData, const void * key1, const void * key2)
+{
+    DICT_NOT_USED(privData);
+    return strcmp(key1, key2) == 0;
+}
+
+#define benchU64Equal(a, b) ((a) == (b))
+#define benchStrEqual(a, b) (strcmp((a), (b)) == 0)
+
+DICT_DEFINE_MAP(benchU64Dict, uint64_t, uint64_t, benchHashU64, benchU64Equal)
+DICT_DEFINE(benchStrDict, const char *, benchHashStr, benchStrEqual)
+
+//C 字符串键，键和值由基准测试管理
+static dictType benchStrType = {
+    benchHashStrCallback,   /* hash function */
+    NULL,                   /* key dup */
+    NULL,                   /* val dup */
+    benchStrCompare,        /* key compare */
+    NULL,                   /* key destructor */
+    NULL,                   /* val destructor */
+    0,                      /* flags */
+    NULL,                   /* embed key len */
+    NULL,                   /* embed key */
+    NULL                    /* key bytes */
+};
+
+/**
+ * 依次测量添加、命中查找、未命中查找和删除
+ */
+#define BENCH_DEFINE_RUN(keys, impl, add, find, del)                                        \
+    do {                                                                                    \
+        long long _t;                                                                       \
+        _t = benchNs(); for (i = 0; i < n; i++) { add; }                                    \
+        benchEmit("define", n, keys, "uniform", "add", n, benchNs() - _t, NULL, impl);      \
+        _t = benchNs(); for (i = 0; i < n; i++) { hits += (find(n - 1 - i)) != NULL; }      \
+        benchEmit("define", n, keys, "uniform", "find", n, benchNs() - _t, NULL, impl);     \
+        _t = benchNs(); for (i = n; i < n * 2; i++) { hits += (find(i)) != NULL; }          \
+        benchEmit("define", n, keys, "uniform", "miss", n, benchNs() - _t, NULL, impl);     \
+        _t = benchNs(); for (i = 0; i < n; i++) { del; }                                    \
+        benchEmit("define", n, keys, "uniform", "delete", n, benchNs() - _t, NULL, impl);   \
+    } while (0)
+
+static void benchDefine(unsigned long n)
+{
+    char ** strs = z_malloc(sizeof(char *) * n * 2);
+    unsigned long i, hits = 0;
+    benchU64Dict * bd;
+    benchStrDict * sd;
+    dict * d;
+
+    //前 n 个键添加到字典中，后 n 个键用来测量未命中的查找
+    for (i = 0; i < n * 2; i++)
+    {
+        char buf[32];
+        int len = snprintf(buf, sizeof(buf), "key:%llu", (unsigned long long)benchIntKey(i));
+
+        strs[i] = z_malloc(len + 1);
+        memcpy(strs[i], buf, len + 1);
+    }
+
+#define benchGenericU64Find(j) dictFind(d, (void *)benchIntKey(j))
+#define benchDefineU64Find(j) benchU64DictFind(bd, benchIntKey(j))
+#define benchGenericStrFind(j) dictFind(d, strs[j])
+#define benchDefineStrFind(j) benchStrDictFind(sd, strs[j])
+
+    d = dictCreate(&benchIntType, NULL);
+    BENCH_DEFINE_RUN("u64", "\"impl\": \"generic\"",
+                     dictAdd(d, (void *)benchIntKey(i), NULL),
+                     benchGenericU64Find,
+                     dictDelete(d, (void *)benchIntKey(i)));
+    dictRelease(d);
+
+    bd = benchU64DictCreate();
+    BENCH_DEFINE_RUN("u64", "\"impl\": \"define\"",
+                     benchU64DictAdd(bd, benchIntKey(i), i),
+                     benchDefineU64Find,
+                     benchU64DictDelete(bd, benchIntKey(i)));
+    assert(benchU64DictSize(bd) == 0);
+    benchU64DictRelease(bd);
+
+    d = dictCreate(&benchStrType, NULL);
+    BENCH_DEFINE_RUN("str", "\"impl\": \"generic\"",
+                     dictAdd(d, strs[i], strs[i]),
+                     benchGenericStrFind,
+                     dictDelete(d, strs[i]));
+    dictRelease(d);
+
+    sd = benchStrDictCreate();
+    BENCH_DEFINE_RUN("str", "\"impl\": \"define\"",
+                     benchStrDictAdd(sd, strs[i], strs[i]),
+                     benchDefineStrFind,
+                     benchStrDictDelete(sd, strs[i]));
+    assert(benchStrDictSize(sd) == 0);
+    benchStrDictRelease(sd);
+
+    //每个字典的命中查找都找到了 n 个键，未命中的查找一个也没有找到
+    assert(hits == n * 4);
+
+    for (i = 0; i < n * 2; i++) z_free(strs[i]);
+    z_free(strs);
+}
+
+/* --------------------------------- 大页 -------------------------------------*/
+
+/**
+ * 打开当前线程用户态的 dTLB 读缺失计数器，内核不允许（perf_event_paranoid）或硬件不支持时返回 -1
+ */
+static int benchTlbOpen(void)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static long long benchTlbRead(int fd)
+{
+    long long count;
+
+    if (fd < 0 || read(fd, &count, sizeof(count)) != sizeof(count))
+        return -1;
+    return count;
+}
+
+/**
+ * 返回进程中透明大页的总量（KiB），读不到 /proc/self/smaps_rollup 时返回 -1
+ */
+static long benchAnonHugeKb(void)
+{
+    FILE * fp = fopen("/proc/self/smaps_rollup", "r");
+    char line[256];
+    long kb = -1;
+
+    if (fp == NULL) return -1;
+    while (fgets(line, sizeof(line), fp))
+        if (sscanf(line, "AnonHugePages: %ld kB", &kb) == 1) break;
+    fclose(fp);
+
+    return kb;
+}
+
+/**
+ * 分别用普通页和透明大页的桶数组测量整数键的随机命中查找
+ *
+ * 整数键不需要解引用，每次查找访问一个桶和一个节点，大页只减少访问桶时的 TLB 缺失
+ */
+static void benchHuge(unsigned long n)
+{
+    static const int modes[] = { DICT_HUGE_PAGES_OFF, DICT_HUGE_PAGES_MADVISE };
+    static const char * names[] = { "off", "madvise" };
+    unsigned long ops = n > BENCH_MIN_OPS ? n : BENCH_MIN_OPS, len, i, found = 0;
+    unsigned int * trace;
+    benchKeys ks;
+    int m, fd = benchTlbOpen();
+
+    len = ops < BENCH_TRACE_LEN ? ops : BENCH_TRACE_LEN;
+    trace = benchTrace(BENCH_DIST_UNIFORM, n, len, 11);
+    benchKeysInit(&ks, BENCH_KEY_INT, n);
+
+    for (m = 0; m < 2; m++)
+    {
+        benchLatency lat;
+        long long total = 0, misses;
+        char extra[160];
+        dict * d;
+
+        dictSetHugePages(modes[m]);
+        d = dictCreate(&benchIntType, NULL);
+        dictExpand(d, n);
+        for (i = 0; i < n; i++)
+            dictAdd(d, benchKey(&ks, benchPermute(i, n)), NULL);
+
+        benchLatencyInit(&lat, ops);
+        misses = benchTlbRead(fd);
+        BENCH_LOOP(&lat, ops, total, found += dictFind(d, benchKey(&ks, trace[i % len])) != NULL);
+        if (misses >= 0) misses = benchTlbRead(fd) - misses;
+        snprintf(extra, sizeof(extra), "\"pages\": \"%s\", \"table_bytes\": %zu, "
+                 "\"dtlb_misses_per_op\": %.3f, \"anon_huge_kb\": %ld",
+                 names[m], d->ht[0].size * sizeof(dictEntry *),
+                 misses >= 0 ? (double)misses / ops : -1.0, benchAnonHugeKb());
+        benchEmit("huge", n, "int", "uniform", "find", ops, total, &lat, extra);
+        z_free(lat.samples);
+        dictRelease(d);
+    }
+    assert(found == ops * 2);
+
+    dictSetHugePages(DICT_HUGE_PAGES_MADVISE);
+    benchKeysRelease(&ks);
+    z_free(trace);
+    if (fd >= 0) close(fd);
+}
+
+/**
+ * 重建字典与保存、映射字典文件的对比，键和值都是短 sds 键
+ *
+ * rebuild 为逐个 dictAdd() 重建字典，即没有字典文件时重启需要做的工作；
+ * load 为 dictLoadMapped() 本身，find_cold 为映射之后第一遍访问全部键的命中查找（包含缺页），
+ * find 为之后的随机命中查找
+ */
+static void benchSave(unsigned long n)
+{
+    unsigned long ops = n > BENCH_MIN_OPS ? n : BENCH_MIN_OPS, len, i, found = 0;
+    char path[] = "/tmp/dictbench-XXXXXX", extra[64];
+    long long total = 0, t;
+    unsigned int * trace;
+    benchLatency lat;
+    dictMapped * dm;
+    benchKeys ks;
+    dict * d;
+    int fd;
+
+    len = ops < BENCH_TRACE_LEN ? ops : BENCH_TRACE_LEN;
+    trace = benchTrace(BENCH_DIST_UNIFORM, n, len, 13);
+    benchKeysInit(&ks, BENCH_KEY_SHORT, n);
+
+    d = dictCreate(&benchSdsType, NULL);
+    t = benchNs();
+    for (i = 0; i < n; i++)
+        dictAdd(d, ks.sdsKeys[benchPermute(i, n)], ks.sdsKeys[i]);
+    benchEmit("save", n, "short", "uniform", "rebuild", n, benchNs() - t, NULL, NULL);
+
+    fd = mkstemp(path);
+    assert(fd >= 0);
+    t = benchNs();
+    assert(dictSave(d, fd) == DICT_OK);
+    benchEmit("save", n, "short", "uniform", "save", n, benchNs() - t, NULL, NULL);
+    close(fd);
+    dictRelease(d);
+
+    t = benchNs();
+    dm = dictLoadMapped(path);
+    t = benchNs() - t;
+    assert(dm != NULL);
+    snprintf(extra, sizeof(extra), "\"file_bytes\": %zu", dm->mapSize);
+    benchEmit("save", n, "short", "uniform", "load", 1, t, NULL, extra);
+
+    t = benchNs();
+    for (i = 0; i < n; i++)
+        found += dictMappedFetch(dm, ks.sdsKeys[benchPermute(i, n)], NULL) == DICT_OK;
+    benchEmit("save", n, "short", "uniform", "find_cold", n, benchNs() - t, NULL, NULL);
+
+    benchLatencyInit(&lat, ops);
+    BENCH_LOOP(&lat, ops, total, found += dictMappedFetch(dm, ks.sdsKeys[trace[i % len]], NULL) == DICT_OK);
+    benchEmit("save", n, "short", "uniform", "find", ops, total, &lat, NULL);
+    assert(found == n + ops);
+
+    z_free(lat.samples);
+    dictMappedRelease(dm);
+    unlink(path);
+    benchKeysRelease(&ks);
+    z_free(trace);
+}
+
+/**
+ * rehash 期间的查找延迟
+ *
+ * 先装入 2^(bits-1) 个整数键，正好装满 0 号哈希表，再添加一个键触发扩展到 2^bits 个桶。
+ * 之后只做命中查找，直到 rehash 完成或者查找了 ops 次：关闭后台 rehash 时每次查找附带一次单步 rehash ，
+ * 开启时由后台线程迁移，查找只在分段锁和轮询上付出开销
+ */
+static void benchBgRehash(int bits)
+{
+    static const char * names[] = { "off", "on" };
+    unsigned long n = 1UL << (bits - 1), ops = n, len, i, k, found = 0;
+    unsigned int * trace;
+    benchKeys ks;
+    int bg;
+
+    len = ops < BENCH_TRACE_LEN ? ops : BENCH_TRACE_LEN;
+    trace = benchTrace(BENCH_DIST_UNIFORM, n, len, 17);
+    benchKeysInit(&ks, BENCH_KEY_INT, n + 1);
+
+    for (bg = 0; bg < 2; bg++)
+    {
+        benchLatency lat;
+        long long total = 0, start;
+        char extra[160];
+        dict * d = dictCreate(&benchIntType, NULL);
+
+        dictExpand(d, n);
+        for (i = 0; i < n; i++)
+            dictAdd(d, benchKey(&ks, benchPermute(i, n)), NULL);
+        assert(!dictIsRehashing(d) && d->ht[0].size == n);
+
+        //基准：同一个表在扩展之前的查找
+        benchLatencyInit(&lat, BENCH_MIN_OPS);
+        BENCH_LOOP(&lat, BENCH_MIN_OPS, total, found += dictFind(d, benchKey(&ks, trace[i % len])) != NULL);
+        snprintf(extra, sizeof(extra), "\"bg_rehash\": \"%s\", \"buckets\": %lu", names[bg], n);
+        benchEmit("bg_rehash", n, "int", "uniform", "find_before", BENCH_MIN_OPS, total, &lat, extra);
+        z_free(lat.samples);
+
+        if (bg) dictEnableBackgroundRehash(d);
+        dictAdd(d, benchKey(&ks, n), NULL);
+        assert(dictIsRehashing(d) && d->ht[1].size == n * 2);
+
+        //只统计 rehash 进行中的查找
+        benchLatencyInit(&lat, ops);
+        start = benchNs();
+        for (i = 0, k = 0; i < ops && dictIsRehashing(d); i++)
+        {
+            if (++k == lat.stride)
+            {
+                long long t = benchNs();
+
+                found += dictFind(d, benchKey(&ks, trace[i % len])) != NULL;
+                benchLatencyAdd(&lat, benchNs() - t);
+                k = 0;
+            }
+            else
+            {
+                found += dictFind(d, benchKey(&ks, trace[i % len])) != NULL;
+            }
+        }
+        total = benchNs() - start;
+        snprintf(extra, sizeof(extra), "\"bg_rehash\": \"%s\", \"buckets\": %lu, \"rehash_finished\": %d",
+                 names[bg], n * 2, !dictIsRehashing(d));
+        if (i) benchEmit("bg_rehash", n, "int", "uniform", "find_rehashing", i, total, &lat, extra);
+        z_free(lat.samples);
+        dictRelease(d);
+    }
+
+    benchKeysRelease(&ks);
+    z_free(trace);
+}
+
+/**
+ * 逐个 dictAdd() 与 dictBulkLoad() 装入空字典的对比，整数键和短 sds 键
+ */
+static void benchBulk(unsigned long n)
+{
+    static const char * ops[] = { "add", "bulk", "bulk_unique" };
+    int kind, op;
+
+    for (kind = BENCH_KEY_INT; kind <= BENCH_KEY_SHORT; kind++)
+    {
+        void ** keys = z_malloc(sizeof(void *) * n);
+        unsigned long i;
+        benchKeys ks;
+
+        benchKeysInit(&ks, kind, n);
+        for (i = 0; i < n; i++)
+            keys[i] = benchKey(&ks, i);
+
+        for (op = 0; op < 3; op++)
+        {
+            dict * d = dictCreate(kind == BENCH_KEY_INT ? &benchIntType : &benchSdsType, NULL);
+            long long t = benchNs();
+
+            if (op == 0)
+            {
+                for (i = 0; i < n; i++)
+                    dictAdd(d, keys[i], NULL);
+            }
+            else
+            {
+                dictBulkLoad(d, keys, NULL, n, op == 2 ? DICT_BULK_ASSUME_UNIQUE : 0, NULL);
+            }
+            t = benchNs() - t;
+            assert(dictSize(d) == n);
+            benchEmit("bulk", n, bench_key_names[kind], "uniform", ops[op], n, t, NULL, NULL);
+            dictRelease(d);
+        }
+
+        benchKeysRelease(&ks);
+        z_free(keys);
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    unsigned long maxSize = argc > 1 ? (unsigned long)strtod(argv[1], NULL) : 1000000, n;
+    int rehashBits = argc > 2 ? atoi(argv[2]) : 27;
+    int kind;
+
+    if (maxSize < 1000) maxSize = 1000;
+    if (maxSize > 100000000) maxSize = 100000000;
+
+    benchCalibrate();
+    printf("{\n  \"benchmark\": \"dict\",\n  \"timestamp\": %lld,\n  \"max_size\": %lu,\n"
+           "  \"min_ops\": %lu,\n  \"latency_samples\": %lu,\n  \"zipf_theta\": %.2f,\n"
+           "  \"timer_overhead_ns\": %lld,\n  \"results\": [\n",
+           (long long)time(NULL), maxSize, BENCH_MIN_OPS, BENCH_LATENCY_SAMPLES,
+           BENCH_ZIPF_THETA, bench_timer_overhead);
+
+    for (n = 1000; n <= maxSize; n *= 10)
+    {
+        for (kind = BENCH_KEY_INT; kind <= BENCH_KEY_LONG; kind++)
+        {
+            benchKeys ks;
+
+            fprintf(stderr, "size %lu, %s keys\n", n, bench_key_names[kind]);
+            benchKeysInit(&ks, kind, n);
+            benchOps(&ks);
+            benchKeysRelease(&ks);
+        }
+    }
+
+    n = maxSize < 4000000 ? maxSize : 4000000;
+    fprintf(stderr, "dictScanParallel, %lu keys\n", n);
+    benchScanParallel(n);
+    fprintf(stderr, "DICT_DEFINE vs generic, %lu keys\n", n);
+    benchDefine(n);
+    fprintf(stderr, "dictSave / dictLoadMapped, %lu keys\n", n);
+    benchSave(n);
+    fprintf(stderr, "dictBulkLoad, %lu keys\n", n);
+    benchBulk(n);
+
+    //桶数组至少要有一个大页
+    n = maxSize;
+    if (dictNextPower(n) * sizeof(dictEntry *) >= DICT_HUGE_TABLE_MIN_BYTES)
+    {
+        fprintf(stderr, "huge pages, %lu keys\n", n);
+        benchHuge(n);
+    }
+
+    //目标大小至少要让 0 号哈希表达到后台 rehash 的门槛
+    if (rehashBits > 0 && (1UL << (rehashBits - 1)) >= DICT_BG_REHASH_MIN_SIZE)
+    {
+        fprintf(stderr, "rehash to 2^%d buckets\n", rehashBits);
+        benchBgRehash(rehashBits);
+    }
+
+    printf("\n  ]\n}\n");
+
+    return 0;
+}
+#endif
@@ -0,0 +1,375 @@
+//
+// Created by Administrator on 2022/3/4.
+//
+
+#ifndef REDIS_DESIGN_DICTDEFINE_H
+#define REDIS_DESIGN_DICTDEFINE_H
+
+#include <stdint.h>
+
+#include "dict.h"
+#include "zmalloc.h"
+
+/**
+ * 生成键类型为 keytype 、值类型为 valtype 的专用字典 name
+ *
+ * 通用字典通过 dictType 中的函数指针计算哈希值、比较键，每次查找至少有两次间接调用，
+ * 键和值也只能是指针或者 64 位整数。生成的字典把 hashfn 和 eqfn 直接展开在代码中，
+ * 所有函数都是 static inline 的，编译器可以把整个查找路径内联到调用处。
+ *
+ * 哈希表与通用字典的链式哈希表相同：两个哈希表，渐进式 rehash ，每次操作迁移一个桶；
+ * 何时扩展、收缩到多大由 dictResizeGrowTarget() / dictResizeShrinkTarget() 按照
+ * resize 策略决定，哈希表大小由 dictNextPower() 计算，dictScan 的游标由 dictScanCursorNext() 计算，
+ * 所以生成的字典与通用字典在相同的操作序列下有相同的大小变化和相同的 SCAN 保证。
+ *
+ * 与通用字典的区别：
+ * 1）不复制也不释放键和值，键和值的内存由调用者管理；
+ * 2）没有安全迭代器、后台 rehash 、无锁读取和快照，遍历使用 nameScan() ；
+ * 3）键按值传递，hashfn(key) 返回 uint64_t ，eqfn(a, b) 在两个键相等时返回非 0 ，
+ *    两者可以是函数也可以是宏，宏的参数可能被求值多次。
+ *
+ * 生成的类型和函数：
+ *     nameEntry     节点，字段 key 、val 可以直接访问
+ *     name          字典，resizePolicy 为 NULL 时使用全局策略
+ *     nameCreate / nameRelease / nameEmpty / nameExpand / nameRehash
+ *     nameAdd / nameAddRaw / nameReplace / nameDelete / nameFind / nameScan / nameSize
+ *
+ * 例如：
+ *     static inline uint64_t hashU64(uint64_t k) { return dictGenHashFunction(&k, sizeof(k)); }
+ *     #define eqU64(a, b) ((a) == (b))
+ *     DICT_DEFINE_MAP(dictU64, uint64_t, uint64_t, hashU64, eqU64)
+ */
+#define DICT_DEFINE_MAP(name, keytype, valtype, hashfn, eqfn)                           \
+                                                                                        \
+typedef struct name##Entry                                                              \
+{                                                                                       \
+    struct name##Entry * next;                                                          \
+    keytype key;                                                                        \
+    valtype val;                                                                        \
+} name##Entry;                                                                          \
+                                                                                        \
+typedef struct name##Table                                                              \
+{                                                                                       \
+    name##Entry ** table;                                                               \
+    unsigned long size;                                                                 \
+    unsigned long sizeMask;                                                             \
+    unsigned long used;                                                                 \
+} name##Table;                                                                          \
+                                                                                        \
+typedef struct name                                                                     \
+{                                                                                       \
+    name##Table ht[2];                                                                  \
+    long rehashIndex;                                                                   \
+    dictResizePolicy * resizePolicy;                                                    \
+} name;                                                                                 \
+                                                                                        \
+typedef void (name##ScanFunction)(void * privData, const name##Entry * de);             \
+                                                                                        \
+static inline void _##name##Reset(name##Table * ht)                                     \
+{                                                                                       \
+    ht->table = NULL;                                                                   \
+    ht->size = 0;                                                                       \
+    ht->sizeMask = 0;                                                                   \
+    ht->used = 0;                                                                       \
+}                                                                                       \
+                                                                                        \
+static inline name * name##Create(void)                                                 \
+{                                                                                       \
+    name * d = z_malloc(sizeof(name));                                                  \
+                                                                                        \
+    _##name##Reset(&d->ht[0]);                                                          \
+    _##name##Reset(&d->ht[1]);                                                          \
+    d->rehashIndex = -1;                                                                \
+    d->resizePolicy = NULL;                                                             \
+                                                                                        \
+    return d;                                                                           \
+}                                                                                       \
+                                                                                        \
+static inline void _##name##Clear(name##Table * ht)                                     \
+{                                                                                       \
+    unsigned long i;                                                                    \
+                                                                                        \
+    for (i = 0; i < ht->size && ht->used > 0; i++)                                      \
+    {                                                                                   \
+        name##Entry * he = ht->table[i], * nextHe;                                      \
+                                                                                        \
+        while (he)                                                                      \
+        {                                                                               \
+            nextHe = he->next;                                                          \
+            z_free(he);                                                                 \
+            ht->used--;                                                                 \
+            he = nextHe;                                                                \
+        }                                                                               \
+    }                                                                                   \
+    z_free(ht->table);                                                                  \
+    _##name##Reset(ht);                                                                 \
+}                                                                                       \
+                                                                                        \
+static inline void name##Empty(name * d)                                                \
+{                                                                                       \
+    _##name##Clear(&d->ht[0]);                                                          \
+    _##name##Clear(&d->ht[1]);                                                          \
+    d->rehashIndex = -1;                                                                \
+}                                                                                       \
+                                                                                        \
+static inline void name##Release(name * d)                                              \
+{                                                                                       \
+    name##Empty(d);                                                                     \
+    z_free(d);                                                                          \
+}                                                                                       \
+                                                                                        \
+static inline unsigned long name##Size(const name * d)                                  \
+{                                                                                       \
+    return d->ht[0].used + d->ht[1].used;                                               \
+}                                                                                       \
+                                                                                        \
+static inline int name##Expand(name * d, unsigned long size)                            \
+{                                                                                       \
+    name##Table n;                                                                      \
+    unsigned long realSize = dictNextPower(size);                                       \
+                                                                                        \
+    if (d->rehashIndex != -1 || d->ht[0].used > size)                                   \
+        return DICT_ERR;                                                                \
+                                                                                        \
+    n.size = realSize;                                                                  \
+    n.sizeMask = realSize - 1;                                                          \
+    n.table = z_calloc(realSize * sizeof(name##Entry *));                               \
+    n.used = 0;                                                                         \
+                                                                                        \
+    if (d->ht[0].table == NULL)                                                         \
+    {                                                                                   \
+        d->ht[0] = n;                                                                   \
+    } else {                                                                            \
+        d->ht[1] = n;                                                                   \
+        d->rehashIndex = 0;                                                             \
+    }                                                                                   \
+                                                                                        \
+    return DICT_OK;                                                                     \
+}                                                                                       \
+                                                                                        \
+static inline int name##Rehash(name * d, int n)                                         \
+{                                                                                       \
+    if (d->rehashIndex == -1) return 0;                                                 \
+                                                                                        \
+    while (n--)                                                                         \
+    {                                                                                   \
+        name##Entry * de, * nextDe;                                                     \
+                                                                                        \
+        if (d->ht[0].used == 0)                                                         \
+        {                                                                               \
+            z_free(d->ht[0].table);                                                     \
+            d->ht[0] = d->ht[1];                                                        \
+            _##name##Reset(&d->ht[1]);                                                  \
+            d->rehashIndex = -1;                                                        \
+            return 0;                                                                   \
+        }                                                                               \
+                                                                                        \
+        while (d->ht[0].table[d->rehashIndex] == NULL)                                  \
+            d->rehashIndex++;                                                           \
+                                                                                        \
+        de = d->ht[0].table[d->rehashIndex];                                            \
+        while (de)                                                                      \
+        {                                                                               \
+            unsigned long h = (unsigned long)(hashfn(de->key)) & d->ht[1].sizeMask;     \
+                                                                                        \
+            nextDe = de->next;                                                          \
+            de->next = d->ht[1].table[h];                                               \
+            d->ht[1].table[h] = de;                                                     \
+            d->ht[0].used--;                                                            \
+            d->ht[1].used++;                                                            \
+            de = nextDe;                                                                \
+        }                                                                               \
+        d->ht[0].table[d->rehashIndex] = NULL;                                          \
+        d->rehashIndex++;                                                               \
+    }                                                                                   \
+                                                                                        \
+    return 1;                                                                           \
+}                                                                                       \
+                                                                                        \
+static inline int _##name##ShrinkIfNeeded(name * d)                                     \
+{                                                                                       \
+    unsigned long target;                                                               \
+                                                                                        \
+    if (d->rehashIndex != -1 || d->ht[0].size <= DICT_HT_INITIAL_SIZE) return DICT_OK;  \
+                                                                                        \
+    target = dictResizeShrinkTarget(d->resizePolicy, d->ht[0].size, d->ht[0].used);     \
+    if (target == 0) return DICT_OK;                                                    \
+                                                                                        \
+    return name##Expand(d, target);                                                     \
+}                                                                                       \
+                                                                                        \
+static inline int _##name##ExpandIfNeeded(name * d)                                     \
+{                                                                                       \
+    unsigned long target;                                                               \
+                                                                                        \
+    if (d->rehashIndex != -1) return DICT_OK;                                           \
+    if (d->ht[0].size == 0) return name##Expand(d, DICT_HT_INITIAL_SIZE);               \
+                                                                                        \
+    target = dictResizeGrowTarget(d->resizePolicy, d->ht[0].size, d->ht[0].used);       \
+    if (target) return name##Expand(d, target);                                         \
+                                                                                        \
+    return _##name##ShrinkIfNeeded(d);                                                  \
+}                                                                                       \
+                                                                                        \
+static inline name##Entry * _##name##Lookup(name * d, keytype key, uint64_t h)          \
+{                                                                                       \
+    int table;                                                                          \
+                                                                                        \
+    for (table = 0; table <= 1; table++)                                                \
+    {                                                                                   \
+        name##Entry * he = d->ht[table].table[h & d->ht[table].sizeMask];               \
+                                                                                        \
+        while (he)                                                                      \
+        {                                                                               \
+            if (eqfn(he->key, key))                                                     \
+                return he;                                                              \
+            he = he->next;                                                              \
+        }                                                                               \
+        if (d->rehashIndex == -1) break;                                                \
+    }                                                                                   \
+                                                                                        \
+    return NULL;                                                                        \
+}                                                                                       \
+                                                                                        \
+static inline name##Entry * name##Find(name * d, keytype key)                           \
+{                                                                                       \
+    if (d->ht[0].used + d->ht[1].used == 0) return NULL;                                \
+    if (d->rehashIndex != -1) name##Rehash(d, 1);                                       \
+                                                                                        \
+    return _##name##Lookup(d, key, (uint64_t)(hashfn(key)));                            \
+}                                                                                       \
+                                                                                        \
+static inline name##Entry * name##AddRaw(name * d, keytype key)                         \
+{                                                                                       \
+    name##Table * ht;                                                                   \
+    name##Entry * entry;                                                                \
+    uint64_t h;                                                                         \
+                                                                                        \
+    if (d->rehashIndex != -1) name##Rehash(d, 1);                                       \
+    if (_##name##ExpandIfNeeded(d) == DICT_ERR) return NULL;                            \
+                                                                                        \
+    h = (uint64_t)(hashfn(key));                                                        \
+    if (_##name##Lookup(d, key, h)) return NULL;                                        \
+                                                                                        \
+    ht = d->rehashIndex != -1 ? &d->ht[1] : &d->ht[0];                                  \
+    entry = z_malloc(sizeof(name##Entry));                                              \
+    entry->key = key;                                                                   \
+    entry->next = ht->table[h & ht->sizeMask];                                          \
+    ht->table[h & ht->sizeMask] = entry;                                                \
+    ht->used++;                                                                         \
+                                                                                        \
+    return entry;                                                                       \
+}                                                                                       \
+                                                                                        \
+static inline int name##Add(name * d, keytype key, valtype val)                         \
+{                                                                                       \
+    name##Entry * entry = name##AddRaw(d, key);                                         \
+                                                                                        \
+    if (!entry) return DICT_ERR;                                                        \
+    entry->val = val;                                                                   \
+                                                                                        \
+    return DICT_OK;                                                                     \
+}                                                                                       \
+                                                                                        \
+static inline int name##Replace(name * d, keytype key, valtype val)                     \
+{                                                                                       \
+    name##Entry * entry = name##AddRaw(d, key);                                         \
+                                                                                        \
+    if (entry)                                                                          \
+    {                                                                                   \
+        entry->val = val;                                                               \
+        return 1;                                                                       \
+    }                                                                                   \
+                                                                                        \
+    entry = name##Find(d, key);                                                         \
+    if (entry) entry->val = val;                                                        \
+                                                                                        \
+    return 0;                                                                           \
+}                                                                                       \
+                                                                                        \
+static inline int name##Delete(name * d, keytype key)                                   \
+{                                                                                       \
+    uint64_t h;                                                                         \
+    int table;                                                                          \
+                                                                                        \
+    if (d->ht[0].used + d->ht[1].used == 0) return DICT_ERR;                            \
+    if (d->rehashIndex != -1) name##Rehash(d, 1);                                       \
+                                                                                        \
+    h = (uint64_t)(hashfn(key));                                                        \
+    for (table = 0; table <= 1; table++)                                                \
+    {                                                                                   \
+        name##Entry ** link = &d->ht[table].table[h & d->ht[table].sizeMask];           \
+                                                                                        \
+        while (*link)                                                                   \
+        {                                                                               \
+            name##Entry * he = *link;                                                   \
+                                                                                        \
+            if (eqfn(he->key, key))                                                     \
+            {                                                                           \
+                *link = he->next;                                                       \
+                z_free(he);                                                             \
+                d->ht[table].used--;                                                    \
+                _##name##ShrinkIfNeeded(d);                                             \
+                return DICT_OK;                                                         \
+            }                                                                           \
+            link = &he->next;                                                           \
+        }                                                                               \
+        if (d->rehashIndex == -1) break;                                                \
+    }                                                                                   \
+                                                                                        \
+    return DICT_ERR;                                                                    \
+}                                                                                       \
+                                                                                        \
+static inline void _##name##ScanBucket(name##Entry * de,                                \
+                                       name##ScanFunction * fn, void * privData)        \
+{                                                                                       \
+    while (de)                                                                          \
+    {                                                                                   \
+        name##Entry * next = de->next;                                                  \
+                                                                                        \
+        fn(privData, de);                                                               \
+        de = next;                                                                      \
+    }                                                                                   \
+}                                                                                       \
+                                                                                        \
+static inline unsigned long name##Scan(name * d, unsigned long v,                       \
+                                       name##ScanFunction * fn, void * privData)        \
+{                                                                                       \
+    name##Table * t0, * t1;                                                             \
+    unsigned long m0, m1, cursor = v;                                                   \
+                                                                                        \
+    if (d->ht[0].used + d->ht[1].used == 0) return 0;                                   \
+                                                                                        \
+    if (d->rehashIndex == -1)                                                           \
+    {                                                                                   \
+        t0 = &d->ht[0];                                                                 \
+        m0 = t0->sizeMask;                                                              \
+        _##name##ScanBucket(t0->table[v & m0], fn, privData);                           \
+    } else {                                                                            \
+        t0 = &d->ht[0];                                                                 \
+        t1 = &d->ht[1];                                                                 \
+        if (t0->size > t1->size)                                                        \
+        {                                                                               \
+            t0 = &d->ht[1];                                                             \
+            t1 = &d->ht[0];                                                             \
+        }                                                                               \
+        m0 = t0->sizeMask;                                                              \
+        m1 = t1->sizeMask;                                                              \
+                                                                                        \
+        _##name##ScanBucket(t0->table[v & m0], fn, privData);                           \
+        do {                                                                            \
+            _##name##ScanBucket(t1->table[v & m1], fn, privData);                       \
+            v = (((v | m0) + 1) & ~m0) | (v & m0);                                      \
+        } while (v & (m0 ^ m1));                                                        \
+    }                                                                                   \
+                                                                                        \
+    return dictScanCursorNext(cursor, m0);                                              \
+}
+
+/**
+ * 生成以 keytype 为键、以 void * 为值的专用字典 name ，见 DICT_DEFINE_MAP()
+ */
+#define DICT_DEFINE(name, keytype, hashfn, eqfn) \
+    DICT_DEFINE_MAP(name, keytype, void *, hashfn, eqfn)
+
+#endif //REDIS_DESIGN_DICTDEFINE_H
@@ -0,0 +1,371 @@
+//
+// Created by Administrator on 2022/3/4.
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#endif
+
+#include "dicthash.h"
+#include "endianconv.h"
+
+/* ----------------------------- 大小写折叠 ----------------------------------*/
+
+/**
+ * 将 64 位字中的 8 个 ASCII 大写字母同时转换为小写（SWAR），其他字节保持不变
+ *
+ * 对每个字节，先去掉最高位，再分别加上偏移量，
+ * 使得 "大于 'Z'" 和 "不小于 'A'" 这两个条件都体现在该字节的最高位上，
+ * 两者异或并排除非 ASCII 字节之后，就得到了大写字母的位置。
+ *
+ * T = O(1)
+ */
+static inline uint64_t _foldCase64(uint64_t w)
+{
+    uint64_t heptets = w & 0x7f7f7f7f7f7f7f7fULL;
+    uint64_t gtZ = heptets + 0x2525252525252525ULL;  //0x7f - 'Z'
+    uint64_t geA = heptets + 0x3f3f3f3f3f3f3f3fULL;  //0x80 - 'A'
+    uint64_t upper = (geA ^ gtZ) & ~w & 0x8080808080808080ULL;
+
+    return w | (upper >> 2);
+}
+
+/**
+ * 将 src 的 48 个字节转换为小写后写入 dst
+ *
+ * wyhash 的主循环每次处理 48 个字节，大小写不敏感的版本先折叠整块再计算。
+ */
+typedef void (foldCaseBlockFunction)(uint8_t * dst, const uint8_t * src);
+
+#define FOLD_BLOCK_SIZE 48
+
+#if !defined(__SSE2__)
+static void _foldCaseBlockSwar(uint8_t * dst, const uint8_t * src)
+{
+    int i;
+
+    for (i = 0; i < FOLD_BLOCK_SIZE; i += 8)
+    {
+        uint64_t w;
+
+        memcpy(&w, src + i, 8);
+        w = _foldCase64(w);
+        memcpy(dst + i, &w, 8);
+    }
+}
+#endif
+
+#if defined(__SSE2__)
+static void _foldCaseBlockSse2(uint8_t * dst, const uint8_t * src)
+{
+    const __m128i lo = _mm_set1_epi8('A' - 1);
+    const __m128i hi = _mm_set1_epi8('Z' + 1);
+    const __m128i bit = _mm_set1_epi8(0x20);
+    int i;
+
+    //有符号比较：非 ASCII 字节是负数，不会被当作大写字母
+    for (i = 0; i < FOLD_BLOCK_SIZE; i += 16)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(x, lo), _mm_cmpgt_epi8(hi, x));
+
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_or_si128(x, _mm_and_si128(upper, bit)));
+    }
+}
+#endif
+
+#if defined(__x86_64__) && defined(__GNUC__)
+__attribute__((target("avx2")))
+static void _foldCaseBlockAvx2(uint8_t * dst, const uint8_t * src)
+{
+    const __m256i lo = _mm256_set1_epi8('A' - 1);
+    const __m256i hi = _mm256_set1_epi8('Z' + 1);
+    const __m256i bit = _mm256_set1_epi8(0x20);
+    __m256i x = _mm256_loadu_si256((const __m256i *)src);
+    __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(x, lo), _mm256_cmpgt_epi8(hi, x));
+
+    __m128i y = _mm_loadu_si128((const __m128i *)(src + 32));
+    __m128i upper16 = _mm_and_si128(_mm_cmpgt_epi8(y, _mm256_castsi256_si128(lo)),
+                                    _mm_cmpgt_epi8(_mm256_castsi256_si128(hi), y));
+
+    _mm256_storeu_si256((__m256i *)dst, _mm256_or_si256(x, _mm256_and_si256(upper, bit)));
+
+    //剩下的 16 个字节
+    _mm_storeu_si128((__m128i *)(dst + 32),
+                     _mm_or_si128(y, _mm_and_si128(upper16, _mm256_castsi256_si128(bit))));
+}
+#endif
+
+//当前 CPU 上最快的折叠函数，在程序启动时选择
+#if defined(__SSE2__)
+static foldCaseBlockFunction * _foldCaseBlock = _foldCaseBlockSse2;
+#else
+static foldCaseBlockFunction * _foldCaseBlock = _foldCaseBlockSwar;
+#endif
+
+#if defined(__x86_64__) && defined(__GNUC__)
+/**
+ * 运行时 CPU 分派：支持 AVX2 的 CPU 使用 AVX2 版本的折叠函数
+ *
+ * 在 main() 之前执行，所以之后多个线程同时读取 _foldCaseBlock 是安全的。
+ */
+__attribute__((constructor))
+static void _dictHashCpuDispatch(void)
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        _foldCaseBlock = _foldCaseBlockAvx2;
+}
+#endif
+
+/* ------------------------------ SipHash-1-3 --------------------------------*/
+
+#define ROTL(x, b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
+
+#define SIPROUND \
+    do { \
+        v0 += v1; v1 = ROTL(v1, 13); v1 ^= v0; v0 = ROTL(v0, 32); \
+        v2 += v3; v3 = ROTL(v3, 16); v3 ^= v2; \
+        v0 += v3; v3 = ROTL(v3, 21); v3 ^= v0; \
+        v2 += v1; v1 = ROTL(v1, 17); v1 ^= v2; v2 = ROTL(v2, 32); \
+    } while (0)
+
+/**
+ * 以小端序读取 8 个字节
+ */
+static inline uint64_t _read64le(const uint8_t * p)
+{
+    uint64_t v;
+
+    memcpy(&v, p, 8);
+    return intrev64ifbe(v);
+}
+
+/**
+ * SipHash-1-3 ，by Jean-Philippe Aumasson and Daniel J. Bernstein
+ *
+ * 每个消息块进行 1 轮压缩，最后进行 3 轮终结，
+ * 比 SipHash-2-4 快得多，对哈希表的防碰撞需求来说仍然足够安全。
+ *
+ * T = O(N)
+ *
+ * @param in 输入
+ * @param inLen 输入的长度
+ * @param k 16 字节的密钥
+ * @param nocase 是否忽略 ASCII 大小写
+ * @return 64 位哈希值
+ */
+static inline __attribute__((always_inline))
+uint64_t _sipHash13(const uint8_t * in, size_t inLen, const uint8_t * k, int nocase)
+{
+    uint64_t v0 = 0x736f6d6570736575ULL;
+    uint64_t v1 = 0x646f72616e646f6dULL;
+    uint64_t v2 = 0x6c7967656e657261ULL;
+    uint64_t v3 = 0x7465646279746573ULL;
+    uint64_t k0 = _read64le(k);
+    uint64_t k1 = _read64le(k + 8);
+    uint64_t m;
+    const uint8_t * end = in + inLen - (inLen % 8);
+    int left = inLen & 7;
+    uint64_t b = ((uint64_t)inLen) << 56;
+
+    v3 ^= k1;
+    v2 ^= k0;
+    v1 ^= k1;
+    v0 ^= k0;
+
+    for (; in != end; in += 8)
+    {
+        m = _read64le(in);
+        if (nocase) m = _foldCase64(m);
+        v3 ^= m;
+        SIPROUND;
+        v0 ^= m;
+    }
+
+#define SIPBYTE(i) ((uint64_t)(nocase ? tolower(in[i]) : in[i]))
+    switch (left)
+    {
+        case 7: b |= SIPBYTE(6) << 48; /* fall through */
+        case 6: b |= SIPBYTE(5) << 40; /* fall through */
+        case 5: b |= SIPBYTE(4) << 32; /* fall through */
+        case 4: b |= SIPBYTE(3) << 24; /* fall through */
+        case 3: b |= SIPBYTE(2) << 16; /* fall through */
+        case 2: b |= SIPBYTE(1) << 8;  /* fall through */
+        case 1: b |= SIPBYTE(0);       break;
+        case 0: break;
+    }
+#undef SIPBYTE
+
+    v3 ^= b;
+    SIPROUND;
+    v0 ^= b;
+
+    v2 ^= 0xff;
+    SIPROUND;
+    SIPROUND;
+    SIPROUND;
+
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+uint64_t sipHash13(const uint8_t * in, size_t inLen, const uint8_t * k)
+{
+    return _sipHash13(in, inLen, k, 0);
+}
+
+uint64_t sipHash13NoCase(const uint8_t * in, size_t inLen, const uint8_t * k)
+{
+    return _sipHash13(in, inLen, k, 1);
+}
+
+/* -------------------------------- wyhash -----------------------------------*/
+
+/* wyhash (final version 4), by Wang Yi, released into the public domain.
+ *
+ * 每次处理 48 个字节，核心操作是 64 位乘 64 位得到 128 位的乘法，
+ * 对长键的吞吐量是 MurmurHash2 的数倍。
+ *
+ * 注意：和 SipHash 一样按小端序读取输入，在大端机器上结果保持一致。
+ */
+static const uint64_t _wyp[4] = {
+    0x2d358dccaa6c78a5ULL, 0x8bb84b93962eacc9ULL,
+    0x4b33a62ed433d4a3ULL, 0x4d5a2da51de1aa47ULL
+};
+
+static inline void _wymum(uint64_t * a, uint64_t * b)
+{
+#if defined(__SIZEOF_INT128__)
+    __uint128_t r = *a;
+
+    r *= *b;
+    *a = (uint64_t)r;
+    *b = (uint64_t)(r >> 64);
+#else
+    uint64_t ha = *a >> 32, hb = *b >> 32, la = (uint32_t)*a, lb = (uint32_t)*b, hi, lo;
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb, t = rl + (rm0 << 32), c = t < rl;
+
+    lo = t + (rm1 << 32);
+    c += lo < t;
+    hi = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+    *a = lo;
+    *b = hi;
+#endif
+}
+
+static inline uint64_t _wymix(uint64_t a, uint64_t b)
+{
+    _wymum(&a, &b);
+    return a ^ b;
+}
+
+static inline uint64_t _wyr8(const uint8_t * p, int nocase)
+{
+    uint64_t v = _read64le(p);
+
+    return nocase ? _foldCase64(v) : v;
+}
+
+static inline uint64_t _wyr4(const uint8_t * p, int nocase)
+{
+    uint32_t v;
+
+    memcpy(&v, p, 4);
+    v = intrev32ifbe(v);
+    return nocase ? _foldCase64(v) : v;
+}
+
+static inline uint64_t _wyr3(const uint8_t * p, size_t k, int nocase)
+{
+    uint64_t v = (((uint64_t)p[0]) << 16) | (((uint64_t)p[k >> 1]) << 8) | p[k - 1];
+
+    return nocase ? _foldCase64(v) : v;
+}
+
+/**
+ * wyhash 的实现，nocase 为真时在读取输入的同时进行大小写折叠
+ *
+ * T = O(N)
+ */
+static inline __attribute__((always_inline))
+uint64_t _wyHash(const uint8_t * p, size_t len, uint64_t seed, int nocase)
+{
+    uint64_t a, b;
+
+    seed ^= _wymix(seed ^ _wyp[0], _wyp[1]);
+    if (len <= 16)
+    {
+        if (len >= 4)
+        {
+            a = (_wyr4(p, nocase) << 32) | _wyr4(p + ((len >> 3) << 2), nocase);
+            b = (_wyr4(p + len - 4, nocase) << 32) | _wyr4(p + len - 4 - ((len >> 3) << 2), nocase);
+        }
+        else if (len > 0)
+        {
+            a = _wyr3(p, len, nocase);
+            b = 0;
+        }
+        else
+        {
+            a = b = 0;
+        }
+    }
+    else
+    {
+        size_t i = len;
+
+        if (i > 48)
+        {
+            uint64_t see1 = seed, see2 = seed;
+            uint8_t folded[FOLD_BLOCK_SIZE];
+
+            do
+            {
+                //大小写不敏感时，先用当前 CPU 上最快的向量指令折叠整块
+                const uint8_t * q = p;
+                if (nocase)
+                {
+                    _foldCaseBlock(folded, p);
+                    q = folded;
+                }
+                seed = _wymix(_wyr8(q, 0) ^ _wyp[1], _wyr8(q + 8, 0) ^ seed);
+                see1 = _wymix(_wyr8(q + 16, 0) ^ _wyp[2], _wyr8(q + 24, 0) ^ see1);
+                see2 = _wymix(_wyr8(q + 32, 0) ^ _wyp[3], _wyr8(q + 40, 0) ^ see2);
+                p += 48;
+                i -= 48;
+            }
+            while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16)
+        {
+            seed = _wymix(_wyr8(p, nocase) ^ _wyp[1], _wyr8(p + 8, nocase) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        a = _wyr8(p + i - 16, nocase);
+        b = _wyr8(p + i - 8, nocase);
+    }
+
+    a ^= _wyp[1];
+    b ^= seed;
+    _wymum(&a, &b);
+
+    return _wymix(a ^ _wyp[0] ^ len, b ^ _wyp[1]);
+}
+
+uint64_t wyHash(const void * key, size_t len, uint64_t seed)
+{
+    return _wyHash(key, len, seed, 0);
+}
+
+uint64_t wyHashNoCase(const void * key, size_t len, uint64_t seed)
+{
+    return _wyHash(key, len, seed, 1);
+}
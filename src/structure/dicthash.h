@@ -0,0 +1,25 @@
+//
+// Created by Administrator on 2022/3/4.
+//
+
+#ifndef REDIS_DESIGN_DICTHASH_H
+#define REDIS_DESIGN_DICTHASH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * 字典使用的 64 位哈希函数族
+ *
+ * SipHash-1-3 ：带 128 位密钥的伪随机函数，可以抵御哈希洪水攻击，
+ *               用于来自不可信客户端的键。
+ * wyhash ：速度更快的非加密哈希，用于可信的键。
+ *
+ * 两者都提供大小写不敏感的版本，结果等于先将 ASCII 大写字母转换为小写再计算哈希。
+ */
+uint64_t sipHash13(const uint8_t * in, size_t inLen, const uint8_t * k);
+uint64_t sipHash13NoCase(const uint8_t * in, size_t inLen, const uint8_t * k);
+uint64_t wyHash(const void * key, size_t len, uint64_t seed);
+uint64_t wyHashNoCase(const void * key, size_t len, uint64_t seed);
+
+#endif //REDIS_DESIGN_DICTHASH_H
@@ -0,0 +1,754 @@
+//
+// Created by Administrator on 2022/3/4.
+//
+
+#include <string.h>
+#include <limits.h>
+
+#include "dictint.h"
+#include "zmalloc.h"
+#include "redisassert.h"
+
+static int _dictIntExpandIfNeeded(dictInt * d);
+static void _dictIntShrinkIfNeeded(dictInt * d);
+
+/**
+ * 64 位整数混合函数（splitmix64 的终结函数），先与种子异或
+ *
+ * 是 64 位整数上的双射，输入的每一位都会影响输出的每一位，
+ * 所以连续的 ID 、只有高位不同的键也能均匀地分布到各个槽中。
+ */
+static inline uint64_t _dictIntMix(uint64_t seed, uint64_t key)
+{
+    uint64_t x = key ^ seed;
+
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+/**
+ * 返回键在字典中的哈希值
+ *
+ * T = O(1)
+ *
+ * @param d 字典
+ * @param key 键
+ * @return 哈希值
+ */
+uint64_t dictIntHash(dictInt * d, uint64_t key)
+{
+    return _dictIntMix(d->seed, key);
+}
+
+/**
+ * 重置哈希表
+ */
+static void _dictIntReset(dictIntTable * ht)
+{
+    ht->entries = NULL;
+    ht->size = 0;
+    ht->sizeMask = 0;
+    ht->used = 0;
+}
+
+/**
+ * 创建一个新的整数键字典
+ *
+ * T = O(1)
+ *
+ * @return 新字典
+ */
+dictInt * dictIntCreate(void)
+{
+    dictInt * d = z_malloc(sizeof(dictInt));
+    uint8_t * seed = dictGetHashFunctionSeed();
+
+    _dictIntReset(&d->ht[0]);
+    _dictIntReset(&d->ht[1]);
+    d->rehashIndex = -1;
+    //使用种子的后 8 个字节，与通用字典的 wyhash 种子不同
+    memcpy(&d->seed, seed + 8, sizeof(d->seed));
+    d->iterators = 0;
+    d->hasZero = 0;
+    d->zero.key = 0;
+    d->zero.v.val = NULL;
+
+    return d;
+}
+
+/**
+ * 删除字典中的所有节点，释放哈希表
+ *
+ * T = O(1)
+ *
+ * @param d 字典
+ */
+void dictIntEmpty(dictInt * d)
+{
+    z_free(d->ht[0].entries);
+    z_free(d->ht[1].entries);
+    _dictIntReset(&d->ht[0]);
+    _dictIntReset(&d->ht[1]);
+    d->rehashIndex = -1;
+    d->hasZero = 0;
+}
+
+/**
+ * 释放字典，值由调用者负责释放
+ *
+ * T = O(1)
+ *
+ * @param d 字典
+ */
+void dictIntRelease(dictInt * d)
+{
+    dictIntEmpty(d);
+    z_free(d);
+}
+
+/* ------------------------------- 探测 ---------------------------------------*/
+
+/**
+ * 返回哈希表中可以探测的最小槽
+ *
+ * rehash 时 0 号哈希表 rehashIndex 之前的槽已经迁移完，都是空的，
+ * 剩下的槽构成一个从 rehashIndex 到表尾、再回到 rehashIndex 的环。
+ */
+static inline unsigned long _dictIntLow(dictInt * d, int table)
+{
+    return table == 0 && dictIntIsRehashing(d) ? (unsigned long)d->rehashIndex : 0;
+}
+
+/**
+ * 在哈希表中查找键，返回所在的槽，不存在时返回 -1
+ *
+ * 节点之前的槽在它被添加时都已经被占用，所以从起始槽开始向后探测，遇到空槽就可以停止。
+ * 起始槽在已经迁移的区域中时，从 rehashIndex 开始；回绕时跳过已经迁移的区域：
+ * 节点的探测路径中被迁移的槽都在 rehashIndex 之前，剩下的部分在环上仍然是连续的。
+ *
+ * T = O(1) ，期望
+ */
+static inline long _dictIntLookup(dictInt * d, int table, uint64_t key, uint64_t hash)
+{
+    dictIntTable * ht = &d->ht[table];
+    unsigned long low = _dictIntLow(d, table), idx, probes;
+
+    if (ht->used == 0) return -1;
+
+    idx = hash & ht->sizeMask;
+    if (idx < low) idx = low;
+
+    //rehash 接近完成时剩下的环可能全满，最多探测一圈
+    for (probes = ht->size - low; probes; probes--)
+    {
+        uint64_t k = ht->entries[idx].key;
+
+        if (k == key) return idx;
+        if (k == 0) return -1;
+
+        if (++idx == ht->size) idx = low;
+    }
+
+    return -1;
+}
+
+/**
+ * 把节点添加到哈希表中第一个空槽，调用者保证键不存在并且哈希表没有满
+ *
+ * T = O(1) ，期望
+ */
+static dictIntEntry * _dictIntInsert(dictInt * d, int table, uint64_t key, uint64_t hash)
+{
+    dictIntTable * ht = &d->ht[table];
+    unsigned long low = _dictIntLow(d, table), idx;
+
+    idx = hash & ht->sizeMask;
+    if (idx < low) idx = low;
+
+    while (ht->entries[idx].key != 0)
+        if (++idx == ht->size) idx = low;
+
+    ht->entries[idx].key = key;
+    ht->used++;
+    return &ht->entries[idx];
+}
+
+/**
+ * 删除哈希表中 idx 槽上的节点
+ *
+ * 不留墓碑，而是把之后同一簇中可以前移的节点移到空出的槽中（backward shift），
+ * 保证每个节点的探测路径上没有空槽。节点可以前移的条件是：
+ * 沿着环从它的起始槽出发，先经过空槽，再到达它当前所在的槽。
+ *
+ * T = O(1) ，期望
+ */
+static void _dictIntRemove(dictInt * d, int table, unsigned long idx)
+{
+    dictIntTable * ht = &d->ht[table];
+    unsigned long low = _dictIntLow(d, table), ring = ht->size - low, j = idx;
+
+    //先清空，环全满时转一圈回到这里也会停下
+    ht->entries[idx].key = 0;
+    while (1)
+    {
+        unsigned long home;
+        uint64_t k;
+
+        if (++j == ht->size) j = low;
+        if ((k = ht->entries[j].key) == 0) break;
+
+        home = _dictIntMix(d->seed, k) & ht->sizeMask;
+        if (home < low) home = low;
+
+        //比较在环上与起始槽的距离
+        if ((idx + ring - home) % ring < (j + ring - home) % ring)
+        {
+            ht->entries[idx] = ht->entries[j];
+            ht->entries[j].key = 0;
+            idx = j;
+        }
+    }
+
+    ht->used--;
+}
+
+/* ------------------------------- rehash -------------------------------------*/
+
+/**
+ * 计算第一个大于等于 size 的 2 的 N 次方
+ */
+static unsigned long _dictIntNextPower(unsigned long size)
+{
+    unsigned long i = DICT_INT_INITIAL_SIZE;
+
+    if (size >= LONG_MAX) return LONG_MAX + 1UL;
+    while (i < size)
+        i *= 2;
+    return i;
+}
+
+/**
+ * 创建一个至少可以容纳 size 个节点（负载不超过 DICT_INT_MAX_LOAD_PERCENT）的哈希表，
+ * 0 号哈希表为空时直接使用，否则作为 1 号哈希表开始渐进式 rehash
+ *
+ * T = O(N) ，N 为新哈希表的大小（清零）
+ *
+ * @param d 字典
+ * @param size 要容纳的节点数量
+ * @return 正在 rehash ，或者 size 小于已有的节点数量时返回 DICT_ERR ，否则返回 DICT_OK
+ */
+int dictIntExpand(dictInt * d, unsigned long size)
+{
+    dictIntTable n;
+    unsigned long used = d->ht[0].used + d->ht[1].used;
+
+    if (dictIntIsRehashing(d) || used > size)
+        return DICT_ERR;
+
+    n.size = _dictIntNextPower(size / DICT_INT_MAX_LOAD_PERCENT * 100 +
+                               size % DICT_INT_MAX_LOAD_PERCENT * 100 / DICT_INT_MAX_LOAD_PERCENT + 1);
+    n.sizeMask = n.size - 1;
+    n.entries = z_calloc(n.size * sizeof(dictIntEntry));
+    n.used = 0;
+
+    if (d->ht[0].entries == NULL)
+    {
+        d->ht[0] = n;
+    }
+    else
+    {
+        d->ht[1] = n;
+        d->rehashIndex = 0;
+    }
+
+    return DICT_OK;
+}
+
+/**
+ * 把哈希表收缩到刚好可以容纳所有节点的最小大小
+ *
+ * T = O(N)
+ *
+ * @param d 字典
+ * @return 正在 rehash 时返回 DICT_ERR ，否则返回 DICT_OK
+ */
+int dictIntResize(dictInt * d)
+{
+    unsigned long minimal = d->ht[0].used;
+
+    if (dictIntIsRehashing(d)) return DICT_ERR;
+    if (minimal < DICT_INT_INITIAL_SIZE * DICT_INT_MAX_LOAD_PERCENT / 100)
+        minimal = DICT_INT_INITIAL_SIZE * DICT_INT_MAX_LOAD_PERCENT / 100;
+
+    return dictIntExpand(d, minimal);
+}
+
+/**
+ * 执行 n 步渐进式 rehash ，每步迁移 0 号哈希表中一个非空的槽，与 dictRehash() 相同，
+ * 最多访问 n * 10 个空槽
+ *
+ * 从 rehashIndex 上迁移节点之后，0 号哈希表中后面的节点不需要移动：
+ * 查找总是从 rehashIndex 开始，它们的探测路径在剩下的环上仍然是连续的。
+ *
+ * T = O(N)
+ *
+ * @param d 字典
+ * @param n 步数
+ * @return 仍有节点需要迁移返回 1 ，否则返回 0
+ */
+int dictIntRehash(dictInt * d, int n)
+{
+    int emptyVisits = n * 10;
+
+    if (!dictIntIsRehashing(d)) return 0;
+
+    while (n-- && d->ht[0].used != 0)
+    {
+        dictIntEntry * e;
+
+        while ((e = &d->ht[0].entries[d->rehashIndex])->key == 0)
+        {
+            d->rehashIndex++;
+            if (--emptyVisits == 0) return 1;
+        }
+
+        //rehashIndex 先前移，1 号哈希表的插入不受影响
+        d->rehashIndex++;
+        d->ht[0].used--;
+        _dictIntInsert(d, 1, e->key, _dictIntMix(d->seed, e->key))->v = e->v;
+        e->key = 0;
+    }
+
+    //迁移完毕，1 号哈希表成为 0 号哈希表
+    if (d->ht[0].used == 0)
+    {
+        z_free(d->ht[0].entries);
+        d->ht[0] = d->ht[1];
+        _dictIntReset(&d->ht[1]);
+        d->rehashIndex = -1;
+        return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * 在给定毫秒数内，以 100 步为单位进行 rehash
+ *
+ * T = O(N)
+ *
+ * @param d 字典
+ * @param ms 毫秒数
+ * @return rehash 的步数
+ */
+int dictIntRehashMilliseconds(dictInt * d, int ms)
+{
+    long long start = timeInMilliseconds();
+    int rehashes = 0;
+
+    while (dictIntRehash(d, 100))
+    {
+        rehashes += 100;
+        if (timeInMilliseconds() - start > ms) break;
+    }
+
+    return rehashes;
+}
+
+/**
+ * 在没有迭代器时执行单步 rehash
+ */
+static inline void _dictIntRehashStep(dictInt * d)
+{
+    if (d->iterators == 0) dictIntRehash(d, 1);
+}
+
+/**
+ * 负载达到 DICT_INT_MAX_LOAD_PERCENT 时扩展为两倍
+ *
+ * 扩展之后 1 号哈希表的负载只有上限的一半，每次操作至少迁移一个节点，
+ * 所以 0 号哈希表迁移完之前 1 号哈希表的负载不会超过上限。
+ * 万一超过（比如刚调用 dictIntResize() 收缩到最小），先一次性完成 rehash 再扩展。
+ */
+static int _dictIntExpandIfNeeded(dictInt * d)
+{
+    unsigned long used = d->ht[0].used + d->ht[1].used;
+
+    if (dictIntIsRehashing(d))
+    {
+        if ((used + 1) * 100 <= d->ht[1].size * DICT_INT_MAX_LOAD_PERCENT || d->iterators)
+            return DICT_OK;
+        while (dictIntRehash(d, 100));
+    }
+
+    if (d->ht[0].size == 0) return dictIntExpand(d, DICT_INT_INITIAL_SIZE * DICT_INT_MAX_LOAD_PERCENT / 100);
+
+    if ((used + 1) * 100 > d->ht[0].size * DICT_INT_MAX_LOAD_PERCENT)
+        return dictIntExpand(d, used + 1);
+
+    return DICT_OK;
+}
+
+/**
+ * 负载低于 DICT_INT_MIN_LOAD_PERCENT 时开始收缩，收缩之后的负载为上限的一半左右，
+ * 不会因为少量添加就重新扩展
+ */
+static void _dictIntShrinkIfNeeded(dictInt * d)
+{
+    if (dictIntIsRehashing(d) || d->ht[0].size <= DICT_INT_INITIAL_SIZE) return;
+
+    if (d->ht[0].used * 100 < d->ht[0].size * DICT_INT_MIN_LOAD_PERCENT)
+        dictIntExpand(d, d->ht[0].used * 2);
+}
+
+/* ------------------------------- 增删查 -------------------------------------*/
+
+/**
+ * 查找键所在的节点
+ *
+ * T = O(1) ，期望
+ *
+ * @param d 字典
+ * @param key 键
+ * @return 节点，键不存在时返回 NULL
+ */
+dictIntEntry * dictIntFind(dictInt * d, uint64_t key)
+{
+    uint64_t hash;
+    long idx;
+    int table;
+
+    if (key == 0) return d->hasZero ? &d->zero : NULL;
+
+    hash = _dictIntMix(d->seed, key);
+
+    //没有 rehash 时只需要探测一个哈希表
+    if (!dictIntIsRehashing(d))
+    {
+        idx = _dictIntLookup(d, 0, key, hash);
+        return idx >= 0 ? &d->ht[0].entries[idx] : NULL;
+    }
+
+    _dictIntRehashStep(d);
+    for (table = 0; table <= 1; table++)
+    {
+        if ((idx = _dictIntLookup(d, table, key, hash)) >= 0)
+            return &d->ht[table].entries[idx];
+        if (!dictIntIsRehashing(d)) break;
+    }
+
+    return NULL;
+}
+
+/**
+ * 返回键的值
+ *
+ * T = O(1) ，期望
+ *
+ * @param d 字典
+ * @param key 键
+ * @return 值，键不存在时返回 NULL
+ */
+void * dictIntFetchValue(dictInt * d, uint64_t key)
+{
+    dictIntEntry * he = dictIntFind(d, key);
+
+    return he ? dictIntGetVal(he) : NULL;
+}
+
+/**
+ * 添加键，由调用者设置值
+ *
+ * T = O(1) ，期望
+ *
+ * @param d 字典
+ * @param key 键
+ * @return 新节点，键已经存在时返回 NULL
+ */
+dictIntEntry * dictIntAddRaw(dictInt * d, uint64_t key)
+{
+    uint64_t hash;
+    int table;
+
+    if (key == 0)
+    {
+        if (d->hasZero) return NULL;
+        d->hasZero = 1;
+        return &d->zero;
+    }
+
+    if (dictIntIsRehashing(d)) _dictIntRehashStep(d);
+
+    hash = _dictIntMix(d->seed, key);
+    for (table = 0; table <= 1; table++)
+    {
+        if (_dictIntLookup(d, table, key, hash) >= 0) return NULL;
+        if (!dictIntIsRehashing(d)) break;
+    }
+
+    if (_dictIntExpandIfNeeded(d) == DICT_ERR) return NULL;
+
+    //正在 rehash 时添加到 1 号哈希表
+    return _dictIntInsert(d, dictIntIsRehashing(d) ? 1 : 0, key, hash);
+}
+
+/**
+ * 添加键值对
+ *
+ * T = O(1) ，期望
+ *
+ * @param d 字典
+ * @param key 键
+ * @param val 值
+ * @return 添加成功返回 DICT_OK ，键已经存在返回 DICT_ERR
+ */
+int dictIntAdd(dictInt * d, uint64_t key, void * val)
+{
+    dictIntEntry * he = dictIntAddRaw(d, key);
+
+    if (he == NULL) return DICT_ERR;
+    dictIntSetVal(he, val);
+    return DICT_OK;
+}
+
+/**
+ * 添加键值对，键已经存在时覆盖它的值
+ *
+ * T = O(1) ，期望
+ *
+ * @param d 字典
+ * @param key 键
+ * @param val 值
+ * @return 新添加的键返回 1 ，覆盖已有的键返回 0
+ */
+int dictIntReplace(dictInt * d, uint64_t key, void * val)
+{
+    dictIntEntry * he;
+
+    if (dictIntAdd(d, key, val) == DICT_OK) return 1;
+
+    he = dictIntFind(d, key);
+    dictIntSetVal(he, val);
+    return 0;
+}
+
+/**
+ * 删除键
+ *
+ * T = O(1) ，期望
+ *
+ * @param d 字典
+ * @param key 键
+ * @return 删除成功返回 DICT_OK ，键不存在返回 DICT_ERR
+ */
+int dictIntDelete(dictInt * d, uint64_t key)
+{
+    uint64_t hash;
+    long idx;
+    int table;
+
+    if (key == 0)
+    {
+        if (!d->hasZero) return DICT_ERR;
+        d->hasZero = 0;
+        return DICT_OK;
+    }
+
+    if (dictIntIsRehashing(d)) _dictIntRehashStep(d);
+
+    hash = _dictIntMix(d->seed, key);
+    for (table = 0; table <= 1; table++)
+    {
+        if ((idx = _dictIntLookup(d, table, key, hash)) >= 0)
+        {
+            _dictIntRemove(d, table, idx);
+            //迭代期间不改变哈希表
+            if (d->iterators == 0) _dictIntShrinkIfNeeded(d);
+            return DICT_OK;
+        }
+        if (!dictIntIsRehashing(d)) break;
+    }
+
+    return DICT_ERR;
+}
+
+/* ------------------------------- 迭代 ---------------------------------------*/
+
+/**
+ * 创建迭代器
+ *
+ * T = O(1)
+ *
+ * @param d 字典
+ * @return 迭代器
+ */
+dictIntIterator * dictIntGetIterator(dictInt * d)
+{
+    dictIntIterator * iter = z_malloc(sizeof(dictIntIterator));
+
+    iter->d = d;
+    iter->table = -1;
+    iter->index = 0;
+    d->iterators++;
+
+    return iter;
+}
+
+/**
+ * 返回迭代器的下一个节点
+ *
+ * T = O(1) ，均摊
+ *
+ * @param iter 迭代器
+ * @return 节点，迭代完毕时返回 NULL
+ */
+dictIntEntry * dictIntNext(dictIntIterator * iter)
+{
+    dictInt * d = iter->d;
+
+    if (iter->table == -1)
+    {
+        iter->table = 0;
+        iter->index = _dictIntLow(d, 0);
+        if (d->hasZero) return &d->zero;
+    }
+
+    while (iter->table <= 1)
+    {
+        dictIntTable * ht = &d->ht[iter->table];
+
+        while (iter->index < ht->size)
+        {
+            dictIntEntry * he = &ht->entries[iter->index++];
+
+            if (he->key != 0) return he;
+        }
+
+        iter->table++;
+        iter->index = 0;
+    }
+
+    return NULL;
+}
+
+/**
+ * 释放迭代器
+ *
+ * T = O(1)
+ *
+ * @param iter 迭代器
+ */
+void dictIntReleaseIterator(dictIntIterator * iter)
+{
+    iter->d->iterators--;
+    z_free(iter);
+}
+
+#ifdef DICT_INT_BENCHMARK_MAIN
+/* 基准测试：与以 void * 保存整数键的通用字典比较添加、命中查找、未命中查找和删除的速度
+ *
+ * gcc -O2 -DDICT_INT_BENCHMARK_MAIN -I../other dictint.c dict.c dicthash.c dictslab.c ../other/zmalloc.c -lpthread -lm
+ * ./a.out [键的数量]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+void _redisAssert(char * estr, char * file, int line)
+{
+    fprintf(stderr, "=== ASSERTION FAILED ===\n==> %s:%d '%s' is not true\n", file, line, estr);
+}
+
+static long long benchUsec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((long long)ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint64_t benchHashInt(const void * key)
+{
+    return dictGenHashFunction(&key, sizeof(key));
+}
+
+static dictType benchIntType = {
+    benchHashInt,           /* hash function */
+    NULL,                   /* key dup */
+    NULL,                   /* val dup */
+    NULL,                   /* key compare */
+    NULL,                   /* key destructor */
+    NULL,                   /* val destructor */
+    0,                      /* flags */
+    NULL,                   /* embed key len */
+    NULL,                   /* embed key */
+    NULL                    /* key bytes */
+};
+
+static uint64_t benchRandom(uint64_t * state)
+{
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+#define BENCH_RUN(label, expr)                                                  \
+    do {                                                                        \
+        long long _start = benchUsec();                                         \
+        for (i = 0; i < n; i++) { expr; }                                       \
+        _elapsed = benchUsec() - _start;                                        \
+        printf("  %-14s %8.1f ns/op\n", label, _elapsed * 1000.0 / n);          \
+    } while (0)
+
+int main(int argc, char ** argv)
+{
+    unsigned long n = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000, i, found = 0;
+    uint64_t * keys = z_malloc(sizeof(uint64_t) * n), * misses = z_malloc(sizeof(uint64_t) * n);
+    uint64_t state = 42;
+    long long _elapsed, generic[4], flat[4];
+    dict * d = dictCreate(&benchIntType, NULL);
+    dictInt * di = dictIntCreate();
+
+    for (i = 0; i < n; i++)
+    {
+        keys[i] = benchRandom(&state) | 1;
+        misses[i] = benchRandom(&state) & ~1ULL;
+    }
+
+    printf("generic dict, %lu keys\n", n);
+    BENCH_RUN("add", dictAdd(d, (void *)keys[i], NULL));
+    generic[0] = _elapsed;
+    //查找在 rehash 完成之后进行，比较的是稳定状态
+    while (dictRehash(d, 100));
+    BENCH_RUN("find (hit)", found += dictFind(d, (void *)keys[n - 1 - i]) != NULL);
+    generic[1] = _elapsed;
+    BENCH_RUN("find (miss)", found += dictFind(d, (void *)misses[i]) != NULL);
+    generic[2] = _elapsed;
+    BENCH_RUN("delete", dictDelete(d, (void *)keys[i]));
+    generic[3] = _elapsed;
+
+    printf("dictInt, %lu keys\n", n);
+    BENCH_RUN("add", dictIntAdd(di, keys[i], NULL));
+    flat[0] = _elapsed;
+    while (dictIntRehash(di, 100));
+    BENCH_RUN("find (hit)", found += dictIntFind(di, keys[n - 1 - i]) != NULL);
+    flat[1] = _elapsed;
+    BENCH_RUN("find (miss)", found += dictIntFind(di, misses[i]) != NULL);
+    flat[2] = _elapsed;
+    BENCH_RUN("delete", dictIntDelete(di, keys[i]));
+    flat[3] = _elapsed;
+
+    printf("speedup: add %.2fx, find hit %.2fx, find miss %.2fx, delete %.2fx (found %lu)\n",
+           (double)generic[0] / flat[0], (double)generic[1] / flat[1],
+           (double)generic[2] / flat[2], (double)generic[3] / flat[3], found);
+
+    dictRelease(d);
+    dictIntRelease(di);
+    z_free(keys);
+    z_free(misses);
+    return 0;
+}
+#endif
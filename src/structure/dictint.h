@@ -0,0 +1,124 @@
+//
+// Created by Administrator on 2022/3/4.
+//
+
+#ifndef REDIS_DESIGN_DICTINT_H
+#define REDIS_DESIGN_DICTINT_H
+
+#include <stdint.h>
+
+#include "dict.h"
+
+/**
+ * 哈希表的初始大小
+ */
+#define DICT_INT_INITIAL_SIZE 16
+
+/**
+ * 负载（节点数量占槽的数量的百分比）达到这个值时扩展，线性探测在更高的负载下探测长度增长很快
+ */
+#define DICT_INT_MAX_LOAD_PERCENT 75
+
+/**
+ * 负载低于这个值时收缩
+ */
+#define DICT_INT_MIN_LOAD_PERCENT 10
+
+/**
+ * 整数键字典的节点，直接保存在哈希表的槽中
+ *
+ * 键为 0 表示槽为空，键为 0 的节点保存在字典结构中，不占用槽
+ */
+typedef struct dictIntEntry
+{
+    uint64_t key;   //键
+    union {
+        void * val;
+        uint64_t u64;
+        int64_t s64;
+        double d;
+    } v;            //值
+} dictIntEntry;
+
+/**
+ * 开放寻址的哈希表
+ */
+typedef struct dictIntTable
+{
+    dictIntEntry * entries;     //槽数组
+    unsigned long size;         //槽的数量，总是 2 的幂
+    unsigned long sizeMask;     //size - 1
+    unsigned long used;         //已有节点数量
+} dictIntTable;
+
+/**
+ * 以 uint64_t 为键的字典
+ *
+ * 与通用字典的区别：
+ * 1）键和值直接保存在槽数组中，添加节点不分配内存；
+ * 2）用线性探测解决冲突，删除时把后面的节点向前移动（backward shift），不留墓碑；
+ * 3）哈希函数固定为带种子的 64 位整数混合函数，没有 keyCompare / keyDup 等回调，
+ *    也不释放值，值由调用者管理。
+ *
+ * rehash 与通用字典相同，是渐进式的：扩展或收缩时分配 1 号哈希表，
+ * 之后每次操作把 0 号哈希表的一个槽迁移到 1 号哈希表，新节点总是添加到 1 号哈希表。
+ * 0 号哈希表中 rehashIndex 之前的槽已经迁移完，查找时跳过这些槽。
+ *
+ * 注意：节点会在 rehash 和删除时移动，dictIntFind() 等返回的节点指针只在下一次修改字典之前有效。
+ */
+typedef struct dictInt
+{
+    dictIntTable ht[2];     //哈希表
+    long rehashIndex;       //rehash 的进度，为 -1 表示没有在 rehash
+    uint64_t seed;          //哈希函数的种子，创建字典时从 dictGetHashFunctionSeed() 取得
+    int iterators;          //正在运行的迭代器数量，不为 0 时不进行单步 rehash
+    int hasZero;            //是否有键为 0 的节点
+    dictIntEntry zero;      //键为 0 的节点
+} dictInt;
+
+/**
+ * 整数键字典的迭代器
+ *
+ * 迭代期间暂停单步 rehash ，可以修改节点的值，但不能添加或删除节点
+ */
+typedef struct dictIntIterator
+{
+    dictInt * d;
+    int table;              //正在迭代的哈希表，-1 表示还没有返回键为 0 的节点
+    unsigned long index;    //下一个要检查的槽
+} dictIntIterator;
+
+/* 宏 */
+#define dictIntGetKey(he) ((he)->key)
+#define dictIntGetVal(he) ((he)->v.val)
+#define dictIntGetSignedIntegerVal(he) ((he)->v.s64)
+#define dictIntGetUnsignedIntegerVal(he) ((he)->v.u64)
+#define dictIntGetDoubleVal(he) ((he)->v.d)
+#define dictIntSetVal(he, _val_) do { (he)->v.val = (_val_); } while(0)
+#define dictIntSetSignedIntegerVal(he, _val_) do { (he)->v.s64 = (_val_); } while(0)
+#define dictIntSetUnsignedIntegerVal(he, _val_) do { (he)->v.u64 = (_val_); } while(0)
+#define dictIntSetDoubleVal(he, _val_) do { (he)->v.d = (_val_); } while(0)
+#define dictIntSlots(d) ((d)->ht[0].size + (d)->ht[1].size)
+#define dictIntSize(d) ((d)->ht[0].used + (d)->ht[1].used + (d)->hasZero)
+#define dictIntIsRehashing(d) ((d)->rehashIndex != -1)
+
+/* API */
+dictInt * dictIntCreate(void);
+void dictIntRelease(dictInt * d);
+void dictIntEmpty(dictInt * d);
+int dictIntExpand(dictInt * d, unsigned long size);
+int dictIntResize(dictInt * d);
+int dictIntAdd(dictInt * d, uint64_t key, void * val);
+dictIntEntry * dictIntAddRaw(dictInt * d, uint64_t key);
+int dictIntReplace(dictInt * d, uint64_t key, void * val);
+int dictIntDelete(dictInt * d, uint64_t key);
+dictIntEntry * dictIntFind(dictInt * d, uint64_t key);
+void * dictIntFetchValue(dictInt * d, uint64_t key);
+int dictIntRehash(dictInt * d, int n);
+int dictIntRehashMilliseconds(dictInt * d, int ms);
+dictIntIterator * dictIntGetIterator(dictInt * d);
+dictIntEntry * dictIntNext(dictIntIterator * iter);
+void dictIntReleaseIterator(dictIntIterator * iter);
+uint64_t dictIntHash(dictInt * d, uint64_t key);
+
+#endif //REDIS_DESIGN_DICTINT_H
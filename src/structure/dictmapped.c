@@ -0,0 +1,591 @@
+//
+// Created by Administrator on 2022/3/4.
+//
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "dictmapped.h"
+#include "dicthash.h"
+#include "zmalloc.h"
+#include "redisassert.h"
+
+/**
+ * dictSave() 的写缓冲区大小
+ */
+#define DICT_SAVE_BUFFER_SIZE (1024 * 1024)
+
+//覆盖层中表示键已经被删除的值
+static char dict_mapped_tombstone;
+#define DICT_MAPPED_TOMBSTONE ((void *)&dict_mapped_tombstone)
+
+/* ---------------------------------- 写文件 ----------------------------------*/
+
+/**
+ * 等待写入文件的节点
+ */
+typedef struct dictSaveItem
+{
+    uint64_t hash;  //键的哈希值
+    sds key;        //键
+    sds val;        //值
+} dictSaveItem;
+
+/**
+ * 带缓冲区的顺序写入
+ */
+typedef struct dictSaveWriter
+{
+    int fd;         //目标文件
+    char * buf;     //缓冲区
+    size_t len;     //缓冲区中的字节数
+    int err;        //是否发生过写错误，发生之后不再写入
+} dictSaveWriter;
+
+/**
+ * 把 n 向上取整为 8 的倍数
+ */
+static inline size_t _dictFileAlign(size_t n)
+{
+    return (n + 7) & ~(size_t)7;
+}
+
+/**
+ * 返回节点在文件中占用的字节数
+ */
+static size_t _dictFileEntrySize(const dictSaveItem * item)
+{
+    size_t n = _dictFileAlign(sizeof(dictFileEntry) + sds_len(item->key) + 1);
+
+    if (item->val)
+        n += _dictFileAlign(sizeof(struct sds_str) + sds_len(item->val) + 1);
+
+    return n;
+}
+
+/**
+ * 把缓冲区中的内容写入文件，处理部分写入和被信号中断的情况
+ */
+static void _dictSaveFlush(dictSaveWriter * w)
+{
+    size_t done = 0;
+
+    while (!w->err && done < w->len)
+    {
+        ssize_t n = write(w->fd, w->buf + done, w->len - done);
+
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0)
+            w->err = 1;
+        else
+            done += n;
+    }
+    w->len = 0;
+}
+
+/**
+ * 写入 len 字节，p 为 NULL 时写入 0
+ */
+static void _dictSaveWrite(dictSaveWriter * w, const void * p, size_t len)
+{
+    while (len)
+    {
+        size_t n = DICT_SAVE_BUFFER_SIZE - w->len;
+
+        if (n > len) n = len;
+        if (p)
+        {
+            memcpy(w->buf + w->len, p, n);
+            p = (const char *)p + n;
+        }
+        else
+        {
+            memset(w->buf + w->len, 0, n);
+        }
+        w->len += n;
+        len -= n;
+        if (w->len == DICT_SAVE_BUFFER_SIZE)
+            _dictSaveFlush(w);
+    }
+}
+
+/**
+ * 按 sds 的布局写入字符串 s ，并补齐到 8 字节
+ */
+static void _dictSaveString(dictSaveWriter * w, const sds s)
+{
+    struct sds_str hdr;
+    size_t len = sds_len(s);
+
+    hdr.len = (int)len;
+    hdr.free = 0;
+    _dictSaveWrite(w, &hdr, sizeof(hdr));
+    _dictSaveWrite(w, s, len);
+    _dictSaveWrite(w, NULL, _dictFileAlign(sizeof(hdr) + len + 1) - sizeof(hdr) - len);
+}
+
+/**
+ * 把字典保存为可以被 dictLoadMapped() 直接映射的文件
+ *
+ * 字典的键和值都必须是 sds ，值可以为 NULL 。
+ * 文件中的桶数组按键的数量重新计算大小，节点按桶的顺序存放，同一个桶的节点相邻。
+ * 桶的索引由 wyhash 和保存时的进程哈希种子计算，种子写入文件头，
+ * 所以加载文件的进程即使使用了不同的哈希种子，也可以直接查找。
+ *
+ * 保存期间不能修改字典。fd 必须位于一个空文件的开头，函数不调用 fsync() 。
+ *
+ * T = O(N)
+ *
+ * @param d 要保存的字典
+ * @param fd 目标文件
+ * @return 保存成功返回 DICT_OK ，写文件失败返回 DICT_ERR
+ */
+int dictSave(dict * d, int fd)
+{
+    unsigned long used = dictSize(d), size = dictNextPower(used), i, n = 0;
+    dictSaveItem * items = z_malloc(sizeof(dictSaveItem) * (used + 1));
+    dictSaveItem * sorted = z_malloc(sizeof(dictSaveItem) * (used + 1));
+    uint64_t * buckets = z_calloc(sizeof(uint64_t) * (size + 1)), off;
+    dictSaveWriter w = { fd, z_malloc(DICT_SAVE_BUFFER_SIZE), 0, 0 };
+    dictFileHeader hdr;
+    dictIterator * di;
+    dictEntry * de;
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, DICT_FILE_MAGIC, sizeof(hdr.magic));
+    hdr.version = DICT_FILE_VERSION;
+    hdr.byteOrder = DICT_FILE_BYTE_ORDER;
+    memcpy(&hdr.seed, dictGetHashFunctionSeed(), sizeof(hdr.seed));
+    hdr.size = size;
+    hdr.used = used;
+    hdr.buckets = sizeof(dictFileHeader);
+
+    //计算哈希值，并统计每个桶的节点数量
+    di = dictGetIterator(d);
+    while ((de = dictNext(di)) != NULL)
+    {
+        dictSaveItem * item = &items[n++];
+
+        item->key = dictGetKey(de);
+        item->val = dictGetVal(de);
+        item->hash = wyHash(item->key, sds_len(item->key), hdr.seed);
+        buckets[(item->hash & (size - 1)) + 1]++;
+    }
+    dictReleaseIterator(di);
+    assert(n == used);
+
+    //按桶排序（计数排序），buckets[b] 变为桶 b 的第一个节点在 sorted 中的位置
+    for (i = 0; i < size; i++)
+        buckets[i + 1] += buckets[i];
+    for (i = 0; i < n; i++)
+        sorted[buckets[items[i].hash & (size - 1)]++] = items[i];
+    //排序之后 buckets[b] 是桶 b + 1 的起始位置，移回一位
+    memmove(buckets + 1, buckets, sizeof(uint64_t) * size);
+    buckets[0] = 0;
+
+    //把桶的起始位置换算成第一个节点在文件中的偏移量，空桶为 0
+    off = hdr.buckets + sizeof(uint64_t) * size;
+    for (i = 0; i < size; i++)
+    {
+        unsigned long j, begin = buckets[i], end = buckets[i + 1];
+
+        buckets[i] = begin < end ? off : 0;
+        for (j = begin; j < end; j++)
+            off += _dictFileEntrySize(&sorted[j]);
+    }
+    hdr.fileSize = off;
+
+    _dictSaveWrite(&w, &hdr, sizeof(hdr));
+    _dictSaveWrite(&w, buckets, sizeof(uint64_t) * size);
+
+    //写入节点，同一个桶中的节点依次相连
+    off = hdr.buckets + sizeof(uint64_t) * size;
+    for (i = 0; i < n; i++)
+    {
+        dictSaveItem * item = &sorted[i];
+        size_t entrySize = _dictFileEntrySize(item);
+        dictFileEntry fe;
+
+        fe.next = 0;
+        if (i + 1 < n && (sorted[i + 1].hash & (size - 1)) == (item->hash & (size - 1)))
+            fe.next = off + entrySize;
+        fe.hash = item->hash;
+        fe.val = item->val ? off + _dictFileAlign(sizeof(dictFileEntry) + sds_len(item->key) + 1)
+                             + sizeof(struct sds_str) : 0;
+        fe.keyLen = (int32_t)sds_len(item->key);
+        fe.keyFree = 0;
+        _dictSaveWrite(&w, &fe, sizeof(fe));
+        _dictSaveWrite(&w, item->key, sds_len(item->key));
+        _dictSaveWrite(&w, NULL, _dictFileAlign(sizeof(fe) + sds_len(item->key) + 1) - sizeof(fe) - sds_len(item->key));
+        if (item->val)
+            _dictSaveString(&w, item->val);
+        off += entrySize;
+    }
+    _dictSaveFlush(&w);
+
+    z_free(w.buf);
+    z_free(buckets);
+    z_free(sorted);
+    z_free(items);
+
+    return w.err ? DICT_ERR : DICT_OK;
+}
+
+/* ---------------------------------- 映射文件 ----------------------------------*/
+
+static uint64_t _dictMappedHash(const void * key)
+{
+    return dictGenHashFunction(key, sds_len((sds)key));
+}
+
+static void * _dictMappedKeyDup(void * privData, const void * key)
+{
+    DICT_NOT_USED(privData);
+    return sds_new_len(key, sds_len((sds)key));
+}
+
+static int _dictMappedKeyCompare(void * privData, const void * key1, const void * key2)
+{
+    size_t len = sds_len((sds)key1);
+
+    DICT_NOT_USED(privData);
+    return len == sds_len((sds)key2) && memcmp(key1, key2, len) == 0;
+}
+
+static void _dictMappedKeyDestructor(void * privData, void * key)
+{
+    DICT_NOT_USED(privData);
+    sds_free(key);
+}
+
+static void _dictMappedValDestructor(void * privData, void * val)
+{
+    DICT_NOT_USED(privData);
+    if (val && val != DICT_MAPPED_TOMBSTONE)
+        sds_free(val);
+}
+
+/**
+ * 覆盖层字典的类型，键在添加时复制，值由覆盖层接管
+ */
+static dictType dictMappedOverlayType = {
+    _dictMappedHash,                /* hash function */
+    _dictMappedKeyDup,              /* key dup */
+    NULL,                           /* val dup */
+    _dictMappedKeyCompare,          /* key compare */
+    _dictMappedKeyDestructor,       /* key destructor */
+    _dictMappedValDestructor,       /* val destructor */
+    0,                              /* flags */
+    NULL,                           /* embed key len */
+    NULL,                           /* embed key */
+    NULL                            /* key bytes */
+};
+
+/**
+ * 检查映射的文件头，文件不完整或者来自字节序不同的主机时返回 0
+ *
+ * 桶数组必须完整地位于文件之内，每个节点至少占用 sizeof(dictFileEntry) + 1 字节（补齐到 8 字节），
+ * 所以 used 不能超过桶数组之后剩下的空间能容纳的节点数量。
+ * 各项检查都先确认被减数不小于减数，文件头中的任何值都不会让计算溢出。
+ */
+static int _dictMappedValidate(const char * base, size_t mapSize)
+{
+    const dictFileHeader * hdr = (const dictFileHeader *)base;
+    uint64_t entries;
+
+    if (mapSize < sizeof(dictFileHeader)) return 0;
+    if (memcmp(hdr->magic, DICT_FILE_MAGIC, sizeof(hdr->magic)) != 0) return 0;
+    if (hdr->version != DICT_FILE_VERSION || hdr->byteOrder != DICT_FILE_BYTE_ORDER) return 0;
+    if (hdr->fileSize != mapSize) return 0;
+    if (hdr->size == 0 || (hdr->size & (hdr->size - 1)) != 0) return 0;
+    if (hdr->buckets < sizeof(dictFileHeader) || (hdr->buckets & 7) != 0) return 0;
+    if (hdr->buckets > mapSize) return 0;
+    if (hdr->size > (mapSize - hdr->buckets) / sizeof(uint64_t)) return 0;
+
+    entries = hdr->buckets + sizeof(uint64_t) * hdr->size;
+    if (hdr->used > (mapSize - entries) / _dictFileAlign(sizeof(dictFileEntry) + 1)) return 0;
+
+    return 1;
+}
+
+/**
+ * 映射 dictSave() 保存的文件
+ *
+ * 文件以 MAP_PRIVATE 的方式只读映射，加载时只检查文件头，不读取桶数组和节点，
+ * 所以加载的耗时与键的数量无关，之后的查找只会为用到的页触发缺页。
+ * 同一个文件可以被多个进程同时映射，未修改的页在进程之间共享页缓存。
+ *
+ * T = O(1)
+ *
+ * @param path 文件路径
+ * @return 成功返回映射的字典，文件无法打开或者格式不正确时返回 NULL
+ */
+dictMapped * dictLoadMapped(const char * path)
+{
+    struct stat st;
+    dictMapped * dm;
+    void * base;
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0) return NULL;
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(dictFileHeader))
+    {
+        close(fd);
+        return NULL;
+    }
+    base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    //映射建立之后文件描述符就不再需要了
+    close(fd);
+    if (base == MAP_FAILED) return NULL;
+    if (!_dictMappedValidate(base, st.st_size))
+    {
+        munmap(base, st.st_size);
+        return NULL;
+    }
+    //查找是随机访问，预读只会带入用不到的页
+    madvise(base, st.st_size, MADV_RANDOM);
+
+    dm = z_malloc(sizeof(*dm));
+    dm->base = base;
+    dm->mapSize = st.st_size;
+    dm->header = base;
+    dm->buckets = (const uint64_t *)(dm->base + dm->header->buckets);
+    dm->overlay = dictCreate(&dictMappedOverlayType, NULL);
+    dm->used = dm->header->used;
+
+    return dm;
+}
+
+/**
+ * 解除映射并释放覆盖层，之前取得的键和值都不能再使用
+ *
+ * T = O(M) ，M 为覆盖层中的键的数量
+ */
+void dictMappedRelease(dictMapped * dm)
+{
+    dictRelease(dm->overlay);
+    munmap((void *)dm->base, dm->mapSize);
+    z_free(dm);
+}
+
+/**
+ * 返回文件中偏移量为 off 的节点，节点不完整时认为文件已经损坏，返回 NULL
+ *
+ * 检查节点头、键和值（包括值的 sds 头）都完整地位于文件之内，并且 off 按 8 字节对齐。
+ * dictSave() 按偏移量递增的顺序写入同一个桶中的节点，
+ * 所以要求 off 不小于 min ，遍历时把 min 设为上一个节点的结尾，损坏的 next 就不会形成环。
+ *
+ * @param dm 映射的字典
+ * @param off 节点的偏移量
+ * @param min 允许的最小偏移量
+ * @return 节点，或者 NULL
+ */
+static const dictFileEntry * _dictMappedEntryAt(dictMapped * dm, uint64_t off, uint64_t min)
+{
+    const dictFileEntry * fe;
+    const struct sds_str * v;
+
+    if (off < min || (off & 7) != 0) return NULL;
+    if (off > dm->mapSize - sizeof(dictFileEntry)) return NULL;
+    fe = (const dictFileEntry *)(dm->base + off);
+    if (fe->keyLen < 0 || (uint64_t)fe->keyLen >= dm->mapSize - off - sizeof(dictFileEntry)) return NULL;
+    if (fe->key[fe->keyLen] != '\0') return NULL;
+    if (fe->val == 0) return fe;
+
+    if (fe->val < sizeof(struct sds_str) || fe->val > dm->mapSize || (fe->val & 7) != 0) return NULL;
+    v = (const struct sds_str *)(dm->base + fe->val - sizeof(struct sds_str));
+    if (v->len < 0 || (uint64_t)v->len >= dm->mapSize - fe->val) return NULL;
+    if (v->buf[v->len] != '\0') return NULL;
+
+    return fe;
+}
+
+/**
+ * 返回文件中第一个节点可能的偏移量，即桶数组的结尾
+ */
+static inline uint64_t _dictMappedEntriesStart(dictMapped * dm)
+{
+    return dm->header->buckets + sizeof(uint64_t) * dm->header->size;
+}
+
+/**
+ * 在映射的文件中查找键，节点损坏时认为文件已经损坏，返回 NULL
+ */
+static const dictFileEntry * _dictMappedFileFind(dictMapped * dm, const sds key)
+{
+    size_t len = sds_len(key);
+    uint64_t h = wyHash(key, len, dm->header->seed);
+    uint64_t off = dm->buckets[h & (dm->header->size - 1)];
+    uint64_t min = _dictMappedEntriesStart(dm);
+
+    while (off)
+    {
+        const dictFileEntry * fe = _dictMappedEntryAt(dm, off, min);
+
+        if (fe == NULL) return NULL;
+        if (fe->hash == h && (size_t)fe->keyLen == len && memcmp(fe->key, key, len) == 0)
+            return fe;
+        min = off + sizeof(dictFileEntry) + fe->keyLen + 1;
+        off = fe->next;
+    }
+
+    return NULL;
+}
+
+/**
+ * 返回文件节点的值
+ */
+static inline sds _dictMappedFileVal(dictMapped * dm, const dictFileEntry * fe)
+{
+    return fe->val ? (sds)(dm->base + fe->val) : NULL;
+}
+
+/**
+ * 查找键对应的值，先查找覆盖层，覆盖层中没有的键再到文件中查找
+ *
+ * 取得的值是只读的，不能修改或者释放：值可能直接指向映射的文件，
+ * 在该键被替换或删除、或者 dictMappedRelease() 之后失效。
+ *
+ * T = O(1)
+ *
+ * @param dm 映射的字典
+ * @param key 键
+ * @param val 保存值，可以为 NULL
+ * @return 找到返回 DICT_OK ，没找到返回 DICT_ERR
+ */
+int dictMappedFetch(dictMapped * dm, const sds key, sds * val)
+{
+    const dictFileEntry * fe;
+    dictEntry * de;
+
+    if ((de = dictFind(dm->overlay, key)) != NULL)
+    {
+        if (dictGetVal(de) == DICT_MAPPED_TOMBSTONE) return DICT_ERR;
+        if (val) *val = dictGetVal(de);
+        return DICT_OK;
+    }
+    if ((fe = _dictMappedFileFind(dm, key)) == NULL) return DICT_ERR;
+    if (val) *val = _dictMappedFileVal(dm, fe);
+
+    return DICT_OK;
+}
+
+/**
+ * 设置键的值，只有这个键会被复制到覆盖层中，文件本身不会被修改
+ *
+ * 键会被复制，值由字典接管，val 可以为 NULL 。
+ *
+ * T = O(1)
+ *
+ * @param dm 映射的字典
+ * @param key 键
+ * @param val 值
+ * @return 键原来不存在返回 1 ，键已经存在、值被替换返回 0
+ */
+int dictMappedReplace(dictMapped * dm, const sds key, sds val)
+{
+    dictEntry * de = dictFind(dm->overlay, key);
+    int existed;
+
+    if (de)
+        existed = dictGetVal(de) != DICT_MAPPED_TOMBSTONE;
+    else
+        existed = _dictMappedFileFind(dm, key) != NULL;
+    dictReplace(dm->overlay, key, val);
+    if (!existed) dm->used++;
+
+    return !existed;
+}
+
+/**
+ * 删除键
+ *
+ * 文件中的键在覆盖层中留下墓碑，只存在于覆盖层中的键直接从覆盖层中删除。
+ *
+ * T = O(1)
+ *
+ * @param dm 映射的字典
+ * @param key 键
+ * @return 删除成功返回 DICT_OK ，键不存在返回 DICT_ERR
+ */
+int dictMappedDelete(dictMapped * dm, const sds key)
+{
+    dictEntry * de = dictFind(dm->overlay, key);
+    int inFile = _dictMappedFileFind(dm, key) != NULL;
+
+    if (de ? dictGetVal(de) == DICT_MAPPED_TOMBSTONE : !inFile) return DICT_ERR;
+    if (inFile)
+        dictReplace(dm->overlay, key, DICT_MAPPED_TOMBSTONE);
+    else
+        dictDelete(dm->overlay, key);
+    dm->used--;
+
+    return DICT_OK;
+}
+
+/**
+ * 返回键值对的数量
+ *
+ * T = O(1)
+ */
+unsigned long dictMappedSize(dictMapped * dm)
+{
+    return dm->used;
+}
+
+/**
+ * 返回覆盖层中的键的数量（包括墓碑），即被复制到内存中的键的数量
+ *
+ * T = O(1)
+ */
+unsigned long dictMappedOverlaySize(dictMapped * dm)
+{
+    return dictSize(dm->overlay);
+}
+
+/**
+ * 遍历所有键值对
+ *
+ * 先按桶的顺序遍历文件中未被覆盖的键，再遍历覆盖层中的键，遍历期间不能修改字典。
+ *
+ * T = O(N)
+ *
+ * @param dm 映射的字典
+ * @param fn 回调函数
+ * @param privData 传给回调函数的私有数据
+ */
+void dictMappedIterate(dictMapped * dm, dictMappedIterateFunction * fn, void * privData)
+{
+    unsigned long i, checkOverlay = dictSize(dm->overlay) != 0;
+    dictIterator * di;
+    dictEntry * de;
+
+    for (i = 0; i < dm->header->size; i++)
+    {
+        uint64_t off = dm->buckets[i], min = _dictMappedEntriesStart(dm);
+        const dictFileEntry * fe;
+
+        //遇到损坏的节点时跳过这个桶剩下的节点
+        while (off && (fe = _dictMappedEntryAt(dm, off, min)) != NULL)
+        {
+            sds key = (sds)fe->key;
+
+            if (!checkOverlay || dictFind(dm->overlay, key) == NULL)
+                fn(privData, key, _dictMappedFileVal(dm, fe));
+            min = off + sizeof(dictFileEntry) + fe->keyLen + 1;
+            off = fe->next;
+        }
+    }
+
+    di = dictGetIterator(dm->overlay);
+    while ((de = dictNext(di)) != NULL)
+    {
+        if (dictGetVal(de) != DICT_MAPPED_TOMBSTONE)
+            fn(privData, dictGetKey(de), dictGetVal(de));
+    }
+    dictReleaseIterator(di);
+}
@@ -0,0 +1,94 @@
+//
+// Created by Administrator on 2022/3/4.
+//
+
+#ifndef REDIS_DESIGN_DICTMAPPED_H
+#define REDIS_DESIGN_DICTMAPPED_H
+
+#include <stdint.h>
+
+#include "dict.h"
+#include "sds.h"
+
+/**
+ * 字典文件的魔数和版本
+ */
+#define DICT_FILE_MAGIC "DICTMAP1"
+#define DICT_FILE_VERSION 1
+
+/**
+ * 写入文件的主机的字节序标记，字节序不同的主机不能直接映射文件
+ */
+#define DICT_FILE_BYTE_ORDER 0x01020304
+
+/**
+ * 字典文件的文件头
+ *
+ * 文件的布局：文件头、桶数组、节点。文件中不保存指针，所有位置都是相对于文件开头的偏移量，
+ * 所以文件可以被映射到任意地址，映射之后不需要任何修正就可以直接查找。
+ */
+typedef struct dictFileHeader
+{
+    char magic[8];          //DICT_FILE_MAGIC
+    uint32_t version;       //DICT_FILE_VERSION
+    uint32_t byteOrder;     //DICT_FILE_BYTE_ORDER
+    uint64_t seed;          //计算桶的索引使用的 wyhash 种子，与进程的哈希种子无关
+    uint64_t size;          //桶的数量，总是 2 的幂
+    uint64_t used;          //节点的数量
+    uint64_t buckets;       //桶数组的偏移量，每个桶是该桶第一个节点的偏移量，0 表示空桶
+    uint64_t fileSize;      //文件的总字节数
+    uint64_t reserved;
+} dictFileHeader;
+
+/**
+ * 字典文件中的节点
+ *
+ * 同一个桶的节点在文件中连续存放，查找时只会访问相邻的页。
+ * 键紧跟在 keyLen 和 keyFree 之后，三者的布局与 struct sds_str 相同，
+ * 所以 key 可以直接作为只读的 sds 使用；值以同样的布局存放在键之后，按 8 字节对齐。
+ */
+typedef struct dictFileEntry
+{
+    uint64_t next;          //同一个桶中下一个节点的偏移量，0 表示没有
+    uint64_t hash;          //键的哈希值，查找时先比较哈希值
+    uint64_t val;           //值的内容（sds 的 buf）的偏移量，0 表示值为 NULL
+    int32_t keyLen;         //键的长度，即 sds_str.len
+    int32_t keyFree;        //总是 0 ，即 sds_str.free
+    char key[];             //键的内容和结尾的 '\0'
+} dictFileEntry;
+
+/**
+ * 映射到内存中的只读字典文件，以及记录修改的覆盖层
+ *
+ * 加载时只映射文件并检查文件头，不读取任何节点，所以加载的耗时与键的数量无关，
+ * 之后的查找按需触发缺页。文件以只读方式映射，修改不会写回文件：
+ * 添加和替换的键值对保存在覆盖层字典中，删除的键在覆盖层中留下墓碑，
+ * 只有被修改过的键才会被复制到内存中，其他键始终直接从映射的文件中读取。
+ */
+typedef struct dictMapped
+{
+    const char * base;              //文件映射的起始地址
+    size_t mapSize;                 //映射的字节数
+    const dictFileHeader * header;  //文件头
+    const uint64_t * buckets;       //桶数组
+    dict * overlay;                 //覆盖层，键为 sds ，值为 sds 或者墓碑
+    unsigned long used;             //键值对的数量，包括覆盖层中新添加的键，不包括被删除的键
+} dictMapped;
+
+/**
+ * dictMappedIterate() 的回调函数，key 和 val 都是只读的
+ */
+typedef void (dictMappedIterateFunction)(void * privData, const sds key, const sds val);
+
+/* API */
+int dictSave(dict * d, int fd);
+dictMapped * dictLoadMapped(const char * path);
+void dictMappedRelease(dictMapped * dm);
+int dictMappedFetch(dictMapped * dm, const sds key, sds * val);
+int dictMappedReplace(dictMapped * dm, const sds key, sds val);
+int dictMappedDelete(dictMapped * dm, const sds key);
+unsigned long dictMappedSize(dictMapped * dm);
+unsigned long dictMappedOverlaySize(dictMapped * dm);
+void dictMappedIterate(dictMapped * dm, dictMappedIterateFunction * fn, void * privData);
+
+#endif //REDIS_DESIGN_DICTMAPPED_H
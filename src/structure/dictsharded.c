@@ -0,0 +1,307 @@
+//
+// Created by Administrator on 2022/3/4.
+//
+
+
+#include "dictsharded.h"
+#include "zmalloc.h"
+#include "redisassert.h"
+
+/**
+ * 返回哈希值 h 所属的分片
+ */
+static inline dictShard * _dictShardedShard(dictSharded * ds, uint64_t h)
+{
+    return &ds->shards[(h >> DICT_SHARDED_HASH_SHIFT) & (ds->numShards - 1)];
+}
+
+/**
+ * 创建一个新的分片字典
+ *
+ * T = O(N)
+ *
+ * @param type 特定类型函数
+ * @param privDataPtr 需要传递给函数的可选参数
+ * @param numShards 分片的数量，会被向上取整为 2 的幂，最多 DICT_SHARDED_MAX_SHARDS 个
+ * @return 创建成功返回分片字典，失败返回 NULL
+ */
+dictSharded * dictShardedCreate(dictType * type, void * privDataPtr, unsigned long numShards)
+{
+    dictSharded * ds;
+    unsigned long n = 1, i;
+
+    while (n < numShards && n < DICT_SHARDED_MAX_SHARDS)
+        n <<= 1;
+
+    if ( (ds = z_malloc(sizeof(dictSharded))) == NULL)
+        return NULL;
+
+    //对齐到缓存行，避免分片之间的伪共享
+    if ((ds->shards = z_malloc_aligned(64, n * sizeof(dictShard))) == NULL)
+    {
+        z_free(ds);
+        return NULL;
+    }
+
+    ds->type = type;
+    ds->numShards = n;
+    for (i = 0; i < n; i++)
+    {
+        pthread_rwlock_init(&ds->shards[i].lock, NULL);
+        ds->shards[i].d = dictCreate(type, privDataPtr);
+    }
+
+    return ds;
+}
+
+/**
+ * 释放分片字典以及其中所有的键值对
+ *
+ * 调用时不能有其他线程正在访问这个分片字典
+ *
+ * T = O(N)
+ *
+ * @param ds 要释放的分片字典
+ */
+void dictShardedRelease(dictSharded * ds)
+{
+    unsigned long i;
+
+    for (i = 0; i < ds->numShards; i++)
+    {
+        dictRelease(ds->shards[i].d);
+        pthread_rwlock_destroy(&ds->shards[i].lock);
+    }
+    z_free(ds->shards);
+    z_free(ds);
+}
+
+/**
+ * 将给定键值对添加到分片字典中，只有键不存在时才会成功
+ *
+ * T = O(1)
+ *
+ * @param ds 分片字典
+ * @param key 键
+ * @param val 值
+ * @return 添加成功返回 DICT_OK ，键已存在返回 DICT_ERR
+ */
+int dictShardedAdd(dictSharded * ds, void * key, void * val)
+{
+    uint64_t h = ds->type->hashFunction(key);
+    dictShard * shard = _dictShardedShard(ds, h);
+    dictEntry * entry;
+
+    pthread_rwlock_wrlock(&shard->lock);
+    entry = dictAddRawWithHash(shard->d, key, h);
+    if (entry)
+        dictSetVal(shard->d, entry, val);
+    pthread_rwlock_unlock(&shard->lock);
+
+    return entry ? DICT_OK : DICT_ERR;
+}
+
+/**
+ * 将给定键值对添加到分片字典中，如果键已经存在，那么替换旧的值
+ *
+ * 键只计算一次哈希，同时用于选择分片和在分片中查找
+ *
+ * T = O(1)
+ *
+ * @param ds 分片字典
+ * @param key 键
+ * @param val 值
+ * @return 全新添加返回 1 ，替换旧值返回 0
+ */
+int dictShardedReplace(dictSharded * ds, void * key, void * val)
+{
+    uint64_t h = ds->type->hashFunction(key);
+    dictShard * shard = _dictShardedShard(ds, h);
+    dictEntry * entry, auxEntry;
+    int existed = 0;
+
+    pthread_rwlock_wrlock(&shard->lock);
+    //查找和添加共用一次探测
+    if ( (entry = dictAddOrFindWithHash(shard->d, key, h, &existed)) != NULL)
+    {
+        auxEntry = *entry;
+        dictSetVal(shard->d, entry, val);
+        if (existed)
+            dictFreeVal(shard->d, &auxEntry);
+    }
+    pthread_rwlock_unlock(&shard->lock);
+
+    return entry != NULL && !existed;
+}
+
+/**
+ * 从分片字典中删除包含给定键的节点，并调用键值的释放函数
+ *
+ * T = O(1)
+ *
+ * @param ds 分片字典
+ * @param key 键
+ * @return 找到并成功删除返回 DICT_OK ，没找到则返回 DICT_ERR
+ */
+int dictShardedDelete(dictSharded * ds, const void * key)
+{
+    dictShard * shard = _dictShardedShard(ds, ds->type->hashFunction(key));
+    int ret;
+
+    pthread_rwlock_wrlock(&shard->lock);
+    ret = dictDelete(shard->d, key);
+    pthread_rwlock_unlock(&shard->lock);
+
+    return ret;
+}
+
+/**
+ * 查找给定键，找到时在持有分片读锁的情况下对节点调用 fn
+ *
+ * 节点只在 fn 执行期间有效，fn 返回之后其他线程就可能修改或者释放它，
+ * 所以 fn 应该把需要的数据复制出去，并且不能修改分片字典。
+ *
+ * T = O(1)
+ *
+ * @param ds 分片字典
+ * @param key 键
+ * @param fn 找到时调用的函数
+ * @param privData 传给 fn 的参数
+ * @return 找到返回 DICT_OK ，没找到返回 DICT_ERR
+ */
+int dictShardedFind(dictSharded * ds, const void * key, dictScanFunction * fn, void * privData)
+{
+    uint64_t h = ds->type->hashFunction(key);
+    dictShard * shard = _dictShardedShard(ds, h);
+    dictEntry * de;
+
+    pthread_rwlock_rdlock(&shard->lock);
+    if ( (de = dictPeekWithHash(shard->d, key, h)) != NULL)
+        fn(privData, de);
+    pthread_rwlock_unlock(&shard->lock);
+
+    return de ? DICT_OK : DICT_ERR;
+}
+
+/**
+ * 返回包含给定键的节点的值
+ *
+ * 值的生命周期由调用者负责（比如使用引用计数），分片字典不保证返回之后值仍然有效
+ *
+ * T = O(1)
+ *
+ * @param ds 分片字典
+ * @param key 键
+ * @return 找到返回值，找不到返回 NULL
+ */
+void * dictShardedFetchValue(dictSharded * ds, const void * key)
+{
+    uint64_t h = ds->type->hashFunction(key);
+    dictShard * shard = _dictShardedShard(ds, h);
+    dictEntry * de;
+    void * val;
+
+    pthread_rwlock_rdlock(&shard->lock);
+    de = dictPeekWithHash(shard->d, key, h);
+    val = de ? dictGetVal(de) : NULL;
+    pthread_rwlock_unlock(&shard->lock);
+
+    return val;
+}
+
+/**
+ * 返回分片字典的节点数量
+ *
+ * 各个分片分别加锁统计，并发修改时结果只是一个近似值
+ *
+ * T = O(S) ，S 为分片数量
+ *
+ * @param ds 分片字典
+ * @return 节点数量
+ */
+unsigned long dictShardedSize(dictSharded * ds)
+{
+    unsigned long i, size = 0;
+
+    for (i = 0; i < ds->numShards; i++)
+    {
+        pthread_rwlock_rdlock(&ds->shards[i].lock);
+        size += dictSize(ds->shards[i].d);
+        pthread_rwlock_unlock(&ds->shards[i].lock);
+    }
+
+    return size;
+}
+
+/**
+ * 迭代分片字典中的元素，用法和保证都与 dictScan() 相同
+ *
+ * 游标的高 16 位记录当前分片的编号，低 48 位是该分片的 dictScan() 游标，
+ * 一个分片迭代完成后从下一个分片的游标 0 继续。
+ * 回调函数在持有分片读锁的情况下执行，不能修改分片字典。
+ *
+ * T = O(1)
+ *
+ * @param ds 分片字典
+ * @param v 游标，第一次调用时为 0
+ * @param fn 对每个元素调用的函数
+ * @param privData 传给 fn 的参数
+ * @return 下一次调用使用的游标，为 0 时表示迭代完成
+ */
+unsigned long dictShardedScan(dictSharded * ds, unsigned long v, dictScanFunction * fn, void * privData)
+{
+    unsigned long shardIdx = v >> 48;
+    unsigned long cursor = v & ((1UL << 48) - 1);
+    dictShard * shard;
+
+    if (shardIdx >= ds->numShards) return 0;
+
+    shard = &ds->shards[shardIdx];
+    pthread_rwlock_rdlock(&shard->lock);
+    cursor = dictScan(shard->d, cursor, fn, privData);
+    pthread_rwlock_unlock(&shard->lock);
+
+    //分片的游标不会超过它的哈希表大小
+    assert(cursor < (1UL << 48));
+
+    //当前分片迭代完成，转到下一个分片
+    if (cursor == 0)
+    {
+        if (++shardIdx == ds->numShards) return 0;
+    }
+
+    return (shardIdx << 48) | cursor;
+}
+
+/**
+ * 在给定毫秒数内，对正在 rehash 的分片进行 rehash
+ *
+ * 读操作不推进 rehash ，所以读多写少的负载应该定期调用这个函数。
+ *
+ * T = O(N)
+ *
+ * @param ds 分片字典
+ * @param ms 给定的毫秒数
+ * @return rehash 的次数
+ */
+int dictShardedRehashMilliseconds(dictSharded * ds, int ms)
+{
+    long long start = timeInMilliseconds();
+    unsigned long i;
+    int rehashes = 0;
+
+    for (i = 0; i < ds->numShards; i++)
+    {
+        long long left = ms - (timeInMilliseconds() - start);
+        dictShard * shard = &ds->shards[i];
+
+        if (left <= 0) break;
+
+        pthread_rwlock_wrlock(&shard->lock);
+        if (dictIsRehashing(shard->d))
+            rehashes += dictRehashMilliseconds(shard->d, (int)left);
+        pthread_rwlock_unlock(&shard->lock);
+    }
+
+    return rehashes;
+}
@@ -0,0 +1,65 @@
+//
+// Created by Administrator on 2022/3/4.
+//
+
+#ifndef REDIS_DESIGN_DICTSHARDED_H
+#define REDIS_DESIGN_DICTSHARDED_H
+
+#include <pthread.h>
+
+#include "dict.h"
+
+/**
+ * 分片数量的上限
+ */
+#define DICT_SHARDED_MAX_SHARDS (1UL << 16)
+
+/**
+ * 选择分片时使用的哈希值的起始位
+ *
+ * 桶的索引使用哈希值的低位，分组哈希表的标签使用最高的 8 位，
+ * 分片使用中间的位，三者互不相关，每个分片内部的键仍然均匀分布。
+ */
+#define DICT_SHARDED_HASH_SHIFT 40
+
+/**
+ * 分片字典的一个分片：一个独立的字典和保护它的读写锁
+ *
+ * 按缓存行对齐，避免不同分片的锁之间的伪共享
+ */
+typedef struct dictShard
+{
+    pthread_rwlock_t lock;  //分片的读写锁
+    dict * d;               //分片的字典
+} __attribute__((aligned(64))) dictShard;
+
+/**
+ * 线程安全的分片字典
+ *
+ * 键按照哈希值被分散到 numShards 个互相独立的字典中，每个分片由自己的读写锁保护，
+ * 所以多个线程可以同时访问不同的分片，对同一个分片的读操作也可以并发进行。
+ *
+ * 读操作不推进 rehash ，rehash 由写操作和 dictShardedRehashMilliseconds() 推进。
+ *
+ * 注意：分片不使用后台 rehash ；dictType 的回调函数会在多个线程中被调用，必须是线程安全的。
+ */
+typedef struct dictSharded
+{
+    dictType * type;            //类型特定的操作函数
+    unsigned long numShards;    //分片的数量，总是 2 的幂
+    dictShard * shards;         //分片数组
+} dictSharded;
+
+/* API */
+dictSharded * dictShardedCreate(dictType * type, void * privDataPtr, unsigned long numShards);
+void dictShardedRelease(dictSharded * ds);
+int dictShardedAdd(dictSharded * ds, void * key, void * val);
+int dictShardedReplace(dictSharded * ds, void * key, void * val);
+int dictShardedDelete(dictSharded * ds, const void * key);
+int dictShardedFind(dictSharded * ds, const void * key, dictScanFunction * fn, void * privData);
+void * dictShardedFetchValue(dictSharded * ds, const void * key);
+unsigned long dictShardedSize(dictSharded * ds);
+unsigned long dictShardedScan(dictSharded * ds, unsigned long v, dictScanFunction * fn, void * privData);
+int dictShardedRehashMilliseconds(dictSharded * ds, int ms);
+
+#endif //REDIS_DESIGN_DICTSHARDED_H
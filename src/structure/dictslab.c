@@ -0,0 +1,246 @@
+//
+// Created by Administrator on 2022/3/4.
+//
+
+#include <stdint.h>
+
+#include "dictslab.h"
+#include "zmalloc.h"
+#include "redisassert.h"
+
+/**
+ * slab 页的页头，位于页的开始处
+ */
+typedef struct dictSlabPage
+{
+    struct dictSlabPage * prev, * next; //页链表中的前一页和后一页
+    void * freeList;        //页内已释放的对象组成的链表，链表指针保存在对象的前 8 个字节中
+    unsigned int used;      //页内已分配的对象数量
+    unsigned int carved;    //页内曾经被分配过的对象数量，之后的对象还从未被使用过
+} dictSlabPage;
+
+//返回对象所在的页
+#define dictSlabPageOf(obj) ((dictSlabPage *)((uintptr_t)(obj) & ~(uintptr_t)(DICT_SLAB_PAGE_SIZE - 1)))
+
+/**
+ * 对象大小向上取整，使对象不跨越缓存行
+ *
+ * 不大于 64 字节的对象取整为 64 的约数，更大的对象取整为 64 的倍数
+ *
+ * @param size 对象大小
+ * @return 取整后的大小
+ */
+static size_t _dictSlabObjSize(size_t size)
+{
+    size_t n = sizeof(void *);
+
+    if (size <= 64)
+    {
+        while (n < size) n <<= 1;
+        return n;
+    }
+
+    return (size + 63) & ~(size_t)63;
+}
+
+/**
+ * 将页 p 从页链表中移除
+ */
+static void _dictSlabUnlink(dictSlab * s, dictSlabPage * p)
+{
+    if (p->prev) p->prev->next = p->next;
+    else s->pages = p->next;
+    if (p->next) p->next->prev = p->prev;
+    else s->tail = p->prev;
+    p->prev = p->next = NULL;
+}
+
+/**
+ * 将页 p 插入到页链表的表头
+ */
+static void _dictSlabPushFront(dictSlab * s, dictSlabPage * p)
+{
+    p->prev = NULL;
+    p->next = s->pages;
+    if (s->pages) s->pages->prev = p;
+    else s->tail = p;
+    s->pages = p;
+}
+
+/**
+ * 将页 p 插入到页链表的表尾
+ */
+static void _dictSlabPushBack(dictSlab * s, dictSlabPage * p)
+{
+    p->next = NULL;
+    p->prev = s->tail;
+    if (s->tail) s->tail->next = p;
+    else s->pages = p;
+    s->tail = p;
+}
+
+/**
+ * 初始化 slab
+ *
+ * 不分配任何页，第一次分配对象时才分配
+ *
+ * T = O(1)
+ *
+ * @param s 要初始化的 slab
+ * @param objSize 对象的大小，取整后不能超过一页可以容纳的大小
+ */
+void dictSlabInit(dictSlab * s, size_t objSize)
+{
+    void * probe;
+
+    s->objSize = _dictSlabObjSize(objSize);
+    assert(s->objSize <= DICT_SLAB_PAGE_SIZE - DICT_SLAB_PAGE_HEADER);
+    s->objsPerPage = (DICT_SLAB_PAGE_SIZE - DICT_SLAB_PAGE_HEADER) / s->objSize;
+    s->pages = s->tail = NULL;
+    s->numPages = 0;
+    s->emptyPages = 0;
+    s->used = 0;
+
+    //测量 malloc 分配同样大小的对象时实际占用的内存，只用于统计
+    probe = z_malloc(objSize);
+    s->mallocSize = z_malloc_size(probe) + sizeof(size_t);
+    z_free(probe);
+}
+
+/**
+ * 从 slab 中分配一个对象
+ *
+ * T = O(1)
+ *
+ * @param s slab
+ * @return 分配的对象，内容未初始化；分配失败返回 NULL
+ */
+void * dictSlabAlloc(dictSlab * s)
+{
+    dictSlabPage * p = s->pages;
+    void * obj;
+
+    //第一页已满说明所有页都已满
+    if (p == NULL || p->used == s->objsPerPage)
+    {
+        if ((p = z_malloc_aligned(DICT_SLAB_PAGE_SIZE, DICT_SLAB_PAGE_SIZE)) == NULL)
+            return NULL;
+        p->freeList = NULL;
+        p->used = 0;
+        p->carved = 0;
+        _dictSlabPushFront(s, p);
+        s->numPages++;
+        s->emptyPages++;
+    }
+
+    if (p->used == 0)
+        s->emptyPages--;
+
+    //优先复用释放过的对象，其次使用从未用过的对象，新页的内存只在需要时才被访问
+    if (p->freeList)
+    {
+        obj = p->freeList;
+        p->freeList = *(void **)obj;
+    }
+    else
+    {
+        obj = (char *)p + DICT_SLAB_PAGE_HEADER + (size_t)p->carved * s->objSize;
+        p->carved++;
+    }
+    p->used++;
+    s->used++;
+
+    //页已满，移到页链表的表尾
+    if (p->used == s->objsPerPage && p != s->tail)
+    {
+        _dictSlabUnlink(s, p);
+        _dictSlabPushBack(s, p);
+    }
+
+    return obj;
+}
+
+/**
+ * 将对象归还给 slab
+ *
+ * T = O(1)
+ *
+ * @param s slab
+ * @param obj 由 dictSlabAlloc() 分配的对象
+ */
+void dictSlabFree(dictSlab * s, void * obj)
+{
+    dictSlabPage * p = dictSlabPageOf(obj);
+
+    *(void **)obj = p->freeList;
+    p->freeList = obj;
+
+    //已满的页重新有了空闲对象，移到页链表的表头
+    if (p->used == s->objsPerPage && p != s->pages)
+    {
+        _dictSlabUnlink(s, p);
+        _dictSlabPushFront(s, p);
+    }
+    p->used--;
+    s->used--;
+
+    if (p->used == 0)
+    {
+        //已经缓存了一个空页，直接归还这一页
+        if (s->emptyPages)
+        {
+            _dictSlabUnlink(s, p);
+            z_free(p);
+            s->numPages--;
+        }
+        else
+        {
+            s->emptyPages++;
+        }
+    }
+}
+
+/**
+ * 一次性释放 slab 的所有页，所有对象都随之失效
+ *
+ * 释放之后 slab 仍然可以继续分配对象
+ *
+ * T = O(P) ，P 为页的数量
+ *
+ * @param s slab
+ */
+void dictSlabRelease(dictSlab * s)
+{
+    dictSlabPage * p = s->pages;
+
+    while (p)
+    {
+        dictSlabPage * next = p->next;
+
+        z_free(p);
+        p = next;
+    }
+
+    s->pages = s->tail = NULL;
+    s->numPages = 0;
+    s->emptyPages = 0;
+    s->used = 0;
+}
+
+/**
+ * 返回 slab 的占用情况
+ *
+ * T = O(1)
+ *
+ * @param s slab
+ * @param stats 用于保存结果
+ */
+void dictSlabGetStats(dictSlab * s, dictSlabStats * stats)
+{
+    stats->objectSize = s->objSize;
+    stats->pages = s->numPages;
+    stats->objects = s->used;
+    stats->capacity = s->numPages * s->objsPerPage;
+    stats->bytes = s->numPages * DICT_SLAB_PAGE_SIZE;
+    stats->mallocBytes = s->used * s->mallocSize;
+}
@@ -0,0 +1,64 @@
+//
+// Created by Administrator on 2022/3/4.
+//
+
+#ifndef REDIS_DESIGN_DICTSLAB_H
+#define REDIS_DESIGN_DICTSLAB_H
+
+#include <stddef.h>
+
+/**
+ * slab 页的大小，页按自身大小对齐，释放对象时通过地址掩码找到所在的页
+ */
+#define DICT_SLAB_PAGE_SIZE (16 * 1024)
+
+/**
+ * 页头占用的字节数，对象从页内的第二条缓存行开始存放
+ */
+#define DICT_SLAB_PAGE_HEADER 64
+
+struct dictSlabPage;
+
+/**
+ * 固定大小对象的 slab 分配器，每个字典一个，只被字典的所属线程使用，不需要加锁
+ *
+ * 对象从按页划分的内存中分配，每页维护自己的空闲链表：
+ * 有空闲对象的页排在页链表的前面，已满的页排在后面，所以分配总是从第一页开始，T = O(1) 。
+ * 对象大小会被向上取整，使得每个对象都不跨越缓存行（不大于 64 字节时取整为 64 的约数）。
+ * 完全空闲的页最多缓存一个，其余的立即归还给系统。
+ */
+typedef struct dictSlab
+{
+    size_t objSize;             //取整后的对象大小，为 0 表示未启用
+    unsigned int objsPerPage;   //每页可以容纳的对象数量
+    struct dictSlabPage * pages;    //页链表，有空闲对象的页在前，已满的页在后
+    struct dictSlabPage * tail;     //页链表的最后一页
+    unsigned long numPages;     //已分配的页数量
+    unsigned long emptyPages;   //完全空闲的页的数量，最多为 1
+    unsigned long used;         //已分配的对象数量
+    size_t mallocSize;          //同样大小的对象由 malloc 分配时实际占用的字节数（包括 malloc 的块头）
+} dictSlab;
+
+/**
+ * slab 的占用情况
+ *
+ * bytes 与 mallocBytes 的差就是使用 slab 而不是逐个 malloc 节约的内存
+ */
+typedef struct dictSlabStats
+{
+    size_t objectSize;      //取整后的对象大小
+    unsigned long pages;    //已分配的页数量
+    unsigned long objects;  //已分配的对象数量
+    unsigned long capacity; //所有页一共可以容纳的对象数量
+    size_t bytes;           //slab 实际占用的字节数
+    size_t mallocBytes;     //同样数量的对象由 malloc 分配时估计占用的字节数
+} dictSlabStats;
+
+/* API */
+void dictSlabInit(dictSlab * s, size_t objSize);
+void * dictSlabAlloc(dictSlab * s);
+void dictSlabFree(dictSlab * s, void * obj);
+void dictSlabRelease(dictSlab * s);
+void dictSlabGetStats(dictSlab * s, dictSlabStats * stats);
+
+#endif //REDIS_DESIGN_DICTSLAB_H
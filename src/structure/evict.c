@@ -0,0 +1,669 @@
+//
+// Created by Administrator on 2022/3/4.
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "evict.h"
+#include "zmalloc.h"
+#include "redisassert.h"
+
+/**
+ * 初始化淘汰状态
+ *
+ * T = O(1)
+ *
+ * @param es 要初始化的淘汰状态
+ * @param keys 键空间
+ * @param expires 设置了过期时间的键，可以为 NULL
+ * @param maxmemory 内存上限，为 0 表示不限制
+ * @param policy MAXMEMORY_* 之一
+ */
+void evictInit(evictState * es, dict * keys, dict * expires, size_t maxmemory, int policy)
+{
+    int j;
+
+    es->keys = keys;
+    es->expires = expires;
+    es->maxmemory = maxmemory;
+    es->policy = policy;
+    es->samples = EVICT_DEFAULT_SAMPLES;
+    es->lfuLogFactor = LFU_DEFAULT_LOG_FACTOR;
+    es->lfuDecayTime = LFU_DEFAULT_DECAY_TIME;
+    es->clock = timeInMilliseconds;
+    es->evictedKeys = 0;
+
+    es->pool = z_malloc(sizeof(evictionPoolEntry) * EVPOOL_SIZE);
+    for (j = 0; j < EVPOOL_SIZE; j++)
+    {
+        es->pool[j].idle = 0;
+        es->pool[j].key = NULL;
+        es->pool[j].cached = sds_new_len(NULL, EVPOOL_CACHED_SDS_SIZE);
+    }
+}
+
+/**
+ * 释放淘汰池，不影响键空间
+ *
+ * T = O(1)
+ *
+ * @param es 淘汰状态
+ */
+void evictRelease(evictState * es)
+{
+    int j;
+
+    for (j = 0; j < EVPOOL_SIZE; j++)
+    {
+        if (es->pool[j].key != es->pool[j].cached)
+            sds_free(es->pool[j].key);
+        sds_free(es->pool[j].cached);
+    }
+    z_free(es->pool);
+    es->pool = NULL;
+}
+
+/* ------------------------------- LRU ---------------------------------------*/
+
+/**
+ * 返回当前的 LRU 时钟：以 LRU_CLOCK_RESOLUTION 毫秒为单位的时间，在 LRU_CLOCK_MAX 处回绕
+ *
+ * T = O(1)
+ *
+ * @param es 淘汰状态
+ * @return LRU 时钟
+ */
+unsigned int evictLRUClock(evictState * es)
+{
+    return (es->clock() / LRU_CLOCK_RESOLUTION) & LRU_CLOCK_MAX;
+}
+
+/**
+ * 估计对象的空闲时间（毫秒），LRU 时钟回绕一次以内的结果是准确的
+ *
+ * T = O(1)
+ *
+ * @param es 淘汰状态
+ * @param o 对象
+ * @return 空闲时间
+ */
+unsigned long long evictObjectIdleTime(evictState * es, robj * o)
+{
+    unsigned long long lruclock = evictLRUClock(es);
+
+    if (lruclock >= o->lru)
+        return (lruclock - o->lru) * LRU_CLOCK_RESOLUTION;
+    else
+        return (lruclock + (LRU_CLOCK_MAX - o->lru)) * LRU_CLOCK_RESOLUTION;
+}
+
+/* ------------------------------- LFU ---------------------------------------*/
+
+/*
+ * LFU 把 24 位的 lru 字段分成两部分：
+ *
+ *          16 bits      8 bits
+ *     +----------------+--------+
+ *     + Last decr time | LOG_C  |
+ *     +----------------+--------+
+ *
+ * LOG_C 是对数访问计数，最大为 255 ，每次访问以 1 / ((LOG_C - LFU_INIT_VAL) * lfuLogFactor + 1)
+ * 的概率加 1 ，所以因子为 10 时大约一百万次访问才能达到 255 。
+ * Last decr time 是最后一次递减计数的时间（分钟，在 65535 处回绕），
+ * 每经过 lfuDecayTime 分钟计数减 1 ，使得过去频繁访问、现在不再访问的键也能被淘汰。
+ */
+
+/**
+ * 返回以分钟为单位的当前时间的低 16 位
+ */
+static unsigned long _evictLFUTimeInMinutes(evictState * es)
+{
+    return (es->clock() / 60000) & 65535;
+}
+
+/**
+ * 返回从 ldt 到现在经过的分钟数，考虑了一次回绕
+ */
+static unsigned long _evictLFUTimeElapsed(evictState * es, unsigned long ldt)
+{
+    unsigned long now = _evictLFUTimeInMinutes(es);
+
+    if (now >= ldt) return now - ldt;
+    return 65535 - ldt + now;
+}
+
+/**
+ * 按概率对数地增加访问计数
+ */
+static uint8_t _evictLFULogIncr(evictState * es, uint8_t counter)
+{
+    double r, baseval, p;
+
+    if (counter == 255) return 255;
+
+    r = (double)rand() / RAND_MAX;
+    baseval = counter - LFU_INIT_VAL;
+    if (baseval < 0) baseval = 0;
+    p = 1.0 / (baseval * es->lfuLogFactor + 1);
+    if (r < p) counter++;
+
+    return counter;
+}
+
+/**
+ * 按经过的衰减周期减少对象的访问计数，返回减少之后的计数，不修改对象
+ *
+ * T = O(1)
+ *
+ * @param es 淘汰状态
+ * @param o 对象
+ * @return 访问计数
+ */
+unsigned long evictLFUDecrAndReturn(evictState * es, robj * o)
+{
+    unsigned long ldt = o->lru >> 8;
+    unsigned long counter = o->lru & 255;
+    unsigned long periods = es->lfuDecayTime ? _evictLFUTimeElapsed(es, ldt) / es->lfuDecayTime : 0;
+
+    if (periods)
+        counter = (periods > counter) ? 0 : counter - periods;
+
+    return counter;
+}
+
+/* ------------------------------- 访问记录 -----------------------------------*/
+
+/**
+ * 初始化新对象的访问记录，对象加入键空间时调用
+ *
+ * T = O(1)
+ *
+ * @param es 淘汰状态
+ * @param o 新对象
+ */
+void evictInitObject(evictState * es, robj * o)
+{
+    if (es->policy == MAXMEMORY_VOLATILE_LFU || es->policy == MAXMEMORY_ALLKEYS_LFU)
+        o->lru = (_evictLFUTimeInMinutes(es) << 8) | LFU_INIT_VAL;
+    else
+        o->lru = evictLRUClock(es);
+}
+
+/**
+ * 记录一次对对象的访问，查找到键时调用
+ *
+ * T = O(1)
+ *
+ * @param es 淘汰状态
+ * @param o 被访问的对象
+ */
+void evictTouchObject(evictState * es, robj * o)
+{
+    if (es->policy == MAXMEMORY_VOLATILE_LFU || es->policy == MAXMEMORY_ALLKEYS_LFU)
+    {
+        unsigned long counter = evictLFUDecrAndReturn(es, o);
+
+        counter = _evictLFULogIncr(es, counter);
+        o->lru = (_evictLFUTimeInMinutes(es) << 8) | counter;
+    }
+    else
+    {
+        o->lru = evictLRUClock(es);
+    }
+}
+
+/* ------------------------------- 淘汰 ---------------------------------------*/
+
+/**
+ * 从 sampledict 中取样，把比池中已有候选更应该被淘汰的键插入淘汰池
+ *
+ * 淘汰池按 idle 从小到大排列，池满时只有比第一个候选更好的键才能插入，并挤掉第一个候选。
+ * 池中的候选在多次淘汰之间保留，所以相当于从越来越多的样本中选择最好的键。
+ *
+ * T = O(samples * EVPOOL_SIZE)
+ *
+ * @param es 淘汰状态
+ * @param sampledict 取样的字典，键空间或者 expires
+ */
+static void _evictPoolPopulate(evictState * es, dict * sampledict)
+{
+    evictionPoolEntry * pool = es->pool;
+    dictEntry * samples[EVICT_DEFAULT_SAMPLES * 4];
+    int count = es->samples, j;
+
+    if (count > (int)(sizeof(samples) / sizeof(samples[0])))
+        count = sizeof(samples) / sizeof(samples[0]);
+    count = dictSampleKeys(sampledict, samples, count);
+
+    for (j = 0; j < count; j++)
+    {
+        unsigned long long idle;
+        sds key = dictGetKey(samples[j]);
+        robj * o = NULL;
+        size_t klen = sds_len(key);
+        int k, dup = 0;
+
+        //TTL 策略只需要过期时间，其他策略需要键空间中的对象
+        if (es->policy != MAXMEMORY_VOLATILE_TTL)
+        {
+            dictEntry * de = sampledict == es->keys ? samples[j] : dictFind(es->keys, key);
+
+            if (de == NULL) continue;
+            o = dictGetVal(de);
+        }
+
+        if (es->policy == MAXMEMORY_VOLATILE_LRU || es->policy == MAXMEMORY_ALLKEYS_LRU)
+            idle = evictObjectIdleTime(es, o);
+        else if (es->policy == MAXMEMORY_VOLATILE_LFU || es->policy == MAXMEMORY_ALLKEYS_LFU)
+            idle = 255 - evictLFUDecrAndReturn(es, o);
+        else
+            idle = ULLONG_MAX - (unsigned long long)dictGetSignedIntegerVal(samples[j]);
+
+        //有放回的取样可能取到同一个键，池中已有的键不再插入
+        for (k = 0; k < EVPOOL_SIZE && pool[k].key; k++)
+        {
+            if (sds_len(pool[k].key) == klen && memcmp(pool[k].key, key, klen) == 0)
+            {
+                dup = 1;
+                break;
+            }
+        }
+        if (dup) continue;
+
+        //找到第一个 idle 不小于当前键的位置
+        k = 0;
+        while (k < EVPOOL_SIZE && pool[k].key && pool[k].idle < idle) k++;
+
+        if (k == 0 && pool[EVPOOL_SIZE - 1].key != NULL)
+        {
+            //池已满，并且当前键比池中所有的候选都差
+            continue;
+        }
+        else if (k < EVPOOL_SIZE && pool[k].key == NULL)
+        {
+            //插入到空位置，不需要移动
+        }
+        else
+        {
+            if (pool[EVPOOL_SIZE - 1].key == NULL)
+            {
+                //右边还有空位，把 k 及之后的候选右移一位
+                sds cached = pool[EVPOOL_SIZE - 1].cached;
+
+                memmove(pool + k + 1, pool + k, sizeof(pool[0]) * (EVPOOL_SIZE - k - 1));
+                pool[k].cached = cached;
+            }
+            else
+            {
+                //池已满，丢弃最左边（最不应该被淘汰）的候选，把 k 之前的候选左移一位
+                sds cached = pool[0].cached;
+
+                k--;
+                if (pool[0].key != pool[0].cached) sds_free(pool[0].key);
+                memmove(pool, pool + 1, sizeof(pool[0]) * k);
+                pool[k].cached = cached;
+            }
+        }
+
+        //复制键，淘汰时还要在字典中查找它，而它可能已经被删除
+        if (klen > EVPOOL_CACHED_SDS_SIZE)
+        {
+            pool[k].key = sds_dup(key);
+        }
+        else
+        {
+            pool[k].cached = sds_copy_len(pool[k].cached, key, klen);
+            pool[k].key = pool[k].cached;
+        }
+        pool[k].idle = idle;
+    }
+}
+
+/**
+ * 从淘汰池中取出最应该被淘汰并且仍然存在的键
+ *
+ * @param es 淘汰状态
+ * @param sampledict 取样的字典
+ * @return 键空间中的键，池中没有仍然存在的键时返回 NULL
+ */
+static sds _evictPoolPopBest(evictState * es, dict * sampledict)
+{
+    evictionPoolEntry * pool = es->pool;
+    int k;
+
+    for (k = EVPOOL_SIZE - 1; k >= 0; k--)
+    {
+        dictEntry * de;
+
+        if (pool[k].key == NULL) continue;
+
+        de = dictFind(sampledict, pool[k].key);
+
+        //从池中移除
+        if (pool[k].key != pool[k].cached)
+            sds_free(pool[k].key);
+        pool[k].key = NULL;
+        pool[k].idle = 0;
+
+        //候选可能在进入淘汰池之后被删除了
+        if (de) return dictGetKey(de);
+    }
+
+    return NULL;
+}
+
+/**
+ * 删除一个键及其过期时间
+ *
+ * key 属于键空间，所以先从 expires 中删除，再由键空间释放键和值
+ */
+static void _evictDeleteKey(evictState * es, sds key)
+{
+    if (es->expires)
+        dictDelete(es->expires, key);
+    dictDelete(es->keys, key);
+    es->evictedKeys++;
+}
+
+/**
+ * 内存超过上限时，按策略淘汰键，直到内存不超过上限
+ *
+ * 每次写入之前调用。LRU 、 LFU 和 TTL 策略借助淘汰池近似地选择最应该被淘汰的键，
+ * random 策略均匀地随机选择。
+ *
+ * T = O(N) ，N 为淘汰的键数量
+ *
+ * @param es 淘汰状态
+ * @return 内存不超过上限返回 EVICT_OK ；策略不允许淘汰，或者已经没有可以淘汰的键时返回 EVICT_FAIL
+ */
+int evictPerform(evictState * es)
+{
+    int allkeys = es->policy == MAXMEMORY_ALLKEYS_LRU || es->policy == MAXMEMORY_ALLKEYS_LFU ||
+                  es->policy == MAXMEMORY_ALLKEYS_RANDOM;
+    dict * sampledict = allkeys ? es->keys : es->expires;
+
+    if (es->maxmemory == 0) return EVICT_OK;
+
+    while (z_malloc_used_memory() > es->maxmemory)
+    {
+        sds bestkey = NULL;
+
+        if (es->policy == MAXMEMORY_NO_EVICTION || sampledict == NULL || dictSize(sampledict) == 0)
+            return EVICT_FAIL;
+
+        if (es->policy == MAXMEMORY_ALLKEYS_RANDOM || es->policy == MAXMEMORY_VOLATILE_RANDOM)
+        {
+            bestkey = dictGetKey(dictGetRandomKey(sampledict));
+        }
+        else
+        {
+            //池中的候选都已经被删除时重新取样
+            while (bestkey == NULL && dictSize(sampledict))
+            {
+                _evictPoolPopulate(es, sampledict);
+                bestkey = _evictPoolPopBest(es, sampledict);
+            }
+            if (bestkey == NULL) return EVICT_FAIL;
+        }
+
+        _evictDeleteKey(es, bestkey);
+    }
+
+    return EVICT_OK;
+}
+
+#ifdef EVICT_BENCHMARK_MAIN
+/* 基准测试：在 Zipf 分布的访问序列上，比较近似 LRU/LFU 与真正的 LRU 的命中率
+ *
+ * gcc -O2 -DEVICT_BENCHMARK_MAIN -I../other -I../object evict.c dict.c dicthash.c dictslab.c sds.c ../other/zmalloc.c -lpthread -lm
+ * ./a.out [键的数量] [访问次数] [缓存占键空间的百分比]
+ */
+#include <stdio.h>
+#include <math.h>
+
+#define BENCH_VALUE_SIZE 256
+
+void _redisAssert(char * estr, char * file, int line)
+{
+    fprintf(stderr, "=== ASSERTION FAILED ===\n==> %s:%d '%s' is not true\n", file, line, estr);
+}
+
+/**
+ * sds.c 使用安全函数库的 memcpy_s ，glibc 没有提供，独立构建基准测试时在这里补上
+ */
+int memcpy_s(void * dest, size_t destMax, const void * src, size_t count)
+{
+    if (count > destMax) return -1;
+    memmove(dest, src, count);
+    return 0;
+}
+
+//虚拟时钟：每次访问前进 10 毫秒，使访问时间的先后在 LRU 时钟上可以区分
+static long long bench_now;
+
+static long long benchClock(void)
+{
+    return bench_now;
+}
+
+static uint64_t benchSdsHash(const void * key)
+{
+    return dictGenHashFunction(key, sds_len((sds)key));
+}
+
+static int benchSdsCompare(void * privData, const void * key1, const void * key2)
+{
+    DICT_NOT_USED(privData);
+    return sds_len((sds)key1) == sds_len((sds)key2) && memcmp(key1, key2, sds_len((sds)key1)) == 0;
+}
+
+static void benchSdsDestructor(void * privData, void * key)
+{
+    DICT_NOT_USED(privData);
+    sds_free(key);
+}
+
+static void benchObjDestructor(void * privData, void * obj)
+{
+    DICT_NOT_USED(privData);
+    z_free(((robj *)obj)->ptr);
+    z_free(obj);
+}
+
+static dictType benchKeyspaceType = {
+    benchSdsHash,           /* hash function */
+    NULL,                   /* key dup */
+    NULL,                   /* val dup */
+    benchSdsCompare,        /* key compare */
+    benchSdsDestructor,     /* key destructor */
+    benchObjDestructor,     /* val destructor */
+    0,                      /* flags */
+    NULL,                   /* embed key len */
+    NULL,                   /* embed key */
+    NULL                    /* key bytes */
+};
+
+/**
+ * 按 Zipf 分布（指数为 s）生成 n 个访问，结果为 [0, keys) 之间的键编号
+ */
+static unsigned int * benchZipfTrace(unsigned int keys, unsigned long n, double s)
+{
+    double * cdf = z_malloc(sizeof(double) * keys), sum = 0;
+    unsigned int * trace = z_malloc(sizeof(unsigned int) * n), k;
+    unsigned long i;
+
+    for (k = 0; k < keys; k++)
+        cdf[k] = (sum += 1.0 / pow(k + 1, s));
+    for (i = 0; i < n; i++)
+    {
+        double r = (double)rand() / RAND_MAX * sum;
+        unsigned int lo = 0, hi = keys - 1;
+
+        while (lo < hi)
+        {
+            unsigned int mid = (lo + hi) / 2;
+
+            if (cdf[mid] < r) lo = mid + 1;
+            else hi = mid;
+        }
+        //打散热点键，避免编号相邻的键总是一起被访问
+        trace[i] = (unsigned int)(((uint64_t)lo * 2654435761u) % keys);
+    }
+    z_free(cdf);
+
+    return trace;
+}
+
+/**
+ * 用近似淘汰策略回放访问序列，未命中时写入键
+ *
+ * @return 命中率，resident 保存稳定之后缓存中的键数量
+ */
+static double benchApprox(unsigned int * trace, unsigned long n, size_t cacheBytes, int policy,
+                          unsigned long * resident)
+{
+    dict * keys = dictCreate(&benchKeyspaceType, NULL);
+    size_t base = z_malloc_used_memory();
+    unsigned long i, hits = 0;
+    evictState es;
+    char buf[32];
+
+    evictInit(&es, keys, NULL, base + cacheBytes, policy);
+    es.clock = benchClock;
+    for (i = 0; i < n; i++)
+    {
+        sds key;
+        dictEntry * de;
+
+        bench_now += 10;
+        key = sds_new_len(buf, snprintf(buf, sizeof(buf), "key:%u", trace[i]));
+        if ((de = dictFind(keys, key)) != NULL)
+        {
+            evictTouchObject(&es, dictGetVal(de));
+            hits++;
+            sds_free(key);
+        }
+        else
+        {
+            robj * o = z_malloc(sizeof(robj));
+
+            o->ptr = z_malloc(BENCH_VALUE_SIZE);
+            evictInitObject(&es, o);
+            dictAdd(keys, key, o);
+            evictPerform(&es);
+        }
+    }
+    *resident = dictSize(keys);
+
+    evictRelease(&es);
+    dictRelease(keys);
+    return (double)hits / n;
+}
+
+/**
+ * 真正的 LRU ：容量为 capacity 个键，用数组实现的双向链表记录访问顺序
+ *
+ * @return 命中率
+ */
+static double benchTrueLRU(unsigned int * trace, unsigned long n, unsigned int keys, unsigned long capacity)
+{
+    int * prev = z_malloc(sizeof(int) * keys), * next = z_malloc(sizeof(int) * keys);
+    char * cached = z_calloc(keys);
+    unsigned long i, hits = 0, size = 0;
+    int head = -1, tail = -1;
+
+    for (i = 0; i < n; i++)
+    {
+        int k = (int)trace[i];
+
+        if (cached[k])
+        {
+            hits++;
+            if (k == head) continue;
+            //从链表中摘除
+            next[prev[k]] = next[k];
+            if (next[k] >= 0) prev[next[k]] = prev[k];
+            else tail = prev[k];
+        }
+        else
+        {
+            //淘汰链表尾部最久没有被访问的键
+            if (size == capacity)
+            {
+                cached[tail] = 0;
+                tail = prev[tail];
+                next[tail] = -1;
+                size--;
+            }
+            cached[k] = 1;
+            size++;
+        }
+        //插入到链表头部
+        prev[k] = -1;
+        next[k] = head;
+        if (head >= 0) prev[head] = k;
+        head = k;
+        if (tail < 0) tail = k;
+    }
+
+    z_free(prev);
+    z_free(next);
+    z_free(cached);
+    return (double)hits / n;
+}
+
+int main(int argc, char ** argv)
+{
+    unsigned int keys = argc > 1 ? atoi(argv[1]) : 100000;
+    unsigned long n = argc > 2 ? strtoul(argv[2], NULL, 10) : 2000000;
+    int percent = argc > 3 ? atoi(argv[3]) : 10;
+    static const struct { const char * name; int policy; } policies[] = {
+        {"allkeys-lru", MAXMEMORY_ALLKEYS_LRU},
+        {"allkeys-lfu", MAXMEMORY_ALLKEYS_LFU},
+        {"allkeys-random", MAXMEMORY_ALLKEYS_RANDOM},
+    };
+    double alphas[] = {0.8, 0.99, 1.2};
+    size_t perKey;
+    unsigned int a, p;
+
+    //估计每个键占用的内存：键、 robj 、值以及字典节点和桶
+    {
+        size_t before = z_malloc_used_memory();
+        dict * d = dictCreate(&benchKeyspaceType, NULL);
+        char buf[32];
+
+        for (a = 0; a < 10000; a++)
+        {
+            robj * o = z_malloc(sizeof(robj));
+
+            o->ptr = z_malloc(BENCH_VALUE_SIZE);
+            dictAdd(d, sds_new_len(buf, snprintf(buf, sizeof(buf), "key:%u", a)), o);
+        }
+        perKey = (z_malloc_used_memory() - before) / 10000;
+        dictRelease(d);
+    }
+
+    printf("keys=%u accesses=%lu cache=%d%% (~%zu bytes per key)\n", keys, n, percent, perKey);
+    for (a = 0; a < sizeof(alphas) / sizeof(alphas[0]); a++)
+    {
+        unsigned int * trace = benchZipfTrace(keys, n, alphas[a]);
+        size_t cacheBytes = perKey * keys / 100 * percent;
+
+        printf("zipf s=%.2f\n", alphas[a]);
+        for (p = 0; p < sizeof(policies) / sizeof(policies[0]); p++)
+        {
+            unsigned long resident;
+            double hit = benchApprox(trace, n, cacheBytes, policies[p].policy, &resident);
+            double lru = benchTrueLRU(trace, n, keys, resident);
+
+            printf("  %-15s hit=%.4f  true-lru(%lu keys)=%.4f  ratio=%.3f\n",
+                   policies[p].name, hit, resident, lru, hit / lru);
+        }
+        z_free(trace);
+    }
+
+    return 0;
+}
+#endif
@@ -0,0 +1,102 @@
+//
+// Created by Administrator on 2022/3/4.
+//
+
+#ifndef REDIS_DESIGN_EVICT_H
+#define REDIS_DESIGN_EVICT_H
+
+#include <stddef.h>
+
+#include "dict.h"
+#include "robj.h"
+#include "sds.h"
+
+/**
+ * maxmemory 策略：内存超过上限时从哪些键中、按什么标准选择要淘汰的键
+ *
+ * volatile 策略只从设置了过期时间的键中选择，allkeys 策略从所有键中选择
+ */
+#define MAXMEMORY_VOLATILE_LRU      0   //淘汰最久没有被访问的键
+#define MAXMEMORY_VOLATILE_LFU      1   //淘汰访问频率最低的键
+#define MAXMEMORY_VOLATILE_RANDOM   2   //随机淘汰
+#define MAXMEMORY_VOLATILE_TTL      3   //淘汰最先过期的键
+#define MAXMEMORY_ALLKEYS_LRU       4
+#define MAXMEMORY_ALLKEYS_LFU       5
+#define MAXMEMORY_ALLKEYS_RANDOM    6
+#define MAXMEMORY_NO_EVICTION       7   //不淘汰，写入由调用者拒绝
+
+/**
+ * 淘汰池的大小
+ */
+#define EVPOOL_SIZE 16
+
+/**
+ * 淘汰池为每个位置预先分配的键缓冲区的长度，更长的键另外分配
+ */
+#define EVPOOL_CACHED_SDS_SIZE 255
+
+/**
+ * 每次填充淘汰池时取样的键数量
+ */
+#define EVICT_DEFAULT_SAMPLES 5
+
+/**
+ * LRU 时钟的最大值和精度（毫秒）
+ */
+#define LRU_CLOCK_MAX ((1 << LRU_BITS) - 1)
+#define LRU_CLOCK_RESOLUTION 1000
+
+/**
+ * LFU 参数
+ */
+#define LFU_INIT_VAL            5   //新对象的访问计数，避免刚写入的键立即被淘汰
+#define LFU_DEFAULT_LOG_FACTOR  10  //访问计数按对数增长的因子，越大增长越慢
+#define LFU_DEFAULT_DECAY_TIME  1   //每经过这么多分钟访问计数减 1 ，为 0 表示不衰减
+
+/**
+ * evictPerform() 的返回值
+ */
+#define EVICT_OK    0   //内存已经不超过上限
+#define EVICT_FAIL  1   //没有可以淘汰的键，内存仍然超过上限
+
+/**
+ * 淘汰池中的候选键，按 idle 从小到大排列，最后一个最应该被淘汰
+ */
+typedef struct evictionPoolEntry
+{
+    unsigned long long idle;    //淘汰的优先程度：LRU 为空闲时间，LFU 为 255 减去访问计数，TTL 为过期时间取反
+    sds key;                    //键的副本，为 NULL 表示这个位置为空
+    sds cached;                 //预先分配的键缓冲区，不太长的键复制到这里
+} evictionPoolEntry;
+
+/**
+ * 淘汰的状态和配置
+ *
+ * 键空间的键为 sds ，值为 robj ；expires 与键空间共享键，值为以毫秒为单位的过期时间（s64）。
+ * 淘汰一个键时先从 expires 中删除，再从键空间中删除，由键空间负责释放键和值。
+ */
+typedef struct evictState
+{
+    dict * keys;            //键空间
+    dict * expires;         //设置了过期时间的键，可以为 NULL
+    size_t maxmemory;       //内存上限，通过 z_malloc_used_memory() 统计，为 0 表示不限制
+    int policy;             //MAXMEMORY_* 之一
+    int samples;            //每次填充淘汰池时取样的键数量
+    int lfuLogFactor;       //LFU 访问计数的对数因子
+    int lfuDecayTime;       //LFU 访问计数的衰减周期（分钟）
+    long long (*clock)(void);   //毫秒时间的来源，默认为 timeInMilliseconds()
+    evictionPoolEntry * pool;   //淘汰池
+    unsigned long long evictedKeys; //累计淘汰的键数量
+} evictState;
+
+/* API */
+void evictInit(evictState * es, dict * keys, dict * expires, size_t maxmemory, int policy);
+void evictRelease(evictState * es);
+unsigned int evictLRUClock(evictState * es);
+unsigned long long evictObjectIdleTime(evictState * es, robj * o);
+unsigned long evictLFUDecrAndReturn(evictState * es, robj * o);
+void evictInitObject(evictState * es, robj * o);
+void evictTouchObject(evictState * es, robj * o);
+int evictPerform(evictState * es);
+
+#endif //REDIS_DESIGN_EVICT_H
@@ -0,0 +1,705 @@
+//
+// Created by Administrator on 2022/3/4.
+//
+
+#include <limits.h>
+#include <string.h>
+#include <time.h>
+
+#include "expire.h"
+#include "zmalloc.h"
+#include "redisassert.h"
+
+/**
+ * 返回单调递增的微秒时间，只用于计算时间预算
+ */
+static long long _expireUsec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((long long)ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint64_t _expireIndexHash(const void * key)
+{
+    return dictGenHashFunction(key, sds_len((sds)key));
+}
+
+static int _expireIndexCompare(void * privData, const void * key1, const void * key2)
+{
+    DICT_NOT_USED(privData);
+    return sds_len((sds)key1) == sds_len((sds)key2) && memcmp(key1, key2, sds_len((sds)key1)) == 0;
+}
+
+/**
+ * 时间轮节点索引的类型，键和值都属于节点，由时间轮释放
+ */
+static dictType expireIndexType = {
+    _expireIndexHash,       /* hash function */
+    NULL,                   /* key dup */
+    NULL,                   /* val dup */
+    _expireIndexCompare,    /* key compare */
+    NULL,                   /* key destructor */
+    NULL,                   /* val destructor */
+    0,                      /* flags */
+    NULL,                   /* embed key len */
+    NULL,                   /* embed key */
+    NULL                    /* key bytes */
+};
+
+/**
+ * 初始化过期状态
+ *
+ * T = O(1)
+ *
+ * @param es 要初始化的过期状态
+ * @param keys 键空间
+ * @param expires 设置了过期时间的键
+ */
+void expireInit(expireState * es, dict * keys, dict * expires)
+{
+    memset(es, 0, sizeof(*es));
+    es->keys = keys;
+    es->expires = expires;
+    es->clock = timeInMilliseconds;
+    es->wheel.index = dictCreate(&expireIndexType, NULL);
+}
+
+/**
+ * 释放时间轮中的所有节点，不影响键空间和 expires
+ *
+ * T = O(N)
+ *
+ * @param es 过期状态
+ */
+void expireRelease(expireState * es)
+{
+    expireWheel * w = &es->wheel;
+    int level, slot;
+
+    for (level = 0; level < EXPIRE_WHEEL_LEVELS; level++)
+    {
+        for (slot = 0; slot < EXPIRE_WHEEL_SLOTS; slot++)
+        {
+            expireWheelNode * n = w->slots[level][slot], * next;
+
+            while (n)
+            {
+                next = n->next;
+                sds_free(n->key);
+                z_free(n);
+                n = next;
+            }
+            w->slots[level][slot] = NULL;
+        }
+        w->bitmap[level] = 0;
+    }
+    w->nodes = 0;
+    dictRelease(w->index);
+    w->index = NULL;
+}
+
+/* ------------------------------- 时间轮 -------------------------------------*/
+
+/**
+ * 把节点插入到时间轮中
+ *
+ * 过期时间与当前 tick 相差不到 64^(L+1) 的节点放在第 L 层，
+ * 它所在的槽在 tick 到达过期时间所在的 64^L 区间时被转到，节点被重新插入到更低的层，
+ * 最终在第 0 层的槽被处理时过期。已经过期的节点放在当前 tick 的槽中。
+ *
+ * T = O(1)
+ *
+ * @param w 时间轮
+ * @param n 节点
+ */
+static void _expireWheelInsert(expireWheel * w, expireWheelNode * n)
+{
+    long long tick = n->when;
+    unsigned long long delta;
+    int level, slot;
+
+    if (tick < w->current) tick = w->current;
+    delta = tick - w->current;
+
+    //超出时间轮范围的节点放在最高层最远的槽中
+    if (delta >> (EXPIRE_WHEEL_BITS * EXPIRE_WHEEL_LEVELS))
+    {
+        delta = (1ULL << (EXPIRE_WHEEL_BITS * EXPIRE_WHEEL_LEVELS)) - 1;
+        tick = w->current + delta;
+    }
+
+    for (level = 0; level < EXPIRE_WHEEL_LEVELS - 1; level++)
+        if ((delta >> (EXPIRE_WHEEL_BITS * (level + 1))) == 0) break;
+
+    slot = (tick >> (EXPIRE_WHEEL_BITS * level)) & EXPIRE_WHEEL_MASK;
+    n->next = w->slots[level][slot];
+    if (n->next) n->next->pprev = &n->next;
+    n->pprev = &w->slots[level][slot];
+    w->slots[level][slot] = n;
+    w->bitmap[level] |= 1ULL << slot;
+}
+
+/**
+ * 把节点从它所在的槽中取出，槽变空时清除 bitmap 中对应的位
+ *
+ * T = O(1)
+ *
+ * @param w 时间轮
+ * @param n 节点
+ */
+static void _expireWheelUnlink(expireWheel * w, expireWheelNode * n)
+{
+    *n->pprev = n->next;
+    if (n->next) n->next->pprev = n->pprev;
+
+    //节点是槽中的第一个节点
+    if (n->pprev >= &w->slots[0][0] && n->pprev <= &w->slots[EXPIRE_WHEEL_LEVELS - 1][EXPIRE_WHEEL_MASK]
+        && *n->pprev == NULL)
+    {
+        long idx = n->pprev - &w->slots[0][0];
+
+        w->bitmap[idx / EXPIRE_WHEEL_SLOTS] &= ~(1ULL << (idx % EXPIRE_WHEEL_SLOTS));
+    }
+}
+
+/**
+ * 是否已经用完时间预算，每 EXPIRE_CYCLE_CHECK_INTERVAL 次调用读一次时钟
+ */
+static int _expireBudgetExceeded(unsigned long * checks, long long start, long long budgetUs)
+{
+    return ++*checks % EXPIRE_CYCLE_CHECK_INTERVAL == 0 && _expireUsec() - start >= budgetUs;
+}
+
+/**
+ * tick 转到第 0 层的起点时，把上层对应槽中的节点重新插入到下层
+ *
+ * 从 w->cascade 层开始，某层也转到起点时再处理更高一层。
+ * 同一时刻过期的大量键会一起被移动，所以这里也受时间预算限制，
+ * 用完时剩下的节点留在原来的槽中，下一次 expireCycle() 先继续移动它们。
+ *
+ * @param w 时间轮，current 已经是新的 tick
+ * @return 完成返回 1 ，用完时间预算返回 0
+ */
+static int _expireWheelCascade(expireWheel * w, unsigned long * checks, long long start, long long budgetUs)
+{
+    while (w->cascade)
+    {
+        int slot = (w->current >> (EXPIRE_WHEEL_BITS * w->cascade)) & EXPIRE_WHEEL_MASK;
+        expireWheelNode ** head = &w->slots[w->cascade][slot];
+
+        //重新插入的节点只会进入更低的层，不会回到这个槽
+        while (*head)
+        {
+            expireWheelNode * n = *head;
+
+            if (_expireBudgetExceeded(checks, start, budgetUs)) return 0;
+            _expireWheelUnlink(w, n);
+            _expireWheelInsert(w, n);
+        }
+        w->bitmap[w->cascade] &= ~(1ULL << slot);
+
+        w->cascade = (slot == 0 && w->cascade < EXPIRE_WHEEL_LEVELS - 1) ? w->cascade + 1 : 0;
+    }
+
+    return 1;
+}
+
+/**
+ * 返回 current 之后第一个需要处理的 tick
+ *
+ * 第 L 层的第 s 个槽在 tick 为 64^L 的整数倍、并且第 L 层的下标为 s 时被转到，
+ * 对每层用 bitmap 找到下一个被转到的非空槽，取最早的一个。
+ * 这样即使时间轮中只有很远的键，长时间没有调用 expireCycle() 之后也不需要逐圈转动。
+ *
+ * T = O(EXPIRE_WHEEL_LEVELS)
+ *
+ * @param w 时间轮
+ * @return 下一个需要处理的 tick ，时间轮为空时返回 LLONG_MAX
+ */
+static long long _expireWheelNext(expireWheel * w)
+{
+    long long next = LLONG_MAX;
+    int level;
+
+    for (level = 0; level < EXPIRE_WHEEL_LEVELS; level++)
+    {
+        int shift = EXPIRE_WHEEL_BITS * level;
+        long long unit = (w->current >> shift) + 1;
+        int rot = unit & EXPIRE_WHEEL_MASK;
+        uint64_t bits = w->bitmap[level];
+        long long tick;
+
+        if (bits == 0) continue;
+
+        //把 bitmap 循环右移，使第 0 位对应下一个单位的槽
+        if (rot) bits = (bits >> rot) | (bits << (EXPIRE_WHEEL_SLOTS - rot));
+        tick = (unit + __builtin_ctzll(bits)) << shift;
+        if (tick < next) next = tick;
+    }
+
+    return next;
+}
+
+/**
+ * 把键的节点移动到新的过期时间，键还没有节点时创建一个
+ */
+static void _expireWheelAdd(expireState * es, sds key, long long when)
+{
+    expireWheel * w = &es->wheel;
+    expireWheelNode * n = dictFetchValue(w->index, key);
+
+    if (n)
+    {
+        _expireWheelUnlink(w, n);
+        n->when = when;
+        _expireWheelInsert(w, n);
+        return;
+    }
+
+    //时间轮为空时，之前的 tick 都不需要处理，直接跳到当前时间
+    if (w->nodes == 0)
+    {
+        w->current = es->clock();
+        w->cascade = 0;
+    }
+
+    n = z_malloc(sizeof(expireWheelNode));
+    n->when = when;
+    n->key = sds_new_len(key, sds_len(key));
+    _expireWheelInsert(w, n);
+    dictAdd(w->index, n->key, n);
+    w->nodes++;
+}
+
+/**
+ * 释放已经从槽中取出的节点
+ */
+static void _expireWheelFree(expireWheel * w, expireWheelNode * n)
+{
+    dictDelete(w->index, n->key);
+    w->nodes--;
+    sds_free(n->key);
+    z_free(n);
+}
+
+/**
+ * 从时间轮中删除键的节点，键没有节点时什么也不做
+ */
+static void _expireWheelRemove(expireState * es, sds key)
+{
+    expireWheelNode * n = dictFetchValue(es->wheel.index, key);
+
+    if (n == NULL) return;
+    _expireWheelUnlink(&es->wheel, n);
+    _expireWheelFree(&es->wheel, n);
+}
+
+/* ------------------------------- 过期时间 -----------------------------------*/
+
+/**
+ * 设置键的过期时间，已经设置的会被覆盖
+ *
+ * 过期时间已经过去的键不会立即删除，由下一次访问或者 expireCycle() 删除
+ *
+ * T = O(1)
+ *
+ * @param es 过期状态
+ * @param key 键
+ * @param when 过期的 UNIX 时间（毫秒）
+ * @return 键不存在返回 DICT_ERR ，否则返回 DICT_OK
+ */
+int expireSet(expireState * es, sds key, long long when)
+{
+    dictEntry * de = dictFind(es->keys, key), * ee;
+
+    if (de == NULL) return DICT_ERR;
+
+    //expires 与键空间共享同一个键
+    key = dictGetKey(de);
+    ee = dictAddOrFind(es->expires, key, NULL);
+    dictSetSignedIntegerVal(ee, when);
+
+    //已经有节点时移动它，每个键在时间轮中只有一个节点
+    _expireWheelAdd(es, key, when);
+
+    return DICT_OK;
+}
+
+/**
+ * 返回键的过期时间
+ *
+ * T = O(1)
+ *
+ * @param es 过期状态
+ * @param key 键
+ * @return 过期的 UNIX 时间（毫秒），键没有设置过期时间返回 -1
+ */
+long long expireGet(expireState * es, sds key)
+{
+    dictEntry * ee = dictFind(es->expires, key);
+
+    return ee ? dictGetSignedIntegerVal(ee) : -1;
+}
+
+/**
+ * 移除键的过期时间，使它不会过期
+ *
+ * T = O(1)
+ *
+ * @param es 过期状态
+ * @param key 键
+ * @return 移除成功返回 DICT_OK ，键没有设置过期时间返回 DICT_ERR
+ */
+int expireRemove(expireState * es, sds key)
+{
+    _expireWheelRemove(es, key);
+    return dictDelete(es->expires, key);
+}
+
+/**
+ * 删除一个键及其过期时间
+ *
+ * key 可能就是键空间中的键，所以先从 expires 中删除，再由键空间释放键和值
+ *
+ * T = O(1)
+ *
+ * @param es 过期状态
+ * @param key 键
+ * @return 删除成功返回 DICT_OK ，键不存在返回 DICT_ERR
+ */
+int expireDeleteKey(expireState * es, sds key)
+{
+    _expireWheelRemove(es, key);
+    dictDelete(es->expires, key);
+    return dictDelete(es->keys, key);
+}
+
+/**
+ * 如果键已经过期，删除它
+ *
+ * 访问键之前调用，保证已经过期但还没有被主动删除的键不会被读到
+ *
+ * T = O(1)
+ *
+ * @param es 过期状态
+ * @param key 键
+ * @return 键已经过期并被删除返回 1 ，否则返回 0
+ */
+int expireIfNeeded(expireState * es, sds key)
+{
+    dictEntry * ee = dictFind(es->expires, key);
+
+    if (ee == NULL || dictGetSignedIntegerVal(ee) > es->clock()) return 0;
+
+    expireDeleteKey(es, key);
+    es->stats.expiredKeys++;
+    es->stats.lazyExpiredKeys++;
+    return 1;
+}
+
+/**
+ * 在键空间中查找键，已经过期的键被删除并视为不存在
+ *
+ * T = O(1)
+ *
+ * @param es 过期状态
+ * @param key 键
+ * @return 键空间中的节点，键不存在或者已经过期返回 NULL
+ */
+dictEntry * expireLookupKey(expireState * es, sds key)
+{
+    expireIfNeeded(es, key);
+    return dictFind(es->keys, key);
+}
+
+/* ------------------------------- 主动过期 -----------------------------------*/
+
+/**
+ * 处理转到的节点，节点已经从槽中取出
+ *
+ * 键已经不在 expires 中时丢弃节点；过期时间已经到达时删除键；
+ * 否则（为超出时间轮范围而提前转到，或者 expires 中的过期时间被直接修改过）
+ * 按 expires 中的过期时间重新插入
+ *
+ * @return 删除了键返回 1 ，否则返回 0
+ */
+static int _expireWheelFire(expireState * es, expireWheelNode * n, long long now)
+{
+    dictEntry * ee = dictFind(es->expires, n->key);
+
+    if (ee == NULL)
+    {
+        es->stats.droppedNodes++;
+        _expireWheelFree(&es->wheel, n);
+        return 0;
+    }
+
+    n->when = dictGetSignedIntegerVal(ee);
+    if (n->when > now)
+    {
+        _expireWheelInsert(&es->wheel, n);
+        return 0;
+    }
+
+    //节点先被释放，expireDeleteKey() 不会再找到它
+    _expireWheelFree(&es->wheel, n);
+    expireDeleteKey(es, dictGetKey(ee));
+    es->stats.expiredKeys++;
+    return 1;
+}
+
+/**
+ * 取样估计 expires 中已经过期但还没有被删除的键的比例，与之前的估计做指数平均
+ */
+static void _expireUpdateStaleRatio(expireState * es, long long now)
+{
+    dictEntry * samples[EXPIRE_STALE_SAMPLES];
+    unsigned long count, stale = 0, j;
+    double ratio = 0;
+
+    if (dictSize(es->expires))
+    {
+        count = dictSampleKeys(es->expires, samples, EXPIRE_STALE_SAMPLES);
+        for (j = 0; j < count; j++)
+            if (dictGetSignedIntegerVal(samples[j]) <= now) stale++;
+        if (count) ratio = (double)stale / count;
+    }
+
+    es->stats.staleRatio = ratio * 0.05 + es->stats.staleRatio * 0.95;
+}
+
+/**
+ * 主动删除过期的键，耗时不超过 budgetUs 微秒
+ *
+ * 从上次停下的 tick 开始转动时间轮直到当前时间，删除转到的槽中已经过期的键。
+ * 时间预算用完时停在当前节点，剩下的键在下一次调用时继续删除，
+ * 所以即使大量的键在同一时刻过期，单次调用的耗时也是有界的。
+ * 应该周期性地调用，例如每 100 毫秒一次。
+ *
+ * T = O(N) ，N 为时间预算内处理的节点数量
+ *
+ * @param es 过期状态
+ * @param budgetUs 时间预算（微秒），小于等于 0 时使用 EXPIRE_CYCLE_BUDGET_US
+ * @return 删除的键数量
+ */
+unsigned long expireCycle(expireState * es, long long budgetUs)
+{
+    expireWheel * w = &es->wheel;
+    long long start = _expireUsec(), elapsed;
+    long long now = es->clock();
+    unsigned long expired = 0, checks = 0;
+    int timedout = 0;
+
+    if (budgetUs <= 0) budgetUs = EXPIRE_CYCLE_BUDGET_US;
+
+    if (w->nodes == 0 && w->current <= now)
+    {
+        w->current = now + 1;
+        w->cascade = 0;
+    }
+
+    while (1)
+    {
+        int idx = w->current & EXPIRE_WHEEL_MASK;
+        expireWheelNode ** slot = &w->slots[0][idx];
+        long long next;
+
+        //先完成上一次没有完成的 cascade
+        if (!_expireWheelCascade(w, &checks, start, budgetUs))
+        {
+            timedout = 1;
+            break;
+        }
+        if (w->current > now) break;
+
+        //逐个取出节点，时间预算用完时剩下的节点留在槽中
+        while (*slot)
+        {
+            expireWheelNode * n = *slot;
+
+            if (_expireBudgetExceeded(&checks, start, budgetUs))
+            {
+                timedout = 1;
+                break;
+            }
+            _expireWheelUnlink(w, n);
+            expired += _expireWheelFire(es, n, now);
+        }
+        if (timedout) break;
+        w->bitmap[0] &= ~(1ULL << idx);
+
+        //跳过连续的空 tick ，直接到下一个要处理的槽或者要 cascade 的槽
+        next = _expireWheelNext(w);
+        if (next > now) next = now + 1;
+
+        w->current = next;
+        if ((w->current & EXPIRE_WHEEL_MASK) == 0)
+            w->cascade = 1;
+    }
+
+    //统计
+    elapsed = _expireUsec() - start;
+    es->stats.cycles++;
+    if (timedout) es->stats.timedOutCycles++;
+    if (elapsed > es->stats.maxCycleUs) es->stats.maxCycleUs = elapsed;
+
+    if (es->rateStart == 0)
+    {
+        es->rateStart = now;
+        es->rateKeys = es->stats.expiredKeys;
+    }
+    else if (now - es->rateStart >= EXPIRE_RATE_WINDOW_MS)
+    {
+        es->stats.expiredPerSec = (double)(es->stats.expiredKeys - es->rateKeys) * 1000 / (now - es->rateStart);
+        es->rateStart = now;
+        es->rateKeys = es->stats.expiredKeys;
+    }
+    _expireUpdateStaleRatio(es, now);
+
+    return expired;
+}
+
+/**
+ * 返回过期的统计信息
+ *
+ * T = O(1)
+ *
+ * @param es 过期状态
+ * @param stats 用于保存结果
+ */
+void expireGetStats(expireState * es, expireStats * stats)
+{
+    *stats = es->stats;
+    stats->wheelNodes = es->wheel.nodes;
+}
+
+#ifdef EXPIRE_BENCHMARK_MAIN
+/* 基准测试：大量的键在同一时刻过期时，主动过期的单次耗时、每秒过期数量和过期键比例
+ *
+ * gcc -O2 -DEXPIRE_BENCHMARK_MAIN -I../other -I../object expire.c dict.c dicthash.c dictslab.c sds.c ../other/zmalloc.c -lpthread -lm
+ * ./a.out [键的数量] [每次调用的时间预算（微秒）]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <malloc.h>
+
+void _redisAssert(char * estr, char * file, int line)
+{
+    fprintf(stderr, "=== ASSERTION FAILED ===\n==> %s:%d '%s' is not true\n", file, line, estr);
+}
+
+/**
+ * sds.c 使用安全函数库的 memcpy_s ，glibc 没有提供，独立构建基准测试时在这里补上
+ */
+int memcpy_s(void * dest, size_t destMax, const void * src, size_t count)
+{
+    if (count > destMax) return -1;
+    memmove(dest, src, count);
+    return 0;
+}
+
+//虚拟时钟：每次 expireCycle() 之间前进 100 毫秒
+static long long bench_now = 1000000;
+
+static long long benchClock(void)
+{
+    return bench_now;
+}
+
+static uint64_t benchSdsHash(const void * key)
+{
+    return dictGenHashFunction(key, sds_len((sds)key));
+}
+
+static int benchSdsCompare(void * privData, const void * key1, const void * key2)
+{
+    DICT_NOT_USED(privData);
+    return sds_len((sds)key1) == sds_len((sds)key2) && memcmp(key1, key2, sds_len((sds)key1)) == 0;
+}
+
+static void benchSdsDestructor(void * privData, void * key)
+{
+    DICT_NOT_USED(privData);
+    sds_free(key);
+}
+
+static dictType benchKeyspaceType = {
+    benchSdsHash,           /* hash function */
+    NULL,                   /* key dup */
+    NULL,                   /* val dup */
+    benchSdsCompare,        /* key compare */
+    benchSdsDestructor,     /* key destructor */
+    NULL,                   /* val destructor */
+    0,                      /* flags */
+    NULL,                   /* embed key len */
+    NULL,                   /* embed key */
+    NULL                    /* key bytes */
+};
+
+static dictType benchExpiresType = {
+    benchSdsHash,           /* hash function */
+    NULL,                   /* key dup */
+    NULL,                   /* val dup */
+    benchSdsCompare,        /* key compare */
+    NULL,                   /* key destructor */
+    NULL,                   /* val destructor */
+    0,                      /* flags */
+    NULL,                   /* embed key len */
+    NULL,                   /* embed key */
+    NULL                    /* key bytes */
+};
+
+int main(int argc, char ** argv)
+{
+    unsigned long keys = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+    long long budget = argc > 2 ? atoll(argv[2]) : EXPIRE_CYCLE_BUDGET_US;
+    dict * d = dictCreate(&benchKeyspaceType, NULL);
+    dict * e = dictCreate(&benchExpiresType, NULL);
+    expireState es;
+    expireStats st;
+    unsigned long i, cycle;
+    char buf[32];
+
+    //关闭 glibc 的 fastbin ：否则收缩哈希表时分配大块内存会先合并之前释放的几十万个小块，
+    //产生几百毫秒的停顿，这是分配器的开销，与过期无关
+    mallopt(M_MXFAST, 0);
+
+    expireInit(&es, d, e);
+    es.clock = benchClock;
+
+    //一半的键在同一毫秒过期，另一半在之后的 10 分钟内均匀过期
+    for (i = 0; i < keys; i++)
+    {
+        sds key = sds_new_len(buf, snprintf(buf, sizeof(buf), "key:%lu", i));
+        long long when = i % 2 ? bench_now + 5000 : bench_now + 5000 + rand() % 600000;
+
+        dictAdd(d, key, NULL);
+        expireSet(&es, key, when);
+    }
+    printf("keys=%lu budget=%lldus\n", keys, budget);
+
+    for (cycle = 0; dictSize(e) && cycle < 100000; cycle++)
+    {
+        bench_now += 100;
+        expireCycle(&es, budget);
+        if (cycle % 50 == 49)
+        {
+            expireGetStats(&es, &st);
+            printf("t=%6.1fs keys=%8lu expired/s=%10.0f stale=%.3f max_cycle=%lldus timedout=%llu\n",
+                   (cycle + 1) / 10.0, dictSize(d), st.expiredPerSec, st.staleRatio,
+                   st.maxCycleUs, st.timedOutCycles);
+        }
+    }
+
+    expireGetStats(&es, &st);
+    printf("done cycles=%llu expired=%llu dropped=%llu max_cycle=%lldus wheel_nodes=%lu\n",
+           st.cycles, st.expiredKeys, st.droppedNodes, st.maxCycleUs, st.wheelNodes);
+
+    expireRelease(&es);
+    dictRelease(e);
+    dictRelease(d);
+    return 0;
+}
+#endif
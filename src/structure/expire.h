@@ -0,0 +1,121 @@
+//
+// Created by Administrator on 2022/3/4.
+//
+
+#ifndef REDIS_DESIGN_EXPIRE_H
+#define REDIS_DESIGN_EXPIRE_H
+
+#include <stdint.h>
+
+#include "dict.h"
+#include "sds.h"
+
+/**
+ * 时间轮以毫秒为 tick 转动，每层 2^EXPIRE_WHEEL_BITS 个槽，共 EXPIRE_WHEEL_LEVELS 层，
+ * 第 L 层的一个槽覆盖 64^L 个 tick ，5 层可以直接容纳大约 12 天之内的过期时间，
+ * 更远的键先放在最高层最远的槽中，转到时重新插入
+ */
+#define EXPIRE_WHEEL_BITS   6
+#define EXPIRE_WHEEL_SLOTS  (1 << EXPIRE_WHEEL_BITS)
+#define EXPIRE_WHEEL_MASK   (EXPIRE_WHEEL_SLOTS - 1)
+#define EXPIRE_WHEEL_LEVELS 5
+
+/**
+ * expireCycle() 默认的时间预算（微秒）
+ */
+#define EXPIRE_CYCLE_BUDGET_US 1000
+
+/**
+ * 每处理这么多个节点或者空 tick 检查一次是否超出时间预算
+ */
+#define EXPIRE_CYCLE_CHECK_INTERVAL 16
+
+/**
+ * 每次 expireCycle() 结束时取样这么多个键，估计已经过期但还没有被删除的键的比例
+ */
+#define EXPIRE_STALE_SAMPLES 20
+
+/**
+ * 计算每秒过期键数量的统计窗口（毫秒）
+ */
+#define EXPIRE_RATE_WINDOW_MS 1000
+
+/**
+ * 时间轮中的节点
+ *
+ * 每个设置了过期时间的键在时间轮中只有一个节点，由 expireWheel.index 找到：
+ * 重新设置过期时间时移动这个节点，移除过期时间或者删除键时释放它。
+ * 节点保存键的副本而不是键空间中的键，绕过 expireState 从 expires 中删除的键（比如被 evict 淘汰）
+ * 的节点留在时间轮中，转到时才被丢弃。
+ */
+typedef struct expireWheelNode
+{
+    struct expireWheelNode * next;
+    struct expireWheelNode ** pprev;    //指向本节点的指针（槽或者前一个节点的 next）的地址
+    long long when;     //过期时间（毫秒）
+    sds key;            //键的副本
+} expireWheelNode;
+
+/**
+ * 分层时间轮
+ *
+ * 第 0 层的槽按 tick 转动，每转完一圈把上一层的下一个槽中的节点重新插入到下层（cascade）。
+ * 处理和 cascade 都可以在节点之间中断，由下一次 expireCycle() 继续。
+ * bitmap 记录每层哪些槽非空，处理时可以跳过连续的空 tick 和空的圈。
+ */
+typedef struct expireWheel
+{
+    expireWheelNode * slots[EXPIRE_WHEEL_LEVELS][EXPIRE_WHEEL_SLOTS];
+    uint64_t bitmap[EXPIRE_WHEEL_LEVELS];
+    long long current;      //下一个要处理的 tick ，之前的 tick 都已经处理完
+    int cascade;            //还没有完成 cascade 的层，为 0 表示没有
+    unsigned long nodes;    //时间轮中的节点数量，包括键已经不在 expires 中的节点
+    dict * index;           //键到它的节点，键为节点中的副本
+} expireWheel;
+
+/**
+ * 过期的统计信息
+ */
+typedef struct expireStats
+{
+    unsigned long long expiredKeys;     //累计过期删除的键数量
+    unsigned long long lazyExpiredKeys; //其中在访问时惰性删除的键数量
+    unsigned long long droppedNodes;    //转到时键已经不在 expires 中而被丢弃的时间轮节点数量
+    unsigned long long cycles;          //expireCycle() 的调用次数
+    unsigned long long timedOutCycles;  //其中用完了时间预算的次数
+    long long maxCycleUs;               //单次 expireCycle() 的最长耗时（微秒）
+    double expiredPerSec;               //最近一个统计窗口内每秒过期的键数量
+    double staleRatio;                  //估计的已经过期但还没有被删除的键占 expires 的比例
+    unsigned long wheelNodes;           //时间轮中的节点数量
+} expireStats;
+
+/**
+ * 过期的状态
+ *
+ * 键空间的键为 sds ；expires 与键空间共享键，值为以毫秒为单位的过期时间（s64），不释放键和值。
+ * 与 evictState 使用同一对字典时，两者删除键的顺序一致：先从 expires 中删除，再从键空间中删除。
+ */
+typedef struct expireState
+{
+    dict * keys;                //键空间
+    dict * expires;             //设置了过期时间的键
+    long long (*clock)(void);   //毫秒时间的来源，默认为 timeInMilliseconds()
+    expireWheel wheel;          //主动过期用的时间轮
+    expireStats stats;
+    long long rateStart;        //当前统计窗口的开始时间
+    unsigned long long rateKeys;    //当前统计窗口开始时的 expiredKeys
+} expireState;
+
+/* API */
+void expireInit(expireState * es, dict * keys, dict * expires);
+void expireRelease(expireState * es);
+int expireSet(expireState * es, sds key, long long when);
+long long expireGet(expireState * es, sds key);
+int expireRemove(expireState * es, sds key);
+int expireDeleteKey(expireState * es, sds key);
+int expireIfNeeded(expireState * es, sds key);
+dictEntry * expireLookupKey(expireState * es, sds key);
+unsigned long expireCycle(expireState * es, long long budgetUs);
+void expireGetStats(expireState * es, expireStats * stats);
+
+#endif //REDIS_DESIGN_EXPIRE_H
@@ -0,0 +1,303 @@
+//
+// Created by Administrator on 2022/3/4.
+//
+
+#include <pthread.h>
+
+#include "lazyfree.h"
+#include "zmalloc.h"
+#include "redisassert.h"
+
+//后台任务的类型
+#define LAZYFREE_JOB_OBJECT     0   //调用 freeFn 释放对象
+#define LAZYFREE_JOB_SKIPLIST   1   //释放跳跃表，并对每个成员调用 freeObj
+
+/**
+ * 交给后台线程的释放任务
+ */
+typedef struct lazyfreeJob
+{
+    int type;       //任务的类型
+    void * ptr;     //要释放的对象
+    union {
+        lazyfreeFunction * freeFn;      //LAZYFREE_JOB_OBJECT 的释放函数
+        void (*freeObj)(robj * obj);    //LAZYFREE_JOB_SKIPLIST 的成员释放函数，可以为 NULL
+    };
+    size_t bytes;   //对象估计占用的字节数
+} lazyfreeJob;
+
+/**
+ * 后台释放线程的状态，由 lock 保护
+ */
+static struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t jobCond;     //有新任务时通知后台线程
+    pthread_cond_t doneCond;    //任务全部完成时通知 lazyfreeDrain()
+    list * jobs;                //等待执行的任务队列
+    pthread_t thread;
+    lazyfreeStats stats;
+} lazyfree;
+
+static pthread_once_t lazyfree_once = PTHREAD_ONCE_INIT;
+
+/**
+ * 释放跳跃表及其所有节点
+ *
+ * T = O(N)
+ *
+ * @param zsl 跳跃表
+ * @param freeObj 成员的释放函数，可以为 NULL
+ */
+static void _lazyfreeSkiplistSync(zskiplist * zsl, void (*freeObj)(robj * obj))
+{
+    zskiplistNode * node = zsl->header->level[0].forward, * next;
+
+    //表头节点不保存成员
+    z_free(zsl->header);
+    while (node)
+    {
+        next = node->level[0].forward;
+        if (freeObj) freeObj(node->obj);
+        z_free(node);
+        node = next;
+    }
+    z_free(zsl);
+}
+
+/**
+ * 执行一个释放任务
+ */
+static void _lazyfreeRun(lazyfreeJob * job)
+{
+    if (job->type == LAZYFREE_JOB_SKIPLIST)
+        _lazyfreeSkiplistSync(job->ptr, job->freeObj);
+    else
+        job->freeFn(job->ptr);
+}
+
+/**
+ * 后台释放线程的主函数
+ */
+static void * _lazyfreeMain(void * arg)
+{
+    DICT_NOT_USED(arg);
+
+    pthread_mutex_lock(&lazyfree.lock);
+    while (1)
+    {
+        listNode * ln;
+        lazyfreeJob * job;
+
+        while (listLength(lazyfree.jobs) == 0)
+            pthread_cond_wait(&lazyfree.jobCond, &lazyfree.lock);
+
+        ln = listFirst(lazyfree.jobs);
+        job = listNodeValue(ln);
+        listDelNode(lazyfree.jobs, ln);
+
+        //释放在锁外进行，主线程提交任务时不会被阻塞
+        pthread_mutex_unlock(&lazyfree.lock);
+        _lazyfreeRun(job);
+        pthread_mutex_lock(&lazyfree.lock);
+
+        lazyfree.stats.pendingObjects--;
+        lazyfree.stats.pendingBytes -= job->bytes;
+        lazyfree.stats.freedObjects++;
+        lazyfree.stats.freedBytes += job->bytes;
+        if (lazyfree.stats.pendingObjects == 0)
+            pthread_cond_broadcast(&lazyfree.doneCond);
+        z_free(job);
+    }
+
+    return NULL;
+}
+
+/**
+ * 第一次提交后台任务时初始化并启动后台线程
+ */
+static void _lazyfreeInit(void)
+{
+    pthread_mutex_init(&lazyfree.lock, NULL);
+    pthread_cond_init(&lazyfree.jobCond, NULL);
+    pthread_cond_init(&lazyfree.doneCond, NULL);
+    lazyfree.jobs = listCreate();
+    if (pthread_create(&lazyfree.thread, NULL, _lazyfreeMain, NULL) != 0)
+        assert(0 && "can't create lazyfree thread");
+}
+
+/**
+ * 释放代价超过阈值时把任务交给后台线程，否则直接执行
+ *
+ * @param job 在栈上准备好的任务
+ * @param cost 释放代价
+ * @return 交给后台线程返回 1 ，直接释放返回 0
+ */
+static int _lazyfreeSubmit(lazyfreeJob * job, size_t cost)
+{
+    lazyfreeJob * copy;
+
+    if (cost <= LAZYFREE_THRESHOLD)
+    {
+        _lazyfreeRun(job);
+        return 0;
+    }
+
+    pthread_once(&lazyfree_once, _lazyfreeInit);
+
+    copy = z_malloc(sizeof(lazyfreeJob));
+    *copy = *job;
+
+    pthread_mutex_lock(&lazyfree.lock);
+    listAddNodeTail(lazyfree.jobs, copy);
+    lazyfree.stats.pendingObjects++;
+    lazyfree.stats.pendingBytes += job->bytes;
+    pthread_cond_signal(&lazyfree.jobCond);
+    pthread_mutex_unlock(&lazyfree.lock);
+
+    return 1;
+}
+
+/**
+ * 释放一个已经从所有数据结构中摘除的对象，代价大时交给后台线程
+ *
+ * 调用之后调用者不能再访问这个对象，freeFn 可能在后台线程中执行，必须是线程安全的
+ *
+ * T = O(1)（交给后台线程时）
+ *
+ * @param ptr 要释放的对象
+ * @param freeFn 释放对象的函数
+ * @param cost 释放代价，通常是需要释放的内存块数量
+ * @param bytes 对象估计占用的字节数，只用于统计
+ * @return 交给后台线程返回 1 ，直接释放返回 0
+ */
+int lazyfreeObject(void * ptr, lazyfreeFunction * freeFn, size_t cost, size_t bytes)
+{
+    lazyfreeJob job;
+
+    job.type = LAZYFREE_JOB_OBJECT;
+    job.ptr = ptr;
+    job.freeFn = freeFn;
+    job.bytes = bytes;
+
+    return _lazyfreeSubmit(&job, cost);
+}
+
+static void _lazyfreeDictRelease(void * ptr)
+{
+    dictRelease(ptr);
+}
+
+/**
+ * 释放字典及其中所有的键值对，节点多时交给后台线程
+ *
+ * 字典的键值释放函数可能在后台线程中执行。
+ * 开启了无锁读的字典，调用者需要保证已经没有读者会访问它。
+ *
+ * T = O(1)（交给后台线程时）
+ *
+ * @param d 要释放的字典
+ * @return 交给后台线程返回 1 ，直接释放返回 0
+ */
+int lazyfreeDict(dict * d)
+{
+    size_t cost;
+
+    //slab 中不需要释放键值的节点随页一起释放
+    if (dictUsesSlab(d) && !d->type->keyDestructor && !d->type->valDestructor)
+        cost = d->slab.numPages;
+    else
+        cost = dictSize(d) * (1 + (d->type->keyDestructor != NULL) + (d->type->valDestructor != NULL));
+
+    return lazyfreeObject(d, _lazyfreeDictRelease, cost, dictMemoryUsage(d));
+}
+
+static void _lazyfreeListRelease(void * ptr)
+{
+    listRelease(ptr);
+}
+
+/**
+ * 释放链表及其所有节点，节点多时交给后台线程
+ *
+ * T = O(1)（交给后台线程时）
+ *
+ * @param l 要释放的链表
+ * @return 交给后台线程返回 1 ，直接释放返回 0
+ */
+int lazyfreeList(list * l)
+{
+    size_t cost = listLength(l) * (1 + (listGetFreeMethod(l) != NULL));
+
+    return lazyfreeObject(l, _lazyfreeListRelease, cost,
+                          sizeof(list) + listLength(l) * sizeof(listNode));
+}
+
+/**
+ * 释放整数集合
+ *
+ * 整数集合只占用一块连续的内存，释放代价总是 1 ，所以总是直接释放
+ *
+ * T = O(1)
+ *
+ * @param is 要释放的整数集合
+ * @return 总是返回 0
+ */
+int lazyfreeIntset(intset * is)
+{
+    return lazyfreeObject(is, z_free, 1, intsetBlobLen(is));
+}
+
+/**
+ * 释放跳跃表及其所有节点，节点多时交给后台线程
+ *
+ * T = O(1)（交给后台线程时）
+ *
+ * @param zsl 要释放的跳跃表
+ * @param freeObj 成员的释放函数，可以为 NULL ，可能在后台线程中执行
+ * @return 交给后台线程返回 1 ，直接释放返回 0
+ */
+int lazyfreeSkiplist(zskiplist * zsl, void (*freeObj)(robj * obj))
+{
+    lazyfreeJob job;
+
+    job.type = LAZYFREE_JOB_SKIPLIST;
+    job.ptr = zsl;
+    job.freeObj = freeObj;
+    //节点的平均层数为 4/3
+    job.bytes = sizeof(zskiplist) +
+                zsl->length * (sizeof(zskiplistNode) + sizeof(struct zxkiplistLevel) * 4 / 3);
+
+    return _lazyfreeSubmit(&job, zsl->length * (1 + (freeObj != NULL)));
+}
+
+/**
+ * 返回后台释放的统计信息
+ *
+ * T = O(1)
+ *
+ * @param stats 用于保存结果
+ */
+void lazyfreeGetStats(lazyfreeStats * stats)
+{
+    pthread_once(&lazyfree_once, _lazyfreeInit);
+
+    pthread_mutex_lock(&lazyfree.lock);
+    *stats = lazyfree.stats;
+    pthread_mutex_unlock(&lazyfree.lock);
+}
+
+/**
+ * 等待所有已经提交的后台释放任务完成
+ *
+ * T = O(N)
+ */
+void lazyfreeDrain(void)
+{
+    pthread_once(&lazyfree_once, _lazyfreeInit);
+
+    pthread_mutex_lock(&lazyfree.lock);
+    while (lazyfree.stats.pendingObjects)
+        pthread_cond_wait(&lazyfree.doneCond, &lazyfree.lock);
+    pthread_mutex_unlock(&lazyfree.lock);
+}
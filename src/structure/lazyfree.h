@@ -0,0 +1,46 @@
+//
+// Created by Administrator on 2022/3/4.
+//
+
+#ifndef REDIS_DESIGN_LAZYFREE_H
+#define REDIS_DESIGN_LAZYFREE_H
+
+#include <stddef.h>
+
+#include "adlist.h"
+#include "dict.h"
+#include "intset.h"
+#include "redis.h"
+
+/**
+ * 释放代价（需要释放的内存块数量）超过这个值的对象交给后台线程释放，
+ * 否则在调用者的线程中直接释放，避免为小对象付出线程间传递的开销
+ */
+#define LAZYFREE_THRESHOLD 64
+
+/**
+ * 后台释放的统计信息
+ */
+typedef struct lazyfreeStats
+{
+    unsigned long pendingObjects;   //已经交给后台线程但还没有释放的对象数量
+    size_t pendingBytes;            //这些对象估计占用的字节数
+    unsigned long freedObjects;     //后台线程累计释放的对象数量
+    size_t freedBytes;              //后台线程累计释放的估计字节数
+} lazyfreeStats;
+
+/**
+ * 释放对象的函数
+ */
+typedef void (lazyfreeFunction)(void * ptr);
+
+/* API */
+int lazyfreeObject(void * ptr, lazyfreeFunction * freeFn, size_t cost, size_t bytes);
+int lazyfreeDict(dict * d);
+int lazyfreeList(list * l);
+int lazyfreeIntset(intset * is);
+int lazyfreeSkiplist(zskiplist * zsl, void (*freeObj)(robj * obj));
+void lazyfreeGetStats(lazyfreeStats * stats);
+void lazyfreeDrain(void);
+
+#endif //REDIS_DESIGN_LAZYFREE_H
@@ -5,19 +5,21 @@
 #ifndef REDIS_DESIGN_REDIS_H
 #define REDIS_DESIGN_REDIS_H
 
+#include "robj.h"
+
 /**
  * 跳跃表节点的实现。
  */
 typedef struct zskiplistNode
 {
+    robj * obj;         //成员对象
+    double score;       //分值
+    struct zskiplistNode * backward;    //后退指针
     struct zxkiplistLevel
     {
         struct zskiplistNode * forward; //前进指针
         unsigned int span;              //跨度
-    } level[];                          //层
-    struct zskiplistNode * backward;    //后退指针
-    double score;       //分值
-    robj * obj;         //成员对象
+    } level[];                          //层，柔性数组成员必须位于结构的最后
 } zskiplistNode;
 
 /**